@@ -0,0 +1,197 @@
+#include <myrmo/bench/timer.h>
+#include <myrmo/cache/disk.h>
+#include <myrmo/cache/async_disk.h>
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <future>
+#include <cstdio>
+
+// The benchmarks measure the cache itself, so keys are hashed with a cheap fixed width hash instead of SHA1.
+static std::string fast_hash(const std::string& uri)
+{
+	char buf[17];
+	snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)std::hash<std::string>()(uri));
+	return std::string(buf, 16);
+}
+
+static std::string make_uri(size_t i)
+{
+	return "https://example.com/item/" + std::to_string(i);
+}
+
+// Compares the copying read with the memory-mapped view read for items of the given size. The files are in the
+// page cache after the first pass, so this measures hot disk hits.
+void bench_read(size_t itemSize, size_t count)
+{
+	using namespace myrmo::cache;
+
+	DiskCache cache(MYRMO_BENCHMARKS_CACHE_DIR, fast_hash, new policy::LRU(), (itemSize * count) / 1048576 + 1);
+	cache.clear();
+	std::vector<char> payload(itemSize, 'x');
+	for (size_t i = 0; i < count; i++)
+		cache.write(make_uri(i), payload.data(), itemSize);
+
+	const size_t reads = std::max<size_t>(2000, 20 * count);
+	std::vector<std::string> uris;
+	for (size_t i = 0; i < reads; i++)
+		uris.push_back(make_uri(i % count));
+
+	std::vector<char> data;
+	myrmo::bench::Timer timer;
+	for (const auto& uri : uris)
+	{
+		cache.read(uri, &data);
+		myrmo::bench::do_not_optimize(data.data()[itemSize / 2]);
+	}
+	const double copyNs = double(timer.nanoseconds()) / reads;
+
+	DiskCache::View view;
+	timer.restart();
+	for (const auto& uri : uris)
+	{
+		cache.read(uri, &view);
+		myrmo::bench::do_not_optimize(view.data()[itemSize / 2]);
+	}
+	const double viewNs = double(timer.nanoseconds()) / reads;
+	view.release();
+
+	printf("items of %8zu B: %9.0f ns/read (copy), %9.0f ns/read (view)\n", itemSize, copyNs, viewNs);
+	cache.clear();
+}
+
+// Writes and reads back small items, stored in a file each or packed into segment files.
+void bench_small_items(size_t itemSize, size_t count, size_t maxSegmentEntrySize)
+{
+	using namespace myrmo::cache;
+
+	const DiskCache::SegmentOptions segments(maxSegmentEntrySize);
+	DiskCache cache(MYRMO_BENCHMARKS_CACHE_DIR, fast_hash, new policy::LRU(), (itemSize * count) / 1048576 + 1, segments);
+	cache.clear();
+	std::vector<char> payload(itemSize, 'x');
+
+	myrmo::bench::Timer timer;
+	for (size_t i = 0; i < count; i++)
+		cache.write(make_uri(i), payload.data(), itemSize);
+	const double writeNs = double(timer.nanoseconds()) / count;
+
+	std::vector<char> data;
+	timer.restart();
+	for (size_t i = 0; i < count; i++)
+	{
+		cache.read(make_uri(i), &data);
+		myrmo::bench::do_not_optimize(data.data()[itemSize / 2]);
+	}
+	const double readNs = double(timer.nanoseconds()) / count;
+
+	timer.restart();
+	cache.clear();
+	const double clearNs = double(timer.nanoseconds()) / count;
+
+	printf("%6zu items of %5zu B, %-13s: %7.0f ns/write, %7.0f ns/read, %7.0f ns/remove\n", count, itemSize,
+		maxSegmentEntrySize ? "segments" : "file per item", writeNs, readNs, clearNs);
+}
+
+// Writes, reads back and removes items in batches of batchSize with the given I/O backend. Removing the items
+// through clear() unlinks them in one batch.
+void bench_io_backend(size_t itemSize, size_t count, size_t batchSize, myrmo::cache::DiskCache::IoBackend backend)
+{
+	using namespace myrmo::cache;
+
+	DiskCache cache(MYRMO_BENCHMARKS_CACHE_DIR, fast_hash, new policy::LRU(), (itemSize * count) / 1048576 + 1, DiskCache::SegmentOptions(), backend);
+	cache.clear();
+	std::vector<char> payload(itemSize, 'x');
+	std::vector<std::string> uris;
+	for (size_t i = 0; i < count; i++)
+		uris.push_back(make_uri(i));
+
+	myrmo::bench::Timer timer;
+	for (size_t begin = 0; begin < count; begin += batchSize)
+	{
+		std::vector<WriteItem> items;
+		for (size_t i = begin; i < std::min(count, begin + batchSize); i++)
+			items.push_back(WriteItem(uris[i], payload.data(), itemSize));
+		cache.writeMany(items);
+	}
+	const double writeNs = double(timer.nanoseconds()) / count;
+
+	std::vector<std::vector<char>> data;
+	timer.restart();
+	for (size_t begin = 0; begin < count; begin += batchSize)
+	{
+		cache.readMany(std::vector<std::string>(uris.begin() + begin, uris.begin() + std::min(count, begin + batchSize)), &data);
+		myrmo::bench::do_not_optimize(data.back().data()[itemSize / 2]);
+	}
+	const double readNs = double(timer.nanoseconds()) / count;
+
+	timer.restart();
+	cache.clear();
+	const double clearNs = double(timer.nanoseconds()) / count;
+
+	printf("%6zu items of %6zu B in batches of %3zu, %-8s: %7.0f ns/write, %7.0f ns/read, %7.0f ns/remove\n", count, itemSize,
+		batchSize, (cache.ioBackend() == DiskCache::IoBackend::IoUring) ? "io_uring" : "streams", writeNs, readNs, clearNs);
+}
+
+// Compares the time the calling thread spends per write with synchronous and asynchronous writes, and the time
+// until all asynchronous writes are on disk.
+void bench_async_writes(size_t itemSize, size_t count, size_t workerCount)
+{
+	using namespace myrmo::cache;
+
+	const size_t cacheSizeInMegaBytes = (itemSize * count) / 1048576 + 1;
+	std::vector<char> payload(itemSize, 'x');
+	double syncNs = 0;
+	{
+		DiskCache cache(MYRMO_BENCHMARKS_CACHE_DIR, fast_hash, new policy::LRU(), cacheSizeInMegaBytes);
+		cache.clear();
+		myrmo::bench::Timer timer;
+		for (size_t i = 0; i < count; i++)
+			cache.write(make_uri(i), payload.data(), itemSize);
+		syncNs = double(timer.nanoseconds()) / count;
+		cache.clear();
+	}
+
+	AsyncDiskCache cache(new DiskCache(MYRMO_BENCHMARKS_CACHE_DIR, fast_hash, new policy::LRU(), cacheSizeInMegaBytes), workerCount);
+	std::vector<std::future<DiskCache::Error>> writes;
+	writes.reserve(count);
+	myrmo::bench::Timer timer;
+	for (size_t i = 0; i < count; i++)
+		writes.push_back(cache.writeAsync(make_uri(i), payload));
+	const double callerNs = double(timer.nanoseconds()) / count;
+	cache.flush();
+	const double totalNs = double(timer.nanoseconds()) / count;
+	cache.clear();
+
+	printf("%5zu items of %7zu B, %zu workers: %8.0f ns/write (sync), %8.0f ns/write (async caller), %8.0f ns/write (async total)\n",
+		count, itemSize, workerCount, syncNs, callerNs, totalNs);
+}
+
+int main()
+{
+	printf("DiskCache read\n");
+	bench_read(4096, 500);
+	bench_read(65536, 200);
+	bench_read(1048576, 50);
+
+	printf("\nDiskCache small items\n");
+	bench_small_items(1024, 20000, 0);
+	bench_small_items(1024, 20000, 4096);
+	bench_small_items(4096, 20000, 0);
+	bench_small_items(4096, 20000, 4096);
+
+	printf("\nDiskCache I/O backends\n");
+	for (const size_t itemSize : { 4096, 65536 })
+	{
+		bench_io_backend(itemSize, 4000, 64, myrmo::cache::DiskCache::IoBackend::Streams);
+		bench_io_backend(itemSize, 4000, 64, myrmo::cache::DiskCache::IoBackend::IoUring);
+	}
+
+	printf("\nDiskCache async writes\n");
+	bench_async_writes(4096, 5000, 1);
+	bench_async_writes(4096, 5000, 2);
+	bench_async_writes(65536, 1000, 2);
+	bench_async_writes(65536, 1000, 4);
+
+	return 0;
+}
@@ -0,0 +1,148 @@
+#include <myrmo/bench/timer.h>
+#include <myrmo/cache/memory.h>
+
+#include <string>
+#include <vector>
+#include <random>
+#include <functional>
+#include <cstdio>
+
+// The benchmarks measure the cache itself, so keys are hashed with a cheap fixed width hash instead of SHA1.
+static std::string fast_hash(const std::string& uri)
+{
+	char buf[17];
+	snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)std::hash<std::string>()(uri));
+	return std::string(buf, 16);
+}
+
+static std::string make_uri(size_t i)
+{
+	return "https://example.com/item/" + std::to_string(i);
+}
+
+// Fills the cache to twice its size limit and reports the average write time per fill level. Once the cache is
+// full every write evicts, so the last rows show the eviction cost as the cache runs at its size limit. The first
+// rows also include the page faults from touching the arena memory for the first time.
+void bench_write_and_evict(size_t cacheSizeInMegaBytes, size_t minItemSize, size_t maxItemSize)
+{
+	using namespace myrmo::cache;
+
+	const size_t maxCacheSize = cacheSizeInMegaBytes * 1048576;
+	MemoryCache cache(fast_hash, new policy::LRU(), cacheSizeInMegaBytes);
+
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<size_t> sizeDist(minItemSize, maxItemSize);
+	std::vector<char> payload(maxItemSize, 'x');
+
+	const size_t buckets = 8; // Quarter fill levels up to 200 % of the size limit.
+	std::vector<uint64_t> bucketNs(buckets, 0);
+	std::vector<size_t> bucketWrites(buckets, 0);
+
+	size_t written = 0;
+	size_t i = 0;
+	while (written < 2 * maxCacheSize)
+	{
+		const size_t size = sizeDist(rng);
+		const size_t bucket = std::min(buckets - 1, (written * 4) / maxCacheSize);
+		const std::string uri = make_uri(i++);
+
+		myrmo::bench::Timer timer;
+		cache.write(uri, payload.data(), size);
+		bucketNs[bucket] += timer.nanoseconds();
+		bucketWrites[bucket]++;
+		written += size;
+	}
+
+	printf("cache %4zu MiB, items %6zu-%6zu B, %zu items cached at the end\n", cacheSizeInMegaBytes, minItemSize, maxItemSize, cache.count());
+	for (size_t b = 0; b < buckets; b++)
+	{
+		if (bucketWrites[b] == 0)
+			continue;
+		printf("  written %3zu-%3zu %% of limit: %8.0f ns/write (%zu writes)\n", b * 25, (b + 1) * 25,
+			double(bucketNs[b]) / bucketWrites[b], bucketWrites[b]);
+	}
+}
+
+// Removes items from a full cache in random order and reports the average time per removal.
+void bench_remove(size_t cacheSizeInMegaBytes, size_t itemSize)
+{
+	using namespace myrmo::cache;
+
+	MemoryCache cache(fast_hash, new policy::LRU(), cacheSizeInMegaBytes);
+	std::vector<char> payload(itemSize, 'x');
+
+	const size_t count = (cacheSizeInMegaBytes * 1048576) / itemSize;
+	std::vector<size_t> order;
+	for (size_t i = 0; i < count; i++)
+	{
+		cache.write(make_uri(i), payload.data(), itemSize);
+		order.push_back(i);
+	}
+	std::shuffle(order.begin(), order.end(), std::mt19937(4321));
+
+	myrmo::bench::Timer timer;
+	for (size_t i : order)
+		cache.remove(make_uri(i));
+	const double ns = double(timer.nanoseconds()) / count;
+
+	printf("cache %4zu MiB, %6zu items of %6zu B: %8.0f ns/remove\n", cacheSizeInMegaBytes, count, itemSize, ns);
+}
+
+// Compares the copying read with the zero-copy handle read for items of the given size.
+void bench_read(size_t cacheSizeInMegaBytes, size_t itemSize)
+{
+	using namespace myrmo::cache;
+
+	MemoryCache cache(fast_hash, new policy::LRU(), cacheSizeInMegaBytes);
+	std::vector<char> payload(itemSize, 'x');
+	const size_t count = (cacheSizeInMegaBytes * 1048576) / itemSize;
+	for (size_t i = 0; i < count; i++)
+		cache.write(make_uri(i), payload.data(), itemSize);
+
+	const size_t reads = 20000;
+	std::vector<std::string> uris;
+	for (size_t i = 0; i < reads; i++)
+		uris.push_back(make_uri(i % count));
+
+	std::vector<char> data;
+	myrmo::bench::Timer timer;
+	for (const auto& uri : uris)
+	{
+		cache.read(uri, &data);
+		myrmo::bench::do_not_optimize(data.data()[itemSize / 2]);
+	}
+	const double copyNs = double(timer.nanoseconds()) / reads;
+
+	MemoryCache::Handle handle;
+	timer.restart();
+	for (const auto& uri : uris)
+	{
+		cache.read(uri, &handle);
+		myrmo::bench::do_not_optimize(handle.data()[itemSize / 2]);
+	}
+	const double handleNs = double(timer.nanoseconds()) / reads;
+	handle.release();
+
+	printf("items of %7zu B: %8.0f ns/read (copy), %8.0f ns/read (handle)\n", itemSize, copyNs, handleNs);
+}
+
+int main()
+{
+	printf("MemoryCache write/evict\n");
+	bench_write_and_evict(16, 1024, 65536);
+	bench_write_and_evict(64, 1024, 65536);
+	bench_write_and_evict(256, 1024, 65536);
+	bench_write_and_evict(256, 100000, 350000);
+
+	printf("\nMemoryCache remove\n");
+	bench_remove(16, 4096);
+	bench_remove(64, 4096);
+	bench_remove(256, 4096);
+
+	printf("\nMemoryCache read\n");
+	bench_read(64, 1024);
+	bench_read(64, 32768);
+	bench_read(64, 300000);
+
+	return 0;
+}
@@ -0,0 +1,163 @@
+#include <myrmo/bench/timer.h>
+#include <myrmo/cache/policy.h>
+
+#include <string>
+#include <vector>
+#include <random>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+static std::string make_hash(size_t i)
+{
+	char buf[17];
+	snprintf(buf, sizeof(buf), "%016zx", i);
+	return std::string(buf, 16);
+}
+
+// Draws keys 0..n-1 where key k has probability proportional to 1 / (k + 1)^s. The keys are shuffled so that
+// hot keys are not clustered at low numbers.
+class ZipfGenerator
+{
+public:
+	ZipfGenerator(size_t n, double s, unsigned seed)
+		: mRng(seed)
+		, mUniform(0.0, 1.0)
+	{
+		mCdf.reserve(n);
+		double sum = 0.0;
+		for (size_t k = 0; k < n; k++)
+		{
+			sum += 1.0 / std::pow(double(k + 1), s);
+			mCdf.push_back(sum);
+		}
+		for (auto& c : mCdf)
+			c /= sum;
+
+		for (size_t k = 0; k < n; k++)
+			mPermutation.push_back(k);
+		std::shuffle(mPermutation.begin(), mPermutation.end(), mRng);
+	}
+
+	size_t operator()()
+	{
+		const double u = mUniform(mRng);
+		const size_t k = std::lower_bound(mCdf.begin(), mCdf.end(), u) - mCdf.begin();
+		return mPermutation[std::min(k, mPermutation.size() - 1)];
+	}
+
+private:
+	std::mt19937 mRng;
+	std::uniform_real_distribution<double> mUniform;
+	std::vector<double> mCdf;
+	std::vector<size_t> mPermutation;
+};
+
+struct Trace
+{
+	std::string name;
+	std::vector<size_t> keys;
+	size_t keySpace;
+};
+
+Trace zipf_trace(size_t keySpace, double s, size_t length)
+{
+	Trace trace;
+	char name[64];
+	snprintf(name, sizeof(name), "zipf %.2f", s);
+	trace.name = name;
+	trace.keySpace = keySpace;
+	ZipfGenerator zipf(keySpace, s, 42);
+	for (size_t i = 0; i < length; i++)
+		trace.keys.push_back(zipf());
+	return trace;
+}
+
+// Zipf accesses, interrupted every scanInterval accesses by a scan over scanLength keys that are never used again.
+Trace scan_mixed_trace(size_t keySpace, double s, size_t length, size_t scanInterval, size_t scanLength)
+{
+	Trace trace;
+	char name[64];
+	snprintf(name, sizeof(name), "zipf %.2f + scans", s);
+	trace.name = name;
+	ZipfGenerator zipf(keySpace, s, 42);
+	size_t scanKey = keySpace;
+	while (trace.keys.size() < length)
+	{
+		for (size_t i = 0; (i < scanInterval) && (trace.keys.size() < length); i++)
+			trace.keys.push_back(zipf());
+		for (size_t i = 0; (i < scanLength) && (trace.keys.size() < length); i++)
+			trace.keys.push_back(scanKey++);
+	}
+	trace.keySpace = scanKey;
+	return trace;
+}
+
+// Replays the trace against a policy that holds at most capacity hashes. A miss adds the hash, evicting from the
+// back of the policy when it is full, like MemoryCache and DiskCache do.
+void replay(const char* policyName, myrmo::cache::policy::EvictionPolicy* p, const Trace& trace, size_t capacity)
+{
+	using namespace myrmo::cache;
+	std::unique_ptr<policy::EvictionPolicy> policy(p);
+	policy->setHashSize(16);
+
+	std::vector<std::string> hashes;
+	hashes.reserve(trace.keySpace);
+	for (size_t k = 0; k < trace.keySpace; k++)
+		hashes.push_back(make_hash(k));
+
+	size_t hits = 0;
+	myrmo::bench::Timer timer;
+	for (size_t key : trace.keys)
+	{
+		const std::string& hash = hashes[key];
+		if (policy->exists(hash) == policy::Error::NoError)
+		{
+			hits++;
+			continue;
+		}
+
+		if (policy->count() >= capacity)
+			policy->remove(std::string(policy->back()));
+		policy->add(hash);
+	}
+	const double ns = double(timer.nanoseconds()) / trace.keys.size();
+
+	printf("  %-10s %-22s capacity %7zu: hit ratio %6.2f %%, %6.0f ns/access\n", policyName, trace.name.c_str(), capacity,
+		100.0 * hits / trace.keys.size(), ns);
+}
+
+typedef std::function<myrmo::cache::policy::EvictionPolicy*()> PolicyFactory;
+
+int main()
+{
+	using namespace myrmo::cache;
+
+	const size_t keySpace = 1000000;
+	const size_t length = 5000000;
+	std::vector<Trace> traces;
+	traces.push_back(zipf_trace(keySpace, 0.8, length));
+	traces.push_back(zipf_trace(keySpace, 0.99, length));
+	traces.push_back(scan_mixed_trace(keySpace, 0.8, length, 200000, 50000));
+	traces.push_back(scan_mixed_trace(keySpace, 0.99, length, 200000, 50000));
+
+	const std::vector<std::pair<const char*, PolicyFactory>> policies = {
+		{ "LRU", []() { return new policy::LRU(); } },
+		{ "CLOCK", []() { return new policy::CLOCK(); } },
+		{ "W-TinyLFU", []() { return new policy::WTinyLFU(); } },
+	};
+
+	printf("Eviction policy hit ratio and throughput, %zu keys, %zu accesses\n", keySpace, length);
+	for (const auto& trace : traces)
+	{
+		for (size_t capacity : { keySpace / 100, keySpace / 10 })
+		{
+			for (const auto& policy : policies)
+				replay(policy.first, policy.second(), trace, capacity);
+		}
+	}
+
+	return 0;
+}
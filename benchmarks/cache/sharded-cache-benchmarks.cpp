@@ -0,0 +1,104 @@
+#include <myrmo/bench/timer.h>
+#include <myrmo/cache/sharded.h>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <random>
+#include <functional>
+#include <cstdio>
+
+// The benchmarks measure the cache itself, so keys are hashed with a cheap fixed width hash instead of SHA1.
+static std::string fast_hash(const std::string& uri)
+{
+	char buf[17];
+	snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)std::hash<std::string>()(uri));
+	return std::string(buf, 16);
+}
+
+static std::string make_uri(size_t i)
+{
+	return "https://example.com/item/" + std::to_string(i);
+}
+
+// Runs a 90 % read / 10 % write mix over a key space that is larger than the cache, and reports the total
+// throughput. A single LRU shard is the same as wrapping one MemoryCache in a global mutex, while CLOCK shards
+// serve hits under a shared lock.
+double run(size_t threadCount, size_t shardCount, size_t opsPerThread, myrmo::cache::ShardedMemoryCache::policyFactory factory)
+{
+	using namespace myrmo::cache;
+
+	const size_t itemSize = 1024;
+	const size_t keyCount = 100000;
+	ShardedMemoryCache cache(fast_hash, factory, 64, shardCount);
+
+	std::vector<char> payload(itemSize, 'x');
+	for (size_t i = 0; i < keyCount / 2; i++)
+		cache.write(make_uri(i), payload.data(), itemSize);
+
+	std::vector<std::vector<std::string>> uris(threadCount);
+	for (size_t t = 0; t < threadCount; t++)
+	{
+		std::mt19937 rng(static_cast<unsigned>(t));
+		std::uniform_int_distribution<size_t> keyDist(0, keyCount - 1);
+		for (size_t n = 0; n < opsPerThread; n++)
+			uris[t].push_back(make_uri(keyDist(rng)));
+	}
+
+	myrmo::bench::Timer timer;
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < threadCount; t++)
+	{
+		threads.emplace_back([&, t]()
+		{
+			ShardedMemoryCache::Handle handle;
+			for (size_t n = 0; n < opsPerThread; n++)
+			{
+				if ((n % 10) == 0)
+				{
+					cache.write(uris[t][n], payload.data(), itemSize);
+				}
+				else if (cache.read(uris[t][n], &handle) == ShardedMemoryCache::Error::NoError)
+				{
+					myrmo::bench::do_not_optimize(handle.data()[0]);
+					handle.release();
+				}
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+
+	return double(threadCount * opsPerThread) / timer.seconds() / 1e6;
+}
+
+int main()
+{
+	using namespace myrmo::cache;
+
+	const size_t opsPerThread = 100000;
+	const size_t shardCounts[] = { 1, 16, 64 };
+	const std::vector<std::pair<const char*, ShardedMemoryCache::policyFactory>> policies = {
+		{ "LRU", []() { return new policy::LRU(); } },
+		{ "CLOCK", []() { return new policy::CLOCK(); } },
+	};
+
+	printf("ShardedMemoryCache throughput in Mops/s (%u hardware threads)\n", std::thread::hardware_concurrency());
+	printf("threads");
+	for (const auto& policy : policies)
+		for (size_t shards : shardCounts)
+			printf(" %6s %3zu shards", policy.first, shards);
+	printf("\n");
+
+	for (size_t threads = 1; threads <= 32; threads *= 2)
+	{
+		printf("%7zu", threads);
+		for (const auto& policy : policies)
+			for (size_t shards : shardCounts)
+				printf(" %17.2f", run(threads, shards, opsPerThread, policy.second));
+		printf("\n");
+		fflush(stdout);
+	}
+
+	return 0;
+}
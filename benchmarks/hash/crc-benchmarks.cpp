@@ -0,0 +1,82 @@
+#include <myrmo/bench/timer.h>
+#include <myrmo/hash/crc.h>
+
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+
+typedef uint32_t (*crcKernel)(const unsigned char* data, size_t size, uint32_t crc);
+
+// Checksums size bytes repeatedly, about 256 MiB in total, and returns the throughput in MB/s.
+static double throughput(crcKernel kernel, const std::vector<unsigned char>& buffer, size_t size)
+{
+	const size_t rounds = std::max<size_t>(1, (256u << 20) / size);
+	uint32_t crc = 0;
+	myrmo::bench::Timer timer;
+	for (size_t round = 0; round < rounds; round++)
+	{
+		crc = kernel(buffer.data(), size, crc);
+		myrmo::bench::do_not_optimize(crc);
+	}
+	return double(rounds) * size * 1000.0 / double(timer.nanoseconds());
+}
+
+static uint32_t crc32(const unsigned char* data, size_t size, uint32_t crc)
+{
+	return myrmo::hash::crc32(reinterpret_cast<const char*>(data), size, crc);
+}
+
+#ifdef MYRMO_HAS_X86_DISPATCH
+// The folding kernel takes multiples of 16 bytes, the tail is left to the table.
+static uint32_t clmul(const unsigned char* data, size_t size, uint32_t crc)
+{
+	const size_t folded = (size >= 64) ? (size & ~size_t(15)) : 0;
+	if (folded)
+		crc = myrmo::hash::detail::crc32_clmul(data, folded, crc);
+	return myrmo::hash::detail::crc32_sliced<16>(data + folded, size - folded, crc);
+}
+#endif
+
+int main()
+{
+	struct Kernel
+	{
+		const char* name;
+		crcKernel kernel;
+	};
+	const Kernel kernels[] = {
+		{ "bytewise", myrmo::hash::detail::crc32_bytewise },
+		{ "slice-4", myrmo::hash::detail::crc32_sliced<4> },
+		{ "slice-8", myrmo::hash::detail::crc32_sliced<8> },
+		{ "slice-16", myrmo::hash::detail::crc32_sliced<16> },
+#ifdef MYRMO_HAS_X86_DISPATCH
+		{ "clmul", myrmo::util::cpu_features().pclmul ? clmul : nullptr },
+#endif
+		{ "crc32()", crc32 }
+	};
+
+	std::vector<unsigned char> buffer(64u << 20);
+	for (size_t i = 0; i < buffer.size(); i++)
+		buffer[i] = static_cast<unsigned char>((i * 2654435761u) >> 13);
+
+	printf("CRC32 throughput in MB/s\n%10s", "size");
+	for (const Kernel& kernel : kernels)
+		printf(" %10s", kernel.name);
+	printf("\n");
+
+	for (size_t size = 16; size <= buffer.size(); size *= 4)
+	{
+		printf("%10zu", size);
+		for (const Kernel& kernel : kernels)
+		{
+			if (kernel.kernel)
+				printf(" %10.0f", throughput(kernel.kernel, buffer, size));
+			else
+				printf(" %10s", "-"); // Not supported by the CPU.
+		}
+		printf("\n");
+	}
+
+	return 0;
+}
@@ -0,0 +1,245 @@
+#include <myrmo/bench/timer.h>
+#include <myrmo/hash/sha1.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+
+typedef void (*sha1Kernel)(uint32_t state[5], const unsigned char* data, size_t count);
+
+// The compression loop as it was before the kernels were unrolled, as a baseline.
+static void sha1_compress_loop(uint32_t state[5], const unsigned char* data, size_t count)
+{
+	using myrmo::util::bits::left_rotate;
+	for (size_t block = 0; block < count; block++, data += 64)
+	{
+		uint32_t words[80];
+		for (int i = 0; i < 16; i++)
+			words[i] = myrmo::hash::detail::load_be32(data + i * 4);
+		for (int i = 16; i < 80; i++)
+			words[i] = left_rotate<1>(words[i-3] ^ words[i-8] ^ words[i-14] ^ words[i-16]);
+
+		uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+		for (int i = 0; i < 80; i++)
+		{
+			uint32_t f, k;
+			if (i < 20)
+			{
+				f = (b & c) | ((~b) & d);
+				k = 0x5A827999;
+			}
+			else if (i < 40)
+			{
+				f = b ^ c ^ d;
+				k = 0x6ED9EBA1;
+			}
+			else if (i < 60)
+			{
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8F1BBCDC;
+			}
+			else
+			{
+				f = b ^ c ^ d;
+				k = 0xCA62C1D6;
+			}
+			const uint32_t temp = left_rotate<5>(a) + f + e + k + words[i];
+			e = d;
+			d = c;
+			c = left_rotate<30>(b);
+			b = a;
+			a = temp;
+		}
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+	}
+}
+
+// Compresses size bytes repeatedly, about 256 MiB in total, and returns the throughput in MB/s.
+static double throughput(sha1Kernel kernel, const std::vector<unsigned char>& buffer, size_t size)
+{
+	const size_t rounds = std::max<size_t>(1, (256u << 20) / size);
+	uint32_t state[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+	myrmo::bench::Timer timer;
+	for (size_t round = 0; round < rounds; round++)
+	{
+		kernel(state, buffer.data(), size / 64);
+		myrmo::bench::do_not_optimize(state[0]);
+	}
+	return double(rounds) * size * 1000.0 / double(timer.nanoseconds());
+}
+
+typedef void (*batchKernel)(const std::string* messages, size_t count, myrmo::hash::Sha1Digest* digests);
+
+static void sha1_each(const std::string* messages, size_t count, myrmo::hash::Sha1Digest* digests)
+{
+	for (size_t i = 0; i < count; i++)
+		myrmo::hash::sha1(messages[i].data(), messages[i].size(), digests[i].data());
+}
+
+static void print_calls(const char* name, double nanoseconds, size_t count)
+{
+	const double ns = nanoseconds / count;
+	printf("%-24s %6.0f ns/call %8.2f M calls/s\n", name, ns, 1000.0 / ns);
+}
+
+// sha1() as it was before the digest overloads: the hex string formatted with snprintf.
+static std::string sha1_snprintf(const std::string& message)
+{
+	uint8_t digest[20];
+	myrmo::hash::sha1(message.data(), message.size(), digest);
+	std::string result;
+	result.resize(40);
+	for (int i = 0; i < 5; i++)
+	{
+		const uint32_t word = (uint32_t(digest[4 * i]) << 24) | (uint32_t(digest[4 * i + 1]) << 16) | (uint32_t(digest[4 * i + 2]) << 8) | digest[4 * i + 3];
+		snprintf(&result[8 * i], 32, "%08x", word);
+	}
+	return result;
+}
+
+// Calls per second of the single message API, with and without the hex string.
+static void bench_api(const std::vector<std::string>& uris)
+{
+	printf("\nSHA1 API of %zu URIs\n", uris.size());
+	{
+		myrmo::bench::Timer timer;
+		for (const std::string& uri : uris)
+			myrmo::bench::do_not_optimize(sha1_snprintf(uri));
+		print_calls("sha1() with snprintf", double(timer.nanoseconds()), uris.size());
+	}
+	{
+		myrmo::bench::Timer timer;
+		for (const std::string& uri : uris)
+			myrmo::bench::do_not_optimize(myrmo::hash::sha1(uri));
+		print_calls("sha1()", double(timer.nanoseconds()), uris.size());
+	}
+	{
+		myrmo::bench::Timer timer;
+		for (const std::string& uri : uris)
+			myrmo::bench::do_not_optimize(myrmo::hash::sha1_digest(uri));
+		print_calls("sha1_digest()", double(timer.nanoseconds()), uris.size());
+	}
+	{
+		uint8_t digest[20];
+		myrmo::bench::Timer timer;
+		for (const std::string& uri : uris)
+		{
+			myrmo::hash::sha1(uri.data(), uri.size(), digest);
+			myrmo::bench::do_not_optimize(digest);
+		}
+		print_calls("sha1() into buffer", double(timer.nanoseconds()), uris.size());
+	}
+
+	const myrmo::hash::Sha1Digest digest(myrmo::hash::sha1_digest(uris[0]));
+	char hex[40];
+	{
+		myrmo::bench::Timer timer;
+		for (size_t i = 0; i < uris.size(); i++)
+		{
+			myrmo::util::hex_encode(digest.data(), digest.size(), hex);
+			myrmo::bench::do_not_optimize(hex);
+		}
+		print_calls("hex_encode()", double(timer.nanoseconds()), uris.size());
+	}
+	{
+		uint8_t decoded[20];
+		myrmo::bench::Timer timer;
+		for (size_t i = 0; i < uris.size(); i++)
+		{
+			myrmo::bench::do_not_optimize(myrmo::util::hex_decode(hex, decoded, sizeof(decoded)));
+			myrmo::bench::do_not_optimize(decoded);
+		}
+		print_calls("hex_decode()", double(timer.nanoseconds()), uris.size());
+	}
+}
+
+static void bench_uris()
+{
+	std::vector<std::string> uris;
+	for (size_t i = 0; i < 100000; i++)
+		uris.push_back("https://www.miasmat.no/wp-content/uploads/app/w800/" + std::to_string(i) + ".JPG");
+
+	bench_api(uris);
+
+	printf("\nSHA1 of %zu URIs\n", uris.size());
+	{
+		std::vector<std::string> hex(uris.size());
+		myrmo::bench::Timer timer;
+		myrmo::hash::sha1_many(uris.data(), uris.size(), hex.data());
+		myrmo::bench::do_not_optimize(hex[0]);
+		print_calls("sha1_many() hex", double(timer.nanoseconds()), uris.size());
+	}
+
+	struct Batch
+	{
+		const char* name;
+		batchKernel kernel;
+	};
+	const Batch batches[] = {
+		{ "one by one", sha1_each },
+#ifdef MYRMO_HAS_X86_DISPATCH
+		{ "avx2 x8", myrmo::util::cpu_features().avx2 ? myrmo::hash::detail::sha1_many_avx2 : nullptr },
+		{ "avx-512 x16", myrmo::util::cpu_features().avx512 ? myrmo::hash::detail::sha1_many_avx512 : nullptr },
+#endif
+		{ "sha1_many()", myrmo::hash::sha1_many }
+	};
+
+	std::vector<myrmo::hash::Sha1Digest> digests(uris.size());
+	for (const Batch& batch : batches)
+	{
+		if (!batch.kernel)
+			continue; // Not supported by the CPU.
+		myrmo::bench::Timer timer;
+		batch.kernel(uris.data(), uris.size(), digests.data());
+		myrmo::bench::do_not_optimize(digests[0]);
+		print_calls(batch.name, double(timer.nanoseconds()), uris.size());
+	}
+}
+
+int main()
+{
+	struct Kernel
+	{
+		const char* name;
+		sha1Kernel kernel;
+	};
+	const Kernel kernels[] = {
+		{ "loop", sha1_compress_loop },
+		{ "scalar", myrmo::hash::detail::sha1_compress_scalar },
+#ifdef MYRMO_HAS_X86_DISPATCH
+		{ "sha-ni", myrmo::util::cpu_features().sha ? myrmo::hash::detail::sha1_compress_ni : nullptr },
+#endif
+		{ "dispatch", myrmo::hash::detail::sha1_compress }
+	};
+
+	std::vector<unsigned char> buffer(64u << 20);
+	for (size_t i = 0; i < buffer.size(); i++)
+		buffer[i] = static_cast<unsigned char>((i * 2654435761u) >> 13);
+
+	printf("SHA1 compression throughput in MB/s\n%10s", "size");
+	for (const Kernel& kernel : kernels)
+		printf(" %10s", kernel.name);
+	printf("\n");
+
+	for (size_t size = 64; size <= buffer.size(); size *= 4)
+	{
+		printf("%10zu", size);
+		for (const Kernel& kernel : kernels)
+		{
+			if (kernel.kernel)
+				printf(" %10.0f", throughput(kernel.kernel, buffer, size));
+			else
+				printf(" %10s", "-"); // Not supported by the CPU.
+		}
+		printf("\n");
+	}
+
+	bench_uris();
+	return 0;
+}
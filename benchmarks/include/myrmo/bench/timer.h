@@ -0,0 +1,39 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+namespace myrmo { namespace bench
+{
+	class Timer
+	{
+	public:
+		Timer() : mStart(Clock::now()) {}
+
+		void restart()
+		{
+			mStart = Clock::now();
+		}
+
+		double seconds() const
+		{
+			return std::chrono::duration<double>(Clock::now() - mStart).count();
+		}
+
+		uint64_t nanoseconds() const
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - mStart).count();
+		}
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point mStart;
+	};
+
+	// Keeps the compiler from optimizing away a computed value.
+	template<typename T>
+	inline void do_not_optimize(const T& value)
+	{
+		asm volatile("" : : "r,m"(value) : "memory");
+	}
+
+}} // End namespace myrmo::bench
@@ -0,0 +1,144 @@
+/* Copyright © 2019 Øystein Myrmo (oystein.myrmo@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <map>
+#include <set>
+#include <utility>
+#include <memory>
+#include <cstdint>
+#include <cassert>
+#include <iterator>
+
+namespace myrmo { namespace cache
+{
+	// Fixed size byte arena. Allocations are placed with a best fit search over the free ranges, and freed
+	// ranges are coalesced with their neighbours. Allocating or freeing never moves other allocations.
+	class Arena
+	{
+	public:
+		static constexpr size_t npos = static_cast<size_t>(-1);
+
+		Arena() = delete;
+		Arena(const Arena&) = delete;
+		Arena(Arena&&) = delete;
+
+		explicit Arena(size_t capacity)
+			: mData(new char[capacity])
+			, mCapacity(capacity)
+			, mUsed(0)
+		{
+			clear();
+		}
+
+		// Returns the offset of the allocated range, or npos if there is no free range large enough.
+		size_t allocate(size_t size)
+		{
+			assert(size > 0);
+			const auto fit = mFreeBySize.lower_bound({ size, 0 });
+			if (fit == mFreeBySize.end())
+				return npos;
+
+			const size_t freeSize = fit->first;
+			const size_t offset = fit->second;
+			eraseFreeRange(offset, freeSize);
+			if (freeSize > size)
+				insertFreeRange(offset + size, freeSize - size);
+
+			mUsed += size;
+			return offset;
+		}
+
+		void free(size_t offset, size_t size)
+		{
+			assert(size > 0);
+			assert((offset + size) <= mCapacity);
+			assert(mUsed >= size);
+			mUsed -= size;
+
+			// Coalesce with the free range that ends where this one starts.
+			auto next = mFreeByOffset.lower_bound(offset);
+			if (next != mFreeByOffset.begin())
+			{
+				auto prev = std::prev(next);
+				assert((prev->first + prev->second) <= offset);
+				if ((prev->first + prev->second) == offset)
+				{
+					const size_t prevOffset = prev->first;
+					size += prev->second;
+					eraseFreeRange(prevOffset, prev->second);
+					offset = prevOffset;
+				}
+			}
+
+			// Coalesce with the free range that starts where this one ends.
+			next = mFreeByOffset.find(offset + size);
+			if (next != mFreeByOffset.end())
+			{
+				size += next->second;
+				eraseFreeRange(next->first, next->second);
+			}
+
+			insertFreeRange(offset, size);
+		}
+
+		bool canAllocate(size_t size) const
+		{
+			return mFreeBySize.lower_bound({ size, 0 }) != mFreeBySize.end();
+		}
+
+		void clear()
+		{
+			mFreeByOffset.clear();
+			mFreeBySize.clear();
+			mUsed = 0;
+			if (mCapacity > 0)
+				insertFreeRange(0, mCapacity);
+		}
+
+		char* data() { return mData.get(); }
+		const char* data() const { return mData.get(); }
+		size_t capacity() const { return mCapacity; }
+		size_t used() const { return mUsed; }
+		size_t freeRangeCount() const { return mFreeByOffset.size(); }
+
+	private:
+		void insertFreeRange(size_t offset, size_t size)
+		{
+			mFreeByOffset.insert({ offset, size });
+			mFreeBySize.insert({ size, offset });
+		}
+
+		void eraseFreeRange(size_t offset, size_t size)
+		{
+			const size_t erased = mFreeByOffset.erase(offset) + mFreeBySize.erase({ size, offset });
+			assert(erased == 2);
+			(void)erased;
+		}
+
+	private:
+		std::unique_ptr<char[]> mData;
+		const size_t mCapacity;
+		size_t mUsed;
+		std::map<size_t, size_t> mFreeByOffset;          // offset -> size
+		std::set<std::pair<size_t, size_t>> mFreeBySize; // (size, offset), ordered for best fit lookups
+	};
+
+}} // End namespace myrmo::cache
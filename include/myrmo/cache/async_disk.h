@@ -0,0 +1,363 @@
+/* Copyright © 2019 Øystein Myrmo (oystein.myrmo@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <myrmo/cache/disk.h>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <functional>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+namespace myrmo { namespace cache
+{
+	// Thread-safe disk cache that performs writes and removes on a pool of background threads, so that file
+	// creation, data writes, eviction deletes and journal flushes stay off the calling thread.
+	//
+	// - writeAsync() and removeAsync() queue an operation and return a future, or call a completion callback on
+	//   a worker thread. Operations on the same item complete in the order they were queued.
+	// - Queued writes are bounded by maxQueuedBytes. When the queue is full, writeAsync() blocks until the
+	//   workers catch up. A single write larger than the bound is accepted when the queue is empty.
+	// - Writes are coalesced while they are queued: a second write of a queued item fails with FileExists, as
+	//   it would once the first write is done, and removing a queued item cancels its write.
+	// - read() serves items that are still queued from the queued data.
+	//
+	// The DiskCache itself is guarded by a mutex. Workers write entries that get a file of their own through a
+	// DiskCache::Writer, which takes the mutex only to reserve space and to commit, so such writes run in
+	// parallel. Entries that go to a segment file are appended under the mutex.
+	template<typename Key>
+	class BasicAsyncDiskCache
+	{
+	public:
+		typedef BasicDiskCache<Key> Cache;
+		typedef typename Cache::Error Error;
+		typedef std::function<void(Error)> completionCallback;
+
+		BasicAsyncDiskCache() = delete;
+		BasicAsyncDiskCache(const BasicAsyncDiskCache&) = delete;
+
+		// Takes ownership of the cache.
+		BasicAsyncDiskCache(Cache* cache, size_t workerCount = 2, size_t maxQueuedBytes = 64 * 1048576)
+			: mCache(cache)
+			, mMaxQueuedBytes(maxQueuedBytes)
+			, mQueuedBytes(0)
+			, mActive(0)
+			, mStopping(false)
+		{
+			assert(workerCount > 0);
+			for (size_t i = 0; i < std::max<size_t>(workerCount, 1); i++)
+				mWorkers.push_back(std::thread(&BasicAsyncDiskCache::work, this));
+		}
+
+		~BasicAsyncDiskCache()
+		{
+			flush();
+			{
+				std::lock_guard<std::mutex> lock(mQueueMutex);
+				mStopping = true;
+			}
+			mWorkAvailable.notify_all();
+			for (std::thread& worker : mWorkers)
+				worker.join();
+		}
+
+		std::future<Error> writeAsync(const std::string& uri, std::vector<char> data)
+		{
+			std::shared_ptr<Operation> op(new Operation(Operation::Write, uri, mCache->hash(uri)));
+			op->data.swap(data);
+			std::future<Error> result = op->promise.get_future();
+			enqueue(op);
+			return result;
+		}
+
+		std::future<Error> writeAsync(const std::string& uri, const std::string& data)
+		{
+			return writeAsync(uri, std::vector<char>(data.begin(), data.end()));
+		}
+
+		std::future<Error> writeAsync(const std::string& uri, const char* data, size_t size)
+		{
+			return writeAsync(uri, std::vector<char>(data, data + size));
+		}
+
+		void writeAsync(const std::string& uri, std::vector<char> data, completionCallback callback)
+		{
+			std::shared_ptr<Operation> op(new Operation(Operation::Write, uri, mCache->hash(uri)));
+			op->data.swap(data);
+			op->callback = callback;
+			enqueue(op);
+		}
+
+		std::future<Error> removeAsync(const std::string& uri)
+		{
+			std::shared_ptr<Operation> op(new Operation(Operation::Remove, uri, mCache->hash(uri)));
+			std::future<Error> result = op->promise.get_future();
+			enqueue(op);
+			return result;
+		}
+
+		void removeAsync(const std::string& uri, completionCallback callback)
+		{
+			std::shared_ptr<Operation> op(new Operation(Operation::Remove, uri, mCache->hash(uri)));
+			op->callback = callback;
+			enqueue(op);
+		}
+
+		Error read(const std::string& uri, std::vector<char>* data)
+		{
+			const Key hash(mCache->hash(uri));
+			{
+				std::lock_guard<std::mutex> lock(mQueueMutex);
+				const auto it = mQueued.find(hash);
+				if (it != mQueued.end())
+				{
+					if (it->second->type == Operation::Remove)
+						return Error::FileDoesNotExist;
+					data->assign(it->second->data.begin(), it->second->data.end());
+					return Error::NoError;
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(mCacheMutex);
+			return mCache->read(uri, data);
+		}
+
+		// Waits until all queued operations are done.
+		void flush()
+		{
+			std::unique_lock<std::mutex> lock(mQueueMutex);
+			mIdle.wait(lock, [this]() { return mQueue.empty() && (mActive == 0); });
+		}
+
+		Error clear()
+		{
+			flush();
+			std::lock_guard<std::mutex> lock(mCacheMutex);
+			return mCache->clear();
+		}
+
+		size_t size() const
+		{
+			std::lock_guard<std::mutex> lock(mCacheMutex);
+			return mCache->size();
+		}
+
+		size_t count() const
+		{
+			std::lock_guard<std::mutex> lock(mCacheMutex);
+			return mCache->count();
+		}
+
+		size_t queuedBytes() const
+		{
+			std::lock_guard<std::mutex> lock(mQueueMutex);
+			return mQueuedBytes;
+		}
+
+	private:
+		struct Operation
+		{
+			enum Type { Write, Remove };
+
+			Operation(Type type, const std::string& uri, const Key& hash)
+				: type(type), uri(uri), hash(hash), started(false), cancelled(false), cancelsWrite(false) {}
+
+			Type type;
+			std::string uri;
+			Key hash;
+			std::vector<char> data;
+			bool started;
+			bool cancelled; // A write that was removed before it started.
+			bool cancelsWrite; // A remove that cancelled a write.
+			std::promise<Error> promise;
+			completionCallback callback;
+
+			void complete(Error error)
+			{
+				if (callback)
+					callback(error);
+				else
+					promise.set_value(error);
+			}
+		};
+
+		void enqueue(const std::shared_ptr<Operation>& op)
+		{
+			std::vector<std::shared_ptr<Operation>> completed;
+			{
+				std::unique_lock<std::mutex> lock(mQueueMutex);
+				if (op->type == Operation::Write)
+					mSpaceAvailable.wait(lock, [&]() { return (mQueuedBytes == 0) || (mQueuedBytes + op->data.size() <= mMaxQueuedBytes); });
+
+				const auto queued = mQueued.find(op->hash);
+				if ((op->type == Operation::Write) && (queued != mQueued.end()) && (queued->second->type == Operation::Write))
+				{
+					lock.unlock();
+					op->complete(Error::FileExists);
+					return;
+				}
+
+				if ((op->type == Operation::Remove) && (queued != mQueued.end()) && (queued->second->type == Operation::Write) && !queued->second->started)
+				{
+					// The write never needs to reach the disk.
+					const std::shared_ptr<Operation> write = queued->second;
+					write->cancelled = true;
+					mQueuedBytes -= write->data.size();
+					std::vector<char>().swap(write->data);
+					mSpaceAvailable.notify_all();
+					completed.push_back(write);
+					op->cancelsWrite = true;
+				}
+
+				if (op->type == Operation::Write)
+					mQueuedBytes += op->data.size();
+
+				mQueued[op->hash] = op;
+				mQueue.push_back(op);
+			}
+			mWorkAvailable.notify_one();
+
+			for (const auto& write : completed)
+				write->complete(Error::NoError);
+		}
+
+		void work()
+		{
+			while (true)
+			{
+				std::shared_ptr<Operation> op;
+				{
+					std::unique_lock<std::mutex> lock(mQueueMutex);
+
+					// Skip operations whose item is being worked on, so that operations on an item keep their order.
+					// Queued operations are still done when stopping.
+					auto it = mQueue.end();
+					mWorkAvailable.wait(lock, [this, &it]()
+					{
+						it = std::find_if(mQueue.begin(), mQueue.end(), [this](const std::shared_ptr<Operation>& queued)
+						{
+							return mInProgress.find(queued->hash) == mInProgress.end();
+						});
+						return (it != mQueue.end()) || (mStopping && mQueue.empty());
+					});
+					if (it == mQueue.end())
+						return;
+
+					op = *it;
+					op->started = true;
+					mQueue.erase(it);
+					mInProgress[op->hash] = op;
+					mActive++;
+				}
+
+				Error error = Error::NoError;
+				if (!op->cancelled)
+					error = (op->type == Operation::Write) ? write(*op) : remove(*op);
+
+				{
+					std::lock_guard<std::mutex> lock(mQueueMutex);
+					const auto queued = mQueued.find(op->hash);
+					if ((queued != mQueued.end()) && (queued->second == op))
+						mQueued.erase(queued);
+					mInProgress.erase(op->hash);
+					if ((op->type == Operation::Write) && !op->cancelled)
+						mQueuedBytes -= op->data.size();
+				}
+				mSpaceAvailable.notify_all();
+				mWorkAvailable.notify_all();
+
+				// Complete before counting as idle, so that callbacks have run when flush() returns.
+				if (!op->cancelled)
+					op->complete(error);
+
+				{
+					std::lock_guard<std::mutex> lock(mQueueMutex);
+					mActive--;
+				}
+				mIdle.notify_all();
+			}
+		}
+
+		Error write(const Operation& op)
+		{
+			const size_t size = op.data.size();
+			if (size <= mCache->segmentOptions().maxEntrySize)
+			{
+				std::lock_guard<std::mutex> lock(mCacheMutex);
+				return mCache->write(op.uri, op.data);
+			}
+
+			typename Cache::Writer writer;
+			{
+				std::lock_guard<std::mutex> lock(mCacheMutex);
+				const Error error = mCache->openWriter(op.uri, size, &writer);
+				if (error != Error::NoError)
+					return error;
+			}
+
+			// The writer only touches its own file, so the data is written without holding the cache.
+			const Error error = writer.write(op.data.data(), size);
+
+			std::lock_guard<std::mutex> lock(mCacheMutex);
+			if (error != Error::NoError)
+			{
+				writer.abort();
+				return error;
+			}
+			return writer.commit();
+		}
+
+		Error remove(const Operation& op)
+		{
+			std::lock_guard<std::mutex> lock(mCacheMutex);
+			const Error error = mCache->remove(op.uri);
+			// A remove that cancelled a queued write also succeeds when nothing was on disk.
+			return ((error == Error::FileDoesNotExist) && op.cancelsWrite) ? Error::NoError : error;
+		}
+
+	private:
+		std::unique_ptr<Cache> mCache;
+		mutable std::mutex mCacheMutex;
+
+		mutable std::mutex mQueueMutex;
+		std::condition_variable mWorkAvailable;
+		std::condition_variable mSpaceAvailable;
+		std::condition_variable mIdle;
+		std::deque<std::shared_ptr<Operation>> mQueue;
+		std::unordered_map<Key, std::shared_ptr<Operation>, KeyHash<Key>> mQueued; // Latest queued operation per item.
+		std::unordered_map<Key, std::shared_ptr<Operation>, KeyHash<Key>> mInProgress;
+		const size_t mMaxQueuedBytes;
+		size_t mQueuedBytes;
+		size_t mActive;
+		bool mStopping;
+
+		std::vector<std::thread> mWorkers;
+	};
+
+	typedef BasicAsyncDiskCache<std::string> AsyncDiskCache;
+
+}} // End namespace myrmo::cache
@@ -0,0 +1,81 @@
+/* Copyright © 2019 Øystein Myrmo (oystein.myrmo@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace myrmo { namespace cache
+{
+	// One item of a writeMany() batch. The uri and data are referenced, not copied, and must outlive the call.
+	struct WriteItem
+	{
+		WriteItem(const std::string& uri, const char* data, size_t size) : uri(&uri), data(data), size(size) {}
+		WriteItem(const std::string& uri, const std::string& data) : uri(&uri), data(data.data()), size(data.size()) {}
+		WriteItem(const std::string& uri, const std::vector<char>& data) : uri(&uri), data(data.data()), size(data.size()) {}
+
+		const std::string* uri;
+		const char* data;
+		size_t size;
+	};
+
+	namespace detail
+	{
+		// The hashes of a batch of uris: in one call to batchFunc if there is one, e.g. hash::sha1_many(), else
+		// one by one with func.
+		template<typename Key>
+		std::vector<Key> hash_many(Key (*func)(const std::string&), void (*batchFunc)(const std::string*, size_t, Key*),
+			const std::string* uris, size_t count)
+		{
+			std::vector<Key> hashes(count);
+			if (batchFunc)
+			{
+				batchFunc(uris, count, hashes.data());
+				return hashes;
+			}
+			for (size_t i = 0; i < count; i++)
+				hashes[i] = func(uris[i]);
+			return hashes;
+		}
+
+		// Same as above for the uris of a writeMany() batch, which are gathered for batchFunc.
+		template<typename Key>
+		std::vector<Key> hash_many(Key (*func)(const std::string&), void (*batchFunc)(const std::string*, size_t, Key*),
+			const std::vector<WriteItem>& items)
+		{
+			if (!batchFunc)
+			{
+				std::vector<Key> hashes;
+				hashes.reserve(items.size());
+				for (const WriteItem& item : items)
+					hashes.push_back(func(*item.uri));
+				return hashes;
+			}
+
+			std::vector<std::string> uris;
+			uris.reserve(items.size());
+			for (const WriteItem& item : items)
+				uris.push_back(*item.uri);
+			return hash_many(func, batchFunc, uris.data(), uris.size());
+		}
+	}
+
+}} // End namespace myrmo::cache
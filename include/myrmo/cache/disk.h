@@ -20,6 +20,11 @@
  */
 #pragma once
 #include <myrmo/cache/policy.h>
+#include <myrmo/cache/batch.h>
+#include <myrmo/util/mapped_file.h>
+#include <myrmo/util/io_uring.h>
+#include <myrmo/util/file.h>
+#include <myrmo/hash/crc.h>
 
 #include <string>
 #include <vector>
@@ -28,11 +33,80 @@
 #include <fstream>
 #include <algorithm>
 #include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <set>
+#include <iterator>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include <atomic>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace myrmo { namespace cache
 {
-	// TODO: Support streaming of large files, both read and write.
-	class DiskCache
+	namespace detail
+	{
+		// Little-endian integer encoding for the index files.
+		inline void append_uint(std::string& out, uint64_t value, size_t bytes)
+		{
+			for (size_t i = 0; i < bytes; i++)
+				out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+		}
+
+		inline uint64_t read_uint(const char* data, size_t bytes)
+		{
+			uint64_t value = 0;
+			for (size_t i = 0; i < bytes; i++)
+				value |= uint64_t(uint8_t(data[i])) << (8 * i);
+			return value;
+		}
+	}
+
+	// Large entries can be streamed in blocks through openWriter() and openReader(), so that they never have
+	// to be held in memory as a whole.
+	//
+	// Optionally, small entries are appended to shared segment files instead of getting a file each, see
+	// SegmentOptions. When evictions and removes leave less than half of a full segment live, its live entries
+	// are moved to the current segment and the segment file is deleted. The size limit counts live bytes, so
+	// the segment files may take up to about twice the space of the entries they hold.
+	//
+	// The index is persisted as a snapshot of the policy's index data plus an append-only journal of the
+	// adds, touches and removes since the snapshot. Each write or remove appends one journal record, and the
+	// journal is compacted into a new snapshot once it holds more than twice as many records as the cache has
+	// entries, and at least 1024, so that small caches do not rewrite their snapshot all the time.
+	//
+	// With the IoUring backend, the files of writeMany() and of readMany() into buffers are opened, written or read
+	// and closed in batches submitted to an io_uring, and so are the unlinks of an eviction pass or of clear().
+	//
+	// Entries that get a file of their own can be spread over a tree of subdirectories, see DirectoryLayout, so
+	// that no directory holds millions of files. If the index is missing or unreadable, or was written with
+	// another layout, the cache rebuilds it on startup by scanning the directory tree on several threads. The
+	// scan moves files to where the current layout puts them. Entries in segment files can only be recovered from
+	// the index and journal.
+	//
+	// Item files, the index snapshot and the layout file are written to a temporary file that is renamed into
+	// place, so a crash leaves either the old or the new file behind, never a torn one. How much is flushed to
+	// stable storage on the way is set by the SyncPolicy. Each entry stores the CRC32 of its data, which is
+	// checked on the first read of the entry after the cache is opened. An entry that fails the check is removed
+	// and the read returns ChecksumMismatch, so a damaged item costs a cache miss instead of the whole cache.
+	//
+	// Index file format, version 3 (all integers little-endian):
+	// - Header: "MYRMOIDX", uint32 version, uint32 hash size.
+	// - Entry: uint64 size, uint32 segment (0 for entries in a file of their own), uint64 offset in the segment,
+	//   uint32 CRC32 of the data, uint8 flags (bit 0 set if the CRC32 is valid).
+	// - Snapshot: one record per entry, in the policy's index data order: hash, entry.
+	// - Journal: the same header, then records of: uint8 type, hash, entry (zero unless the type is Add or Move).
+	// Version 2 entries have no CRC32 and version 1 entries hold the size only. Version 0 files have no header and
+	// hold hashes only. Older versions are migrated on startup, which is the only time the cache reads the sizes
+	// of its files from the file system. Migrated and recovered entries have no CRC32 and are not checked.
+	template<typename Key>
+	class BasicDiskCache
 	{
 	public:
 		enum class Error : unsigned int
@@ -44,100 +118,603 @@ namespace myrmo { namespace cache
 			CouldNotDeleteFile,
 			CouldNotClearSpaceForFile,
 			CouldNotWriteFile,
-			CouldNotWriteIndexFile
+			CouldNotWriteIndexFile,
+			SizeExceedsExpectedSize,
+			ChecksumMismatch
+		};
+
+		// Read-only memory-mapped view of a cached file. The item is pinned while the view is alive, so it is
+		// never evicted. Removing it unlinks the file, but the view keeps the mapped bytes valid until released.
+		// Views must be released before the cache is destroyed.
+		class View
+		{
+		public:
+			View() : mCache(nullptr), mGeneration(0) {}
+			View(const View&) = delete;
+			View& operator=(const View&) = delete;
+
+			View(View&& other)
+				: mCache(other.mCache)
+				, mHash(std::move(other.mHash))
+				, mGeneration(other.mGeneration)
+				, mFile(std::move(other.mFile))
+			{
+				other.mCache = nullptr;
+			}
+
+			View& operator=(View&& other)
+			{
+				if (this != &other)
+				{
+					release();
+					mCache = other.mCache;
+					mHash = std::move(other.mHash);
+					mGeneration = other.mGeneration;
+					mFile = std::move(other.mFile);
+					other.mCache = nullptr;
+				}
+				return *this;
+			}
+
+			~View()
+			{
+				release();
+			}
+
+			void release()
+			{
+				if (mCache)
+					mCache->unpin(mHash, mGeneration);
+				mCache = nullptr;
+				mFile.close();
+			}
+
+			const char* data() const { return mFile.data(); }
+			size_t size() const { return mFile.size(); }
+			const char* begin() const { return mFile.data(); }
+			const char* end() const { return mFile.data() + mFile.size(); }
+			bool valid() const { return mCache != nullptr; }
+
+		private:
+			friend class BasicDiskCache;
+			BasicDiskCache* mCache;
+			Key mHash;
+			uint64_t mGeneration;
+			util::MappedFile mFile;
+		};
+
+		// Streams a new item into the cache. The space for the expected size is reserved when the writer is
+		// opened. The data goes to a temporary file, which becomes the item only when commit() succeeds, so
+		// readers never see a partially written item. A writer that is destroyed without commit() is aborted.
+		// Writers must be committed or aborted before the cache is destroyed.
+		class Writer
+		{
+		public:
+			Writer() : mCache(nullptr), mExpectedSize(0), mWritten(0), mCrc(0) {}
+			Writer(const Writer&) = delete;
+			Writer& operator=(const Writer&) = delete;
+
+			Writer(Writer&& other)
+				: mCache(other.mCache)
+				, mHash(std::move(other.mHash))
+				, mFile(std::move(other.mFile))
+				, mExpectedSize(other.mExpectedSize)
+				, mWritten(other.mWritten)
+				, mCrc(other.mCrc)
+			{
+				other.mCache = nullptr;
+			}
+
+			Writer& operator=(Writer&& other)
+			{
+				if (this != &other)
+				{
+					abort();
+					mCache = other.mCache;
+					mHash = std::move(other.mHash);
+					mFile = std::move(other.mFile);
+					mExpectedSize = other.mExpectedSize;
+					mWritten = other.mWritten;
+					mCrc = other.mCrc;
+					other.mCache = nullptr;
+				}
+				return *this;
+			}
+
+			~Writer()
+			{
+				abort();
+			}
+
+			Error write(const char* data, size_t size)
+			{
+				if (!mCache)
+					return Error::CouldNotWriteFile;
+				if ((mWritten + size) > mExpectedSize)
+					return Error::SizeExceedsExpectedSize;
+
+				mFile.write(data, size);
+				if (!mFile.good())
+					return Error::CouldNotWriteFile;
+				mWritten += size;
+				mCrc = hash::crc32(data, size, mCrc);
+				return Error::NoError;
+			}
+
+			// Makes the written data the cached item. The item may be smaller than the expected size.
+			Error commit()
+			{
+				if (!mCache)
+					return Error::CouldNotWriteFile;
+				BasicDiskCache* cache = mCache;
+				mCache = nullptr;
+				return cache->commitWriter(*this);
+			}
+
+			void abort()
+			{
+				if (mCache)
+					mCache->abortWriter(*this);
+				mCache = nullptr;
+			}
+
+			size_t written() const { return mWritten; }
+			size_t expectedSize() const { return mExpectedSize; }
+			bool valid() const { return mCache != nullptr; }
+
+		private:
+			friend class BasicDiskCache;
+			BasicDiskCache* mCache;
+			Key mHash;
+			std::ofstream mFile;
+			size_t mExpectedSize;
+			size_t mWritten;
+			uint32_t mCrc; // Of the data written so far.
+		};
+
+		// Streams a cached item. The item is pinned while the reader is alive, like with a View.
+		// Readers must be released before the cache is destroyed. An entry that was not checked yet is checked
+		// while it is streamed: if the data read does not match, error() returns ChecksumMismatch once the end of
+		// the item is reached, and the entry is removed.
+		class Reader
+		{
+		public:
+			Reader() : mCache(nullptr), mGeneration(0), mSize(0), mPosition(0), mVerify(false), mCrc(0), mExpectedCrc(0), mError(Error::NoError) {}
+			Reader(const Reader&) = delete;
+			Reader& operator=(const Reader&) = delete;
+
+			Reader(Reader&& other)
+				: mCache(other.mCache)
+				, mHash(std::move(other.mHash))
+				, mGeneration(other.mGeneration)
+				, mFile(std::move(other.mFile))
+				, mSize(other.mSize)
+				, mPosition(other.mPosition)
+				, mVerify(other.mVerify)
+				, mCrc(other.mCrc)
+				, mExpectedCrc(other.mExpectedCrc)
+				, mError(other.mError)
+			{
+				other.mCache = nullptr;
+			}
+
+			Reader& operator=(Reader&& other)
+			{
+				if (this != &other)
+				{
+					release();
+					mCache = other.mCache;
+					mHash = std::move(other.mHash);
+					mGeneration = other.mGeneration;
+					mFile = std::move(other.mFile);
+					mSize = other.mSize;
+					mPosition = other.mPosition;
+					mVerify = other.mVerify;
+					mCrc = other.mCrc;
+					mExpectedCrc = other.mExpectedCrc;
+					mError = other.mError;
+					other.mCache = nullptr;
+				}
+				return *this;
+			}
+
+			~Reader()
+			{
+				release();
+			}
+
+			// Reads up to size bytes and returns the number of bytes read, 0 at the end of the item.
+			size_t read(char* data, size_t size)
+			{
+				if (!mCache)
+					return 0;
+
+				size = std::min(size, mSize - mPosition);
+				mFile.read(data, size);
+				const size_t count = static_cast<size_t>(mFile.gcount());
+				mPosition += count;
+
+				if (mVerify)
+				{
+					mCrc = hash::crc32(data, count, mCrc);
+					if ((count < size) || (mPosition == mSize))
+					{
+						// A file shorter than its entry is as damaged as one with other data.
+						mVerify = false;
+						mError = mCache->checkStreamed(mHash, mGeneration, (count == size) && (mCrc == mExpectedCrc));
+					}
+				}
+				return count;
+			}
+
+			void release()
+			{
+				if (mCache)
+					mCache->unpin(mHash, mGeneration);
+				mCache = nullptr;
+				if (mFile.is_open())
+					mFile.close();
+			}
+
+			size_t size() const { return mSize; }
+			size_t position() const { return mPosition; }
+			bool eof() const { return mPosition >= mSize; }
+			bool valid() const { return mCache != nullptr; }
+			Error error() const { return mError; }
+
+		private:
+			friend class BasicDiskCache;
+			BasicDiskCache* mCache;
+			Key mHash;
+			uint64_t mGeneration;
+			std::ifstream mFile;
+			size_t mSize;
+			size_t mPosition;
+			bool mVerify; // The entry is checked when the end of the item is read.
+			uint32_t mCrc; // Of the data read so far.
+			uint32_t mExpectedCrc;
+			Error mError;
+		};
+
+		typedef Key (*hashFunction)(const std::string& uri);
+
+		// Hashes count uris at once, e.g. hash::sha1_many(). Must give the same hashes as the hash function.
+		typedef void (*batchHashFunction)(const std::string* uris, size_t count, Key* hashes);
+
+		// Entries of up to maxEntrySize bytes are appended to shared segment files of up to segmentSize bytes.
+		// A maxEntrySize of 0 stores every entry in a file of its own.
+		struct SegmentOptions
+		{
+			explicit SegmentOptions(size_t maxEntrySize = 0, size_t segmentSize = 16 * 1048576)
+				: maxEntrySize(maxEntrySize), segmentSize(segmentSize) {}
+			size_t maxEntrySize;
+			size_t segmentSize;
+		};
+
+		// Entries that get a file of their own are stored levels directories deep. Each directory is named by the
+		// next charsPerLevel characters of the hash's string form, e.g. ab/cd/abcd0123... for 2 levels of 2
+		// characters. The index, journal and segment files stay in the cache directory. A recovery scan uses up
+		// to scanThreads threads.
+		struct DirectoryLayout
+		{
+			explicit DirectoryLayout(size_t levels = 0, size_t charsPerLevel = 2, size_t scanThreads = 4)
+				: levels(levels), charsPerLevel(charsPerLevel), scanThreads(scanThreads) {}
+			size_t levels;
+			size_t charsPerLevel;
+			size_t scanThreads;
+		};
+
+		// File I/O of batches. IoUring falls back to Streams if io_uring is not available at build time or run time.
+		enum class IoBackend
+		{
+			Streams,
+			IoUring
 		};
 
-		typedef std::string (*hashFunction)(const std::string& uri);
+		// What is flushed to stable storage. Without syncing, a crash of the machine may lose recent writes, and
+		// the rename of a temporary file may reach the disk before its data, which the checksums then catch.
+		// - Files: each item file and index snapshot before it is renamed into place, and each segment append.
+		// - Full: also each journal flush and the directory of each renamed file, so that a write is durable
+		//   when it returns.
+		enum class SyncPolicy
+		{
+			None,
+			Files,
+			Full
+		};
 
-		DiskCache() = delete;
-		DiskCache(const DiskCache& cache) = delete;
+		BasicDiskCache() = delete;
+		BasicDiskCache(const BasicDiskCache& cache) = delete;
+
+		BasicDiskCache(const std::string& cacheDir, hashFunction func, policy::BasicEvictionPolicy<Key>* policy, size_t cacheSizeInMegaBytes = 50)
+			: BasicDiskCache(cacheDir, func, policy, cacheSizeInMegaBytes, SegmentOptions())
+		{
+		}
 
-		DiskCache(const std::string& cacheDir, hashFunction func, policy::EvictionPolicy* policy, size_t cacheSizeInMegaBytes = 50)
+		BasicDiskCache(const std::string& cacheDir, hashFunction func, policy::BasicEvictionPolicy<Key>* policy, size_t cacheSizeInMegaBytes, SegmentOptions segments, IoBackend backend = IoBackend::Streams, DirectoryLayout layout = DirectoryLayout(), SyncPolicy sync = SyncPolicy::None)
 			: mCacheDir(cacheDir)
 			, mHashFunction(func)
+			, mBatchHashFunction(nullptr)
+			, mIndexPath(index_path("myrmo_disk_cache_index"))
+			, mJournalPath(index_path("myrmo_disk_cache_journal"))
+			, mLayoutPath(index_path("myrmo_disk_cache_layout"))
 			, mPolicy(policy)
 			, mMaxCacheSize(cacheSizeInMegaBytes * 1048576)
 			, mCacheSize(0)
+			, mReservedSize(0)
+			, mSegmentOptions(segments)
+			, mLayout(layout)
+			, mSync(sync)
+			, mActiveSegment(0)
+			, mNextSegment(1)
+			, mJournalCount(0)
+			, mGeneration(0)
 		{
-			const std::string hash(mHashFunction("myrmo_disk_cache_index"));
-			const std::string fName = file_path(hash);
-			mPolicy->setHashSize(hash.size());
+			if (backend == IoBackend::IoUring)
+			{
+				mRing.reset(new util::IoUring());
+				if (!mRing->isOpen())
+					mRing.reset();
+			}
+
+			const Key hash(mHashFunction("myrmo_disk_cache_index"));
+			mHashSize = KeyTraits<Key>::size(hash);
+			mPolicy->setHashSize(mHashSize);
+			assert((mLayout.levels == 0) || (mLayout.charsPerLevel > 0));
+			assert(mLayout.levels * mLayout.charsPerLevel <= KeyTraits<Key>::toString(hash).size());
 
 			std::vector<char> data;
-			Error error = read("myrmo_disk_cache_index", &data, true);
-			if (error != Error::NoError)
-				data.clear();
-			mPolicy->setIndexData(data);
+			Error error = readIndexFile(mIndexPath, &data);
+			const bool indexLoaded = (error == Error::NoError) && loadSnapshot(data);
 
-			// Calculate initial disk cache size.
-			mPolicy->forEach([&](const std::string& hash)
+			error = readIndexFile(mJournalPath, &data);
+			if (error == Error::NoError)
+				replayJournal(data);
+
+			if (!indexLoaded || !layoutUnchanged())
 			{
-				std::ifstream f(file_path(hash), std::ifstream::ate | std::ifstream::binary);
-				if (f.is_open())
-					mCacheSize += f.tellg();
-				f.close();
-			});
+				recover();
+				writeLayoutFile();
+			}
+
+			loadSegments();
+			for (const auto& it : mEntries)
+				mCacheSize += it.second.size;
+			assert(mEntries.size() == mPolicy->count());
+
+			// Start from a fresh snapshot, so that the journal only holds records of this session.
+			error = compact();
+			assert(error == Error::NoError);
+			collectSegments();
 		}
 
-		~DiskCache()
+		~BasicDiskCache()
 		{
-			Error error = writeIndexFile();
+			for (const auto& it : mEntries)
+				assert(it.second.pins == 0); // Outstanding views or readers.
+			assert(mPending.empty()); // Outstanding writers.
+			Error error = compact();
 			assert(error == Error::NoError);
 		}
 
-		Error read(const std::string& uri, std::vector<char>* data, bool isIndexFile = false)
+		// Zero-copy read. On success the view maps the item's file and pins the item until released.
+		Error read(const std::string& uri, View* view)
+		{
+			return readHash(mHashFunction(uri), view);
+		}
+
+		// Same as read(), for callers that already have the hash of the uri.
+		Error readHash(const Key& hash, View* view)
 		{
 			Error error = Error::FileDoesNotExist;
-			const std::string hash(mHashFunction(uri));
+			view->release();
 
-			if (isIndexFile || (mPolicy->exists(hash) == policy::Error::NoError))
+			if (mPolicy->exists(hash) == policy::Error::NoError)
 			{
-				std::ifstream f(file_path(hash), std::ios::binary);
-
-				if (f.is_open())
+				const auto it = mEntries.find(hash);
+				assert(it != mEntries.end());
+				const bool opened = (it != mEntries.end()) && (it->second.segment
+					? view->mFile.open(segment_path(it->second.segment), it->second.offset, it->second.size)
+					: view->mFile.open(file_path(hash)));
+				if (opened && (verifyEntry(hash, view->mFile.data(), view->mFile.size()) != Error::NoError))
+				{
+					view->mFile.close();
+					return Error::ChecksumMismatch;
+				}
+				if (opened)
 				{
-					f.seekg(0, std::ios::end);
-					const size_t fSize = f.tellg();
-					f.seekg(0, std::ios::beg);
+					it->second.pins++;
+					view->mCache = this;
+					view->mHash = hash;
+					view->mGeneration = it->second.generation;
+					journal(JournalRecord::Touch, hash);
+					error = Error::NoError;
+				}
+			}
+
+			return error;
+		}
 
-					data->resize(fSize, '\0');
-					f.read(&(*data)[0], fSize);
-					f.close();
+		Error openReader(const std::string& uri, Reader* reader)
+		{
+			Error error = Error::FileDoesNotExist;
+			const Key hash(mHashFunction(uri));
+			reader->release();
 
-					error = Error::NoError;
+			if (mPolicy->exists(hash) == policy::Error::NoError)
+			{
+				const auto it = mEntries.find(hash);
+				assert(it != mEntries.end());
+				if (it != mEntries.end())
+				{
+					reader->mFile.clear();
+					reader->mFile.open(it->second.segment ? segment_path(it->second.segment) : file_path(hash), std::ios::binary);
+					if (it->second.segment)
+						reader->mFile.seekg(it->second.offset);
+					if (reader->mFile.is_open() && reader->mFile.good())
+					{
+						it->second.pins++;
+						reader->mCache = this;
+						reader->mHash = hash;
+						reader->mGeneration = it->second.generation;
+						reader->mSize = it->second.size;
+						reader->mPosition = 0;
+						reader->mVerify = it->second.hasCrc && !it->second.verified;
+						reader->mCrc = 0;
+						reader->mExpectedCrc = it->second.crc;
+						reader->mError = Error::NoError;
+						journal(JournalRecord::Touch, hash);
+						error = Error::NoError;
+					}
 				}
 			}
 
 			return error;
 		}
 
+		Error read(const std::string& uri, std::vector<char>* data, bool isIndexFile = false)
+		{
+			if (isIndexFile)
+				return readIndexFile(index_path(uri), data);
+
+			return readHash(mHashFunction(uri), data);
+		}
+
+		Error readHash(const Key& hash, std::vector<char>* data)
+		{
+			View view;
+			Error error = readHash(hash, &view);
+			if (error == Error::NoError)
+				data->assign(view.begin(), view.end());
+			return error;
+		}
+
+		// Reads a batch of items. Each view is set as by read(), and the returned errors are per item.
+		std::vector<Error> readMany(const std::vector<std::string>& uris, std::vector<View>* views)
+		{
+			std::vector<Error> errors(uris.size(), Error::FileDoesNotExist);
+			const std::vector<Key> hashes(detail::hash_many(mHashFunction, mBatchHashFunction, uris.data(), uris.size()));
+			views->resize(uris.size());
+			for (size_t i = 0; i < uris.size(); i++)
+				errors[i] = readHash(hashes[i], &(*views)[i]);
+			return errors;
+		}
+
+		// Reads a batch of items. The returned errors are per item, as returned by read().
+		std::vector<Error> readMany(const std::vector<std::string>& uris, std::vector<std::vector<char>>* data)
+		{
+			std::vector<Error> errors(uris.size(), Error::FileDoesNotExist);
+			const std::vector<Key> hashes(detail::hash_many(mHashFunction, mBatchHashFunction, uris.data(), uris.size()));
+			data->resize(uris.size());
+			if (mRing)
+			{
+				readFiles(hashes, data, &errors);
+				return errors;
+			}
+
+			for (size_t i = 0; i < uris.size(); i++)
+			{
+				errors[i] = readHash(hashes[i], &(*data)[i]);
+				if (errors[i] != Error::NoError)
+					(*data)[i].clear();
+			}
+			return errors;
+		}
+
 		Error write(const std::string& uri, const char* data, size_t size)
 		{
-			Error error = Error::NoError;
-			const std::string hash(mHashFunction(uri));
-			const std::string fName(file_path(hash));
+			return writeHash(mHashFunction(uri), data, size);
+		}
+
+		// Same as write(), for callers that already have the hash of the uri.
+		Error writeHash(const Key& hash, const char* data, size_t size)
+		{
 			assert(mPolicy->exists(hash) == policy::Error::DoesNotExist);
 
-			std::ifstream i(fName, std::ios::binary);
-			if (i.good())
+			Error error = writeFile(hash, data, size);
+			if (error == Error::NoError)
+				error = flushJournal();
+			return error;
+		}
+
+		// Writes a batch of items with one eviction pass and one index file update for the whole batch. The
+		// returned errors are per item, as returned by write(). Items of a batch that exceeds the cache size may
+		// evict earlier items of the batch.
+		std::vector<Error> writeMany(const std::vector<WriteItem>& items)
+		{
+			std::vector<Error> errors(items.size(), Error::NoError);
+			const std::vector<Key> hashes(detail::hash_many(mHashFunction, mBatchHashFunction, items));
+			std::unordered_set<Key, KeyHash<Key>> batch;
+
+			// Items that exist, or come earlier in the batch, are not written and do not count towards the eviction.
+			size_t batchSize = 0;
+			for (size_t i = 0; i < items.size(); i++)
+			{
+				if ((mEntries.find(hashes[i]) != mEntries.end()) || (mPending.find(hashes[i]) != mPending.end()) || !batch.insert(hashes[i]).second)
+					errors[i] = Error::FileExists;
+				else if ((items[i].size > 0) && (items[i].size <= mMaxCacheSize))
+					batchSize += items[i].size;
+			}
+
+			// Make room for the whole batch at once. The journal is flushed once for the whole batch.
+			Error error = Error::FileSizeGreaterThanMaxCacheSize;
+			if (batchSize <= mMaxCacheSize)
+				error = evictUntilEnoughSpace(batchSize);
+
+			if (mRing && (error == Error::NoError))
 			{
-				error = Error::FileExists;
-				i.close();
+				writeFiles(items, hashes, &errors);
 			}
 			else
 			{
-				std::ofstream f(file_path(hash), std::ios::binary);
-				if (f.is_open())
+				for (size_t i = 0; i < items.size(); i++)
+				{
+					if (errors[i] == Error::NoError)
+						errors[i] = writeFile(hashes[i], items[i].data, items[i].size);
+				}
+			}
+
+			const bool written = std::find(errors.begin(), errors.end(), Error::NoError) != errors.end();
+
+			if (written && (flushJournal() != Error::NoError))
+			{
+				for (Error& error : errors)
 				{
-					error = evictUntilEnoughSpace(size);
 					if (error == Error::NoError)
-					{
-						f.write(data, size);
-						mCacheSize += size;
-						mPolicy->add(hash);
-						error = writeIndexFile();
-					}
-					f.close();
+						error = Error::CouldNotWriteIndexFile;
+				}
+			}
+
+			return errors;
+		}
+
+		// Evicts until expectedSize bytes fit and reserves them for the writer.
+		Error openWriter(const std::string& uri, size_t expectedSize, Writer* writer)
+		{
+			writer->abort();
+			const Key hash(mHashFunction(uri));
+			const std::string fName(file_path(hash));
+
+			// Only the index tells whether the item exists. A file without an entry, e.g. left by a crash between
+			// a commit and the journal flush, is replaced on commit.
+			if ((mEntries.find(hash) != mEntries.end()) || (mPending.find(hash) != mPending.end()))
+				return Error::FileExists;
+
+			Error error = evictUntilEnoughSpace(expectedSize);
+			if ((error == Error::NoError) && !ensureDirectory(hash))
+				error = Error::CouldNotWriteFile;
+			if (error == Error::NoError)
+			{
+				writer->mFile.clear();
+				writer->mFile.open(fName + ".tmp", std::ios::binary | std::ios::trunc);
+				if (writer->mFile.is_open())
+				{
+					mReservedSize += expectedSize;
+					mPending.insert(hash);
+					writer->mCache = this;
+					writer->mHash = hash;
+					writer->mExpectedSize = expectedSize;
+					writer->mWritten = 0;
 				}
 				else
 				{
@@ -161,36 +738,79 @@ namespace myrmo { namespace cache
 		Error clear()
 		{
 			Error error = Error::NoError;
+			util::FileBatch unlinks(mRing.get());
 
-			std::string hash = mPolicy->back();
-			while (hash.size())
+			while (mPolicy->count() > 0)
 			{
-				error = removeFile(hash);
-				if ((error == Error::NoError) || (error == Error::FileDoesNotExist))
+				const Key hash = mPolicy->back();
+				error = removeFile(hash, mRing ? &unlinks : nullptr);
+				if (error == Error::FileDoesNotExist)
 				{
-					mPolicy->remove(hash);
-					hash = mPolicy->back();
+					mPolicy->remove(hash); // In the policy, but not in the index.
 				}
-				else // Error::CouldNotDeleteFile
+				else if (error != Error::NoError) // Error::CouldNotDeleteFile
 				{
 					break;
 				}
 			}
 
+			submitUnlinks(unlinks);
 			if (error == Error::NoError)
 				assert(mCacheSize == 0);
 
+			// Replace the journal of removes with an empty snapshot.
+			const Error indexError = compact();
+			if (error == Error::NoError)
+				error = indexError;
+
 			return error;
 		}
 
 		inline Error remove(const std::string& uri)
 		{
-			Error error = removeFile(mHashFunction(uri));
+			return removeHash(mHashFunction(uri));
+		}
+
+		// Same as remove(), for callers that already have the hash of the uri.
+		Error removeHash(const Key& hash)
+		{
+			Error error = removeFile(hash);
 			if (error == Error::NoError)
-				writeIndexFile();
+			{
+				flushJournal();
+				collectSegments();
+			}
 			return error;
 		}
 
+		Key hash(const std::string& uri) const
+		{
+			return mHashFunction(uri);
+		}
+
+		// Used to hash the uris of readMany() and writeMany(). By default they are hashed one by one.
+		void setBatchHashFunction(batchHashFunction func)
+		{
+			mBatchHashFunction = func;
+		}
+
+		// True if the item is in the cache or being written. Unlike a read, this does not count as a use.
+		bool containsHash(const Key& hash) const
+		{
+			return (mEntries.find(hash) != mEntries.end()) || (mPending.find(hash) != mPending.end());
+		}
+
+		const SegmentOptions& segmentOptions() const
+		{
+			return mSegmentOptions;
+		}
+
+		// The backend in use, which is Streams if io_uring was asked for but is not available.
+		IoBackend ioBackend() const
+		{
+			return mRing ? IoBackend::IoUring : IoBackend::Streams;
+		}
+
 		size_t size() const
 		{
 			return mCacheSize; // Disregarding index file
@@ -202,77 +822,925 @@ namespace myrmo { namespace cache
 		}
 
 	private:
-		inline Error removeFile(const std::string& hash, bool isIndexFile = false)
+		struct Entry
 		{
-			Error error = Error::NoError;
+			Entry() : size(0), offset(0), segment(0), crc(0), hasCrc(false), verified(false), generation(0), pins(0) {}
+			explicit Entry(uint64_t size) : size(size), offset(0), segment(0), crc(0), hasCrc(false), verified(false), generation(0), pins(0) {}
+			// An entry written in this session needs no check.
+			Entry(uint64_t size, uint32_t crc) : size(size), offset(0), segment(0), crc(crc), hasCrc(true), verified(true), generation(0), pins(0) {}
+			uint64_t size;
+			uint64_t offset;
+			uint32_t segment;
+			uint32_t crc;
+			bool hasCrc;
+			bool verified; // Not persisted, entries are checked once per session.
+			uint64_t generation; // Tells views of a removed item from views of an item written again under its uri.
+			size_t pins;
+		};
+
+		struct Segment
+		{
+			Segment() : size(0), live(0) {}
+			uint64_t size; // Bytes appended, live or dead.
+			uint64_t live; // Bytes of entries in the index.
+			std::unordered_set<Key, KeyHash<Key>> keys; // Entries in the index, so collecting a segment only visits its own.
+		};
+
+		// Writes the item's file or appends it to a segment, and adds it to the index. Does not flush the journal.
+		// Whether the item exists is decided by the index, so the file of an item that never made it into the
+		// index is replaced.
+		inline Error writeFile(const Key& hash, const char* data, size_t size)
+		{
+			if ((mEntries.find(hash) != mEntries.end()) || (mPending.find(hash) != mPending.end()))
+				return Error::FileExists;
 
-			const std::string fileName = file_path(hash);
-			std::ifstream f(fileName, std::ios::binary);
-			if (f.good())
+			if (size <= mSegmentOptions.maxEntrySize)
 			{
-				f.seekg(0, std::ios::end);
-				const size_t fSize = f.tellg();
-				f.seekg(0, std::ios::beg);
+				Error error = evictUntilEnoughSpace(size);
+				Entry entry(size, hash::crc32(data, size));
+				if (error == Error::NoError)
+					error = appendToSegment(hash, data, size, &entry);
+				if (error == Error::NoError)
+					addEntry(hash, entry);
+				return error;
+			}
+
+			const std::string fName(file_path(hash));
 
-				bool removed = std::remove(fileName.c_str()) == 0;
-				if (removed)
+			// Evict first, so that an item that cannot be cached does not leave an empty file behind.
+			Error error = evictUntilEnoughSpace(size);
+			if ((error == Error::NoError) && !ensureDirectory(hash))
+				error = Error::CouldNotWriteFile;
+			if (error == Error::NoError)
+			{
+				const std::string tmpName(fName + ".tmp");
+				std::ofstream f(tmpName, std::ios::binary | std::ios::trunc);
+				f.write(data, size);
+				f.close();
+				if (f.good() && commitFile(tmpName, fName))
 				{
-					mCacheSize -= fSize;
-					if (!isIndexFile)
-						mPolicy->remove(hash);
+					addEntry(hash, Entry(size, hash::crc32(data, size)));
 				}
 				else
 				{
-					error = Error::CouldNotDeleteFile;
+					std::remove(tmpName.c_str());
+					error = Error::CouldNotWriteFile;
 				}
 			}
-			else
-			{
-				error = Error::FileDoesNotExist;
-			}
 
 			return error;
 		}
 
-		inline std::string file_path(const std::string& hash) const
+		inline void addEntry(const Key& hash, Entry entry)
 		{
-			return mCacheDir + "/" + hash;
+			entry.generation = ++mGeneration;
+			mEntries[hash] = entry;
+			mCacheSize += entry.size;
+			mPolicy->add(hash);
+			journal(JournalRecord::Add, hash, entry);
 		}
 
-		inline Error writeIndexFile() const
+		// Removes the item's file and index entry. The size comes from the index, so the file is not opened. With a
+		// batch, the unlink is queued in it and the entry is removed before the file is.
+		inline Error removeFile(const Key& hash, util::FileBatch* unlinks = nullptr)
 		{
-			Error error = Error::CouldNotWriteIndexFile;
+			const auto it = mEntries.find(hash);
+			if (it == mEntries.end())
+				return Error::FileDoesNotExist;
 
-			const std::string hash(mHashFunction("myrmo_disk_cache_index"));
-			const std::string fName = mCacheDir + "/" + hash;
-			std::ofstream f(fName, std::ios::binary);
-
-			if (f.is_open())
+			if (it->second.segment)
 			{
-				std::string indexData = mPolicy->getIndexData();
-				f.write(indexData.c_str(), indexData.size());
-				f.close();
-				error = Error::NoError;
+				releaseFromSegment(hash, it->second);
+			}
+			else if (unlinks)
+			{
+				unlinks->unlink(file_path(hash));
+			}
+			else
+			{
+				// A file that is already gone only needs to leave the index.
+				const std::string fileName = file_path(hash);
+				if ((std::remove(fileName.c_str()) != 0) && (errno != ENOENT))
+					return Error::CouldNotDeleteFile;
 			}
 
-			return error;
+			// Views of a pinned item keep their mapping of the unlinked file.
+			mCacheSize -= it->second.size;
+			mEntries.erase(it);
+			mPolicy->remove(hash);
+			journal(JournalRecord::Remove, hash);
+			return Error::NoError;
 		}
 
-		inline Error evictUntilEnoughSpace(const size_t size)
+		// Checks the entry's data against its CRC32 on the first read of the entry. An entry that fails the check is
+		// removed, so the next write of the item replaces it.
+		inline Error verifyEntry(const Key& hash, const char* data, size_t size)
 		{
-			Error error = Error::NoError;
+			const auto it = mEntries.find(hash);
+			if (it == mEntries.end())
+				return Error::FileDoesNotExist; // Removed by an earlier check of the same batch.
+			if (it->second.verified)
+				return Error::NoError;
 
-			if (size > mMaxCacheSize)
+			if (it->second.hasCrc && ((size != it->second.size) || (hash::crc32(data, size) != it->second.crc)))
 			{
-				error = Error::FileSizeGreaterThanMaxCacheSize;
+				removeHash(hash); // Readers that still stream it keep their open file.
+				return Error::ChecksumMismatch;
 			}
-			else
+
+			it->second.verified = true;
+			return Error::NoError;
+		}
+
+		// Renames a written temporary file into place, flushing what the sync policy asks for.
+		inline bool commitFile(const std::string& tmpName, const std::string& fName) const
+		{
+			if ((mSync != SyncPolicy::None) && !util::sync_file(tmpName))
+				return false;
+			if (std::rename(tmpName.c_str(), fName.c_str()) != 0)
+				return false;
+			return (mSync != SyncPolicy::Full) || util::sync_parent_directory(fName);
+		}
+
+		// Called by a reader at the end of an entry that was not checked yet. Entries that were removed or written
+		// again in the meantime are not touched.
+		Error checkStreamed(const Key& hash, uint64_t generation, bool matches)
+		{
+			const auto it = mEntries.find(hash);
+			if ((it == mEntries.end()) || (it->second.generation != generation) || it->second.verified)
+				return matches ? Error::NoError : Error::ChecksumMismatch;
+
+			if (!matches)
 			{
-				size_t errorCount = 0;
-				while ((mCacheSize + size) > mMaxCacheSize)
-				{
-					const std::string hash = mPolicy->back();
-					error = removeFile(hash); // Also calls mPolicy->remove(hash).
+				removeHash(hash);
+				return Error::ChecksumMismatch;
+			}
+			it->second.verified = true;
+			return Error::NoError;
+		}
+
+		// Only the view of the current generation of an item unpins it. Views of removed items have nothing to unpin.
+		void unpin(const Key& hash, uint64_t generation)
+		{
+			const auto it = mEntries.find(hash);
+			if ((it != mEntries.end()) && (it->second.generation == generation))
+			{
+				assert(it->second.pins > 0);
+				it->second.pins--;
+			}
+		}
+
+		Error commitWriter(Writer& writer)
+		{
+			const std::string fName(file_path(writer.mHash));
+			writer.mFile.close();
+			mReservedSize -= writer.mExpectedSize;
+			mPending.erase(writer.mHash);
+
+			if (writer.mFile.fail() || !commitFile(fName + ".tmp", fName))
+			{
+				std::remove((fName + ".tmp").c_str());
+				return Error::CouldNotWriteFile;
+			}
+
+			addEntry(writer.mHash, Entry(writer.mWritten, writer.mCrc));
+			return flushJournal();
+		}
+
+		void abortWriter(Writer& writer)
+		{
+			writer.mFile.close();
+			std::remove((file_path(writer.mHash) + ".tmp").c_str());
+			mReservedSize -= writer.mExpectedSize;
+			mPending.erase(writer.mHash);
+		}
+
+		inline Error readIndexFile(const std::string& path, std::vector<char>* data) const
+		{
+			std::ifstream f(path, std::ios::binary);
+			if (!f.is_open())
+				return Error::FileDoesNotExist;
+
+			f.seekg(0, std::ios::end);
+			const size_t fSize = f.tellg();
+			f.seekg(0, std::ios::beg);
+
+			data->resize(fSize, '\0');
+			f.read(&(*data)[0], fSize);
+			return Error::NoError;
+		}
+
+		inline std::string file_path(const Key& hash) const
+		{
+			const std::string name(KeyTraits<Key>::toString(hash));
+			std::string path(mCacheDir);
+			for (size_t level = 0; level < mLayout.levels; level++)
+			{
+				path += '/';
+				path.append(name, std::min(name.size(), level * mLayout.charsPerLevel), mLayout.charsPerLevel);
+			}
+			return path + "/" + name;
+		}
+
+		// The index, journal and layout files are named after the hash of their name and stay in the cache directory.
+		inline std::string index_path(const std::string& name) const
+		{
+			return mCacheDir + "/" + KeyTraits<Key>::toString(mHashFunction(name));
+		}
+
+		// Creates the directories of the item's file. Directories created before are remembered.
+		bool ensureDirectory(const Key& hash)
+		{
+			if (mLayout.levels == 0)
+				return true;
+
+			std::string dir(file_path(hash));
+			dir.erase(dir.rfind('/'));
+			if (mDirectories.find(dir) != mDirectories.end())
+				return true;
+
+			for (size_t pos = mCacheDir.size() + 1; pos <= dir.size(); pos++)
+			{
+				if ((pos < dir.size()) && (dir[pos] != '/'))
+					continue;
+				if ((::mkdir(dir.substr(0, pos).c_str(), 0755) != 0) && (errno != EEXIST))
+					return false;
+			}
+			mDirectories.insert(dir);
+			return true;
+		}
+
+		inline std::string segment_path(uint32_t segment) const
+		{
+			return mCacheDir + "/segment-" + std::to_string(segment);
+		}
+
+		// Appends an entry's data to the current segment and sets the entry's location. The entry's CRC32 is left
+		// as it is, so that moved entries keep the checksum of their original write.
+		inline Error appendToSegment(const Key& hash, const char* data, size_t size, Entry* entry)
+		{
+			if (mActiveSegment && ((mSegments[mActiveSegment].size + size) > mSegmentOptions.segmentSize))
+				sealSegment();
+
+			bool created = false;
+			if (!mActiveSegment)
+			{
+				mActiveSegment = mNextSegment++;
+				mSegments[mActiveSegment] = Segment();
+				mSegmentFile.clear();
+				mSegmentFile.open(segment_path(mActiveSegment), std::ios::binary | std::ios::trunc);
+				created = true;
+			}
+
+			Segment& segment = mSegments[mActiveSegment];
+			entry->segment = mActiveSegment;
+			entry->offset = segment.size;
+			segment.size += size;
+
+			// Flushed right away, so that the data is visible to mapped views and readers.
+			const std::string path(segment_path(mActiveSegment));
+			mSegmentFile.write(data, size);
+			mSegmentFile.flush();
+			if (mSegmentFile.good() && (mSync != SyncPolicy::None) && !util::sync_file(path))
+				mSegmentFile.setstate(std::ios::badbit);
+			if (mSegmentFile.good() && created && (mSync == SyncPolicy::Full) && !util::sync_parent_directory(path))
+				mSegmentFile.setstate(std::ios::badbit);
+			if (!mSegmentFile.good())
+			{
+				sealSegment(); // The segment may hold a partial write. Its space is reclaimed like dead entries.
+				return Error::CouldNotWriteFile;
+			}
+
+			segment.live += size;
+			segment.keys.insert(hash);
+			return Error::NoError;
+		}
+
+		inline void sealSegment()
+		{
+			mSegmentFile.close();
+			const uint32_t sealed = mActiveSegment;
+			mActiveSegment = 0;
+			releaseFromSegment(sealed, 0);
+		}
+
+		inline void releaseFromSegment(const Key& hash, const Entry& entry)
+		{
+			const auto it = mSegments.find(entry.segment);
+			if (it != mSegments.end())
+				it->second.keys.erase(hash);
+			releaseFromSegment(entry.segment, entry.size);
+		}
+
+		// Deletes segments without live entries, and queues full segments that are less than half live for collection.
+		inline void releaseFromSegment(uint32_t id, uint64_t size)
+		{
+			const auto it = mSegments.find(id);
+			assert(it != mSegments.end());
+			if (it == mSegments.end())
+				return;
+
+			assert(it->second.live >= size);
+			it->second.live -= size;
+			if (it->second.live == 0)
+			{
+				if (id == mActiveSegment)
+				{
+					mSegmentFile.close();
+					mActiveSegment = 0;
+				}
+				std::remove(segment_path(id).c_str());
+				mSegments.erase(it);
+				mCollectableSegments.erase(id);
+			}
+			else if ((id != mActiveSegment) && (it->second.live * 2 < it->second.size))
+			{
+				mCollectableSegments.insert(id);
+			}
+		}
+
+		// Moves the live entries of the queued segments to the current segment and deletes the queued segments.
+		// Views and readers of moved entries keep the data of the old segment file.
+		inline void collectSegments()
+		{
+			while (!mCollectableSegments.empty())
+			{
+				const uint32_t id = *mCollectableSegments.begin();
+				mCollectableSegments.erase(mCollectableSegments.begin());
+
+				// Moved in file order, so the old segment is read front to back.
+				std::vector<std::pair<uint64_t, Key>> live;
+				for (const Key& hash : mSegments[id].keys)
+				{
+					const auto it = mEntries.find(hash);
+					assert((it != mEntries.end()) && (it->second.segment == id));
+					if ((it != mEntries.end()) && (it->second.segment == id))
+						live.push_back({ it->second.offset, hash });
+				}
+				std::sort(live.begin(), live.end(), [](const std::pair<uint64_t, Key>& a, const std::pair<uint64_t, Key>& b) { return a.first < b.first; });
+
+				std::ifstream f(segment_path(id), std::ios::binary);
+				std::vector<char> data;
+				bool moved = f.is_open();
+				for (const auto& item : live)
+				{
+					if (!moved)
+						break;
+
+					Entry& current = mEntries[item.second];
+					data.resize(current.size);
+					f.seekg(current.offset);
+					f.read(data.data(), data.size());
+					Entry entry(current);
+					moved = f.good() && (appendToSegment(item.second, data.data(), data.size(), &entry) == Error::NoError);
+					if (moved)
+					{
+						current.segment = entry.segment;
+						current.offset = entry.offset;
+						Segment& old = mSegments[id];
+						old.live -= entry.size;
+						old.keys.erase(item.second);
+						journal(JournalRecord::Move, item.second, current);
+					}
+				}
+
+				// The new locations must be persisted before the old segment is gone. If moving failed, the
+				// segment stays with the entries that are left in it.
+				if ((flushJournal() == Error::NoError) && (mSegments[id].live == 0))
+				{
+					std::remove(segment_path(id).c_str());
+					mSegments.erase(id);
+				}
+			}
+		}
+
+		// The layout file holds "levels charsPerLevel". Caches from before layouts existed have none and are flat.
+		// Returns false if the file cannot be parsed.
+		bool readLayoutFile(size_t* levels, size_t* charsPerLevel) const
+		{
+			std::ifstream f(mLayoutPath);
+			*levels = 0;
+			*charsPerLevel = mLayout.charsPerLevel;
+			return !f.is_open() || static_cast<bool>(f >> *levels >> *charsPerLevel);
+		}
+
+		bool layoutUnchanged() const
+		{
+			size_t levels, charsPerLevel;
+			if (!readLayoutFile(&levels, &charsPerLevel))
+				return false;
+			return (levels == mLayout.levels) && ((levels == 0) || (charsPerLevel == mLayout.charsPerLevel));
+		}
+
+		void writeLayoutFile() const
+		{
+			const std::string& fName(mLayoutPath);
+			std::ofstream f(fName + ".tmp", std::ios::trunc);
+			f << mLayout.levels << " " << mLayout.charsPerLevel << "\n";
+			f.close();
+			if (!f.good() || !commitFile(fName + ".tmp", fName))
+				std::remove((fName + ".tmp").c_str());
+		}
+
+		struct ScannedFile
+		{
+			std::string dir;
+			std::string name;
+			uint64_t size;
+			int64_t modified;
+		};
+
+		// Lists the regular files and subdirectories of dir, and those of its subdirectories depth levels down.
+		static void scanDirectory(const std::string& dir, size_t depth, std::vector<ScannedFile>* files, std::vector<std::string>* dirs)
+		{
+			DIR* d = ::opendir(dir.c_str());
+			if (!d)
+				return;
+
+			std::vector<std::string> subdirs;
+			while (const struct dirent* e = ::readdir(d))
+			{
+				const std::string name(e->d_name);
+				struct stat st;
+				if ((name == ".") || (name == "..") || (::fstatat(::dirfd(d), e->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0))
+					continue;
+				if (S_ISDIR(st.st_mode))
+					subdirs.push_back(dir + "/" + name);
+				else if (S_ISREG(st.st_mode))
+					files->push_back(ScannedFile{ dir, name, static_cast<uint64_t>(st.st_size), static_cast<int64_t>(st.st_mtime) });
+			}
+			::closedir(d);
+
+			for (const std::string& subdir : subdirs)
+			{
+				dirs->push_back(subdir);
+				if (depth > 0)
+					scanDirectory(subdir, depth - 1, files, dirs);
+			}
+		}
+
+		// Scans the cache directory for item files and reconciles the index with them. The subdirectories of the
+		// cache directory are scanned in parallel. Files are moved to where the current layout puts them, entries
+		// without a file are dropped, and files without an entry are added, least recently modified first.
+		// Leftover temporary files of writers and segment files without entries are deleted.
+		void recover()
+		{
+			// Item files are as deep as the current layout or the one in the layout file, which is not rewritten
+			// before the scan. Without a readable layout file, any layout the hash names allow is scanned.
+			const size_t nameSize = KeyTraits<Key>::toString(mHashFunction("myrmo_disk_cache_index")).size();
+			size_t levels, charsPerLevel;
+			if (!readLayoutFile(&levels, &charsPerLevel))
+				levels = nameSize;
+			const size_t depth = std::min(std::max(levels, mLayout.levels), nameSize);
+
+			std::vector<ScannedFile> files;
+			std::vector<std::string> dirs;
+			scanDirectory(mCacheDir, 0, &files, &dirs);
+
+			const size_t threadCount = std::min(std::max<size_t>(mLayout.scanThreads, 1), dirs.size());
+			std::vector<std::vector<ScannedFile>> threadFiles(threadCount);
+			std::vector<std::vector<std::string>> threadDirs(threadCount);
+			std::atomic<size_t> next(0);
+			const size_t topDirCount = dirs.size();
+			auto scan = [&](size_t thread)
+			{
+				for (size_t i = next++; i < topDirCount; i = next++)
+					scanDirectory(dirs[i], (depth > 0) ? depth - 1 : 0, &threadFiles[thread], &threadDirs[thread]);
+			};
+			std::vector<std::thread> threads;
+			for (size_t t = 1; t < threadCount; t++)
+				threads.push_back(std::thread(scan, t));
+			if (threadCount > 0)
+				scan(0);
+			for (std::thread& thread : threads)
+				thread.join();
+			for (size_t t = 0; t < threadCount; t++)
+			{
+				files.insert(files.end(), threadFiles[t].begin(), threadFiles[t].end());
+				dirs.insert(dirs.end(), threadDirs[t].begin(), threadDirs[t].end());
+			}
+
+			std::sort(files.begin(), files.end(), [](const ScannedFile& a, const ScannedFile& b)
+			{
+				return (a.modified != b.modified) ? (a.modified < b.modified) : (a.name < b.name);
+			});
+
+			std::set<uint32_t> segments;
+			for (const auto& it : mEntries)
+			{
+				if (it.second.segment)
+					segments.insert(it.second.segment);
+			}
+
+			const std::string reserved[] = {
+				KeyTraits<Key>::toString(mHashFunction("myrmo_disk_cache_index")),
+				KeyTraits<Key>::toString(mHashFunction("myrmo_disk_cache_journal")),
+				KeyTraits<Key>::toString(mHashFunction("myrmo_disk_cache_layout"))
+			};
+
+			// A file at the place the layout puts it wins over copies of the same item elsewhere.
+			std::unordered_map<Key, size_t, KeyHash<Key>> chosen;
+			std::vector<bool> isItem(files.size(), false);
+			std::vector<Key> hashes(files.size());
+			for (size_t i = 0; i < files.size(); i++)
+			{
+				const ScannedFile& file = files[i];
+				const std::string path(file.dir + "/" + file.name);
+				const bool topLevel = (file.dir == mCacheDir);
+
+				if ((file.name.size() > 4) && (file.name.compare(file.name.size() - 4, 4, ".tmp") == 0))
+				{
+					::unlink(path.c_str()); // A writer that never committed.
+					continue;
+				}
+				if (topLevel && (file.name.compare(0, 8, "segment-") == 0))
+				{
+					const std::string id(file.name.substr(8));
+					if (!id.empty() && (id.size() <= 9) && (id.find_first_not_of("0123456789") == std::string::npos) && !segments.count(static_cast<uint32_t>(std::stoul(id))))
+						::unlink(path.c_str());
+					continue;
+				}
+				if (topLevel && std::count(std::begin(reserved), std::end(reserved), file.name))
+					continue;
+
+				Key hash;
+				if (!KeyTraits<Key>::fromString(file.name, &hash) || (KeyTraits<Key>::size(hash) != mHashSize) || (KeyTraits<Key>::toString(hash) != file.name))
+					continue;
+
+				isItem[i] = true;
+				hashes[i] = hash;
+				const auto it = chosen.find(hash);
+				if ((it == chosen.end()) || (path == file_path(hash)))
+					chosen[hash] = i;
+			}
+
+			std::unordered_set<Key, KeyHash<Key>> found;
+			for (size_t i = 0; i < files.size(); i++)
+			{
+				if (!isItem[i])
+					continue;
+
+				const Key& hash = hashes[i];
+				const std::string path(files[i].dir + "/" + files[i].name);
+				const auto entry = mEntries.find(hash);
+				if ((chosen[hash] != i) || ((entry != mEntries.end()) && entry->second.segment))
+				{
+					::unlink(path.c_str()); // A second copy, or an item the index has in a segment.
+					continue;
+				}
+
+				const std::string expected(file_path(hash));
+				if ((path != expected) && (!ensureDirectory(hash) || (std::rename(path.c_str(), expected.c_str()) != 0)))
+					continue;
+
+				found.insert(hash);
+				if (entry == mEntries.end())
+				{
+					mEntries[hash] = Entry(files[i].size);
+					mPolicy->add(hash);
+				}
+				else
+				{
+					entry->second.size = files[i].size;
+				}
+			}
+
+			for (auto it = mEntries.begin(); it != mEntries.end();)
+			{
+				if (!it->second.segment && !found.count(it->first))
+				{
+					mPolicy->remove(it->first);
+					it = mEntries.erase(it);
+				}
+				else
+				{
+					++it;
+				}
+			}
+
+			// Directories left empty, e.g. by a change of layout, are removed, deepest first.
+			std::sort(dirs.begin(), dirs.end(), [](const std::string& a, const std::string& b) { return a.size() > b.size(); });
+			for (const std::string& dir : dirs)
+			{
+				if ((::rmdir(dir.c_str()) == 0) || (errno == ENOENT))
+					mDirectories.erase(dir);
+			}
+		}
+
+		// Rebuilds the segment table from the index. Entries whose segment file is gone are dropped.
+		inline void loadSegments()
+		{
+			for (const auto& it : mEntries)
+			{
+				if (it.second.segment)
+				{
+					Segment& segment = mSegments[it.second.segment];
+					segment.live += it.second.size;
+					segment.keys.insert(it.first);
+					mNextSegment = std::max(mNextSegment, it.second.segment + 1);
+				}
+			}
+
+			std::set<uint32_t> missing;
+			for (auto& it : mSegments)
+			{
+				std::ifstream f(segment_path(it.first), std::ifstream::ate | std::ifstream::binary);
+				if (f.is_open())
+				{
+					it.second.size = static_cast<uint64_t>(f.tellg());
+					if (it.second.live * 2 < it.second.size)
+						mCollectableSegments.insert(it.first);
+				}
+				else
+				{
+					missing.insert(it.first);
+				}
+			}
+
+			if (missing.empty())
+				return;
+
+			for (auto it = mEntries.begin(); it != mEntries.end();)
+			{
+				if (missing.count(it->second.segment))
+				{
+					mPolicy->remove(it->first);
+					it = mEntries.erase(it);
+				}
+				else
+				{
+					++it;
+				}
+			}
+			for (uint32_t id : missing)
+				mSegments.erase(id);
+		}
+
+		enum class JournalRecord : char
+		{
+			Add = 'A',
+			Touch = 'T',
+			Remove = 'R',
+			Move = 'M'
+		};
+
+		// Appends a record to the journal. Records are buffered until flushJournal(), so that touches from reads
+		// cost no I/O of their own. Losing buffered touches in a crash only loses recency information.
+		inline void journal(JournalRecord record, const Key& hash, const Entry& entry = Entry())
+		{
+			if (!mJournal.is_open())
+				return;
+
+			mJournalBuffer.push_back(static_cast<char>(record));
+			KeyTraits<Key>::append(mJournalBuffer, hash);
+			appendEntry(mJournalBuffer, entry);
+			mJournalCount++;
+
+			if (mJournalCount > std::max<size_t>(1024, 2 * mPolicy->count()))
+				compact();
+		}
+
+		inline Error flushJournal()
+		{
+			if (!mJournalBuffer.empty())
+			{
+				mJournal.write(mJournalBuffer.data(), mJournalBuffer.size());
+				mJournal.flush();
+				mJournalBuffer.clear();
+				if (mJournal.good() && (mSync == SyncPolicy::Full) && !util::sync_file(mJournalPath))
+					mJournal.setstate(std::ios::badbit);
+			}
+			return (mJournal.is_open() && mJournal.good()) ? Error::NoError : Error::CouldNotWriteIndexFile;
+		}
+
+		static const uint32_t IndexVersion = 3;
+		static const size_t IndexHeaderSize = 16;
+
+		static size_t entrySize(uint32_t version)
+		{
+			return (version == 1) ? 8 : (version == 2) ? 20 : 25;
+		}
+
+		static void appendEntry(std::string& out, const Entry& entry)
+		{
+			detail::append_uint(out, entry.size, 8);
+			detail::append_uint(out, entry.segment, 4);
+			detail::append_uint(out, entry.offset, 8);
+			detail::append_uint(out, entry.crc, 4);
+			detail::append_uint(out, entry.hasCrc ? 1 : 0, 1);
+		}
+
+		static Entry readEntry(const char* data, uint32_t version)
+		{
+			Entry entry(detail::read_uint(data, 8));
+			if (version >= 2)
+			{
+				entry.segment = static_cast<uint32_t>(detail::read_uint(data + 8, 4));
+				entry.offset = detail::read_uint(data + 12, 8);
+			}
+			if (version >= 3)
+			{
+				entry.crc = static_cast<uint32_t>(detail::read_uint(data + 20, 4));
+				entry.hasCrc = (data[24] & 1) != 0;
+			}
+			return entry;
+		}
+
+		// True for the versions that are read, the current and older ones with a header, of this hash size.
+		inline bool isKnownIndex(const std::vector<char>& data, uint32_t version) const
+		{
+			return (version >= 1) && (version <= IndexVersion) && (detail::read_uint(&data[12], 4) == mHashSize);
+		}
+
+		inline std::string indexHeader() const
+		{
+			std::string header("MYRMOIDX");
+			detail::append_uint(header, IndexVersion, 4);
+			detail::append_uint(header, mHashSize, 4);
+			return header;
+		}
+
+		// Returns the version of an index or journal file, 0 for files without a header.
+		inline uint32_t indexVersion(const std::vector<char>& data) const
+		{
+			if ((data.size() < IndexHeaderSize) || (memcmp(data.data(), "MYRMOIDX", 8) != 0))
+				return 0;
+			return static_cast<uint32_t>(detail::read_uint(&data[8], 4));
+		}
+
+		// Returns false if the snapshot is unreadable or truncated, in which case the index is recovered by a scan.
+		inline bool loadSnapshot(const std::vector<char>& data)
+		{
+			const uint32_t version = indexVersion(data);
+			if (version == 0)
+			{
+				mPolicy->setIndexData(data);
+				migrateEntries();
+				return data.size() % mHashSize == 0;
+			}
+
+			// An index of an unknown version or of another hash function is ignored.
+			if (!isKnownIndex(data, version))
+				return false;
+
+			const size_t recordSize = mHashSize + entrySize(version);
+			std::vector<char> indexData;
+			indexData.reserve((data.size() - IndexHeaderSize) / recordSize * mHashSize);
+			for (size_t offset = IndexHeaderSize; offset + recordSize <= data.size(); offset += recordSize)
+			{
+				const Key hash(KeyTraits<Key>::fromBytes(&data[offset], mHashSize));
+				mEntries[hash] = readEntry(&data[offset + mHashSize], version);
+				indexData.insert(indexData.end(), data.begin() + offset, data.begin() + offset + mHashSize);
+			}
+			mPolicy->setIndexData(indexData);
+			return (data.size() - IndexHeaderSize) % recordSize == 0;
+		}
+
+		// Reads the sizes of the files of a version 0 index. Entries whose file is gone are dropped.
+		inline void migrateEntries()
+		{
+			std::vector<Key> missing;
+			mPolicy->forEach([&](const Key& hash)
+			{
+				if (mEntries.find(hash) != mEntries.end())
+					return;
+				std::ifstream f(file_path(hash), std::ifstream::ate | std::ifstream::binary);
+				if (f.is_open())
+					mEntries[hash] = Entry(static_cast<uint64_t>(f.tellg()));
+				else
+					missing.push_back(hash);
+			});
+			for (const Key& hash : missing)
+				mPolicy->remove(hash);
+		}
+
+		inline void replayJournal(const std::vector<char>& data)
+		{
+			const uint32_t version = indexVersion(data);
+			if ((version != 0) && !isKnownIndex(data, version))
+				return;
+
+			const size_t headerSize = (version == 0) ? 0 : IndexHeaderSize;
+			const size_t recordSize = (version == 0) ? 1 + mHashSize : 1 + mHashSize + entrySize(version);
+			// A torn record at the end, from a crash during an append, is ignored.
+			for (size_t offset = headerSize; offset + recordSize <= data.size(); offset += recordSize)
+			{
+				const Key hash(KeyTraits<Key>::fromBytes(&data[offset + 1], mHashSize));
+				switch (static_cast<JournalRecord>(data[offset]))
+				{
+				case JournalRecord::Add:
+					if (mPolicy->exists(hash) == policy::Error::DoesNotExist)
+						mPolicy->add(hash);
+					if (version != 0)
+						mEntries[hash] = readEntry(&data[offset + 1 + mHashSize], version);
+					break;
+				case JournalRecord::Move:
+				{
+					const auto it = mEntries.find(hash);
+					if (it != mEntries.end())
+						it->second = readEntry(&data[offset + 1 + mHashSize], version);
+					break;
+				}
+				case JournalRecord::Touch:
+					mPolicy->exists(hash);
+					break;
+				case JournalRecord::Remove:
+					mPolicy->remove(hash);
+					mEntries.erase(hash);
+					break;
+				default:
+					assert(false); // Corrupt journal.
+					return;
+				}
+			}
+
+			if (version == 0)
+				migrateEntries();
+		}
+
+		// Writes a snapshot of the index and truncates the journal. After a crash between the two steps the old
+		// journal is replayed on top of the new snapshot, which at worst drops an entry whose file remains.
+		inline Error compact()
+		{
+			Error error = writeIndexFile();
+			if (error == Error::NoError)
+			{
+				mJournalBuffer.clear();
+				mJournalCount = 0;
+				if (mJournal.is_open())
+					mJournal.close();
+				mJournal.clear();
+				mJournal.open(mJournalPath, std::ios::binary | std::ios::trunc);
+				mJournalBuffer = indexHeader();
+				error = flushJournal();
+			}
+			return error;
+		}
+
+		// The snapshot replaces the old one by a rename, so a crash while writing it leaves the old one.
+		inline Error writeIndexFile() const
+		{
+			Error error = Error::CouldNotWriteIndexFile;
+
+			const std::string& fName(mIndexPath);
+			std::ofstream f(fName + ".tmp", std::ios::binary | std::ios::trunc);
+
+			if (f.is_open())
+			{
+				const std::string indexData = mPolicy->getIndexData();
+				std::string snapshot = indexHeader();
+				snapshot.reserve(snapshot.size() + indexData.size() + mEntries.size() * entrySize(IndexVersion));
+				for (size_t offset = 0; offset + mHashSize <= indexData.size(); offset += mHashSize)
+				{
+					const auto it = mEntries.find(KeyTraits<Key>::fromBytes(&indexData[offset], mHashSize));
+					assert(it != mEntries.end());
+					snapshot.append(indexData, offset, mHashSize);
+					appendEntry(snapshot, (it != mEntries.end()) ? it->second : Entry());
+				}
+				f.write(snapshot.data(), snapshot.size());
+				f.close();
+				if (f.good() && commitFile(fName + ".tmp", fName))
+					error = Error::NoError;
+				else
+					std::remove((fName + ".tmp").c_str());
+			}
+
+			return error;
+		}
+
+		inline Error evictUntilEnoughSpace(const size_t size)
+		{
+			Error error = Error::NoError;
+
+			if (size > mMaxCacheSize)
+			{
+				error = Error::FileSizeGreaterThanMaxCacheSize;
+			}
+			else
+			{
+				size_t errorCount = 0;
+				size_t pinnedCount = 0;
+				util::FileBatch unlinks(mRing.get());
+				while ((mCacheSize + mReservedSize + size) > mMaxCacheSize)
+				{
+					if (pinnedCount >= mPolicy->count())
+					{
+						error = Error::CouldNotClearSpaceForFile; // Everything left is pinned.
+						break;
+					}
+
+					const Key hash = mPolicy->back();
+					const auto it = mEntries.find(hash);
+					if ((it != mEntries.end()) && (it->second.pins > 0))
+					{
+						// Pinned items cannot be evicted. Touch it so the policy offers the next candidate.
+						mPolicy->exists(hash);
+						pinnedCount++;
+						continue;
+					}
+
+					pinnedCount = 0;
+					error = removeFile(hash, mRing ? &unlinks : nullptr); // Also calls mPolicy->remove(hash).
 					assert(error == Error::NoError); // The cache is corrupt if we end up removing files that do not exist.
 					if (error == Error::NoError)
 					{
@@ -288,18 +1756,171 @@ namespace myrmo { namespace cache
 						}
 					}
 				}
+
+				submitUnlinks(unlinks);
 			}
 
+			collectSegments();
 			return error;
 		}
 
+		// A file that cannot be unlinked has already left the index, so it is left behind without being counted.
+		void submitUnlinks(util::FileBatch& unlinks)
+		{
+			unlinks.submit();
+			for (size_t i = 0; i < unlinks.size(); i++)
+				assert((unlinks.result(i) == 0) || (unlinks.result(i) == -ENOENT));
+		}
+
+		// Writes the files of a batch together after its eviction pass, to temporary files that a second batch
+		// renames into place. Entries for segments are appended as by writeFile(). Items that already have an error
+		// are skipped. Does not flush the journal.
+		void writeFiles(const std::vector<WriteItem>& items, const std::vector<Key>& hashes, std::vector<Error>* errors)
+		{
+			const size_t none = static_cast<size_t>(-1);
+			std::vector<size_t> ops(items.size(), none);
+			util::FileBatch batch(mRing.get());
+			const bool sync = mSync != SyncPolicy::None;
+
+			for (size_t i = 0; i < items.size(); i++)
+			{
+				const Key& hash = hashes[i];
+				if ((*errors)[i] != Error::NoError)
+					continue;
+				if (items[i].size <= mSegmentOptions.maxEntrySize)
+					(*errors)[i] = writeFile(hash, items[i].data, items[i].size);
+				else if (!ensureDirectory(hash))
+					(*errors)[i] = Error::CouldNotWriteFile;
+				else
+					ops[i] = batch.write(file_path(hash) + ".tmp", items[i].data, items[i].size, false, sync);
+			}
+
+			batch.submit();
+			util::FileBatch renames(mRing.get());
+			for (size_t i = 0; i < items.size(); i++)
+			{
+				if (ops[i] == none)
+					continue;
+
+				const std::string fName(file_path(hashes[i]));
+				if (batch.result(ops[i]) == 0)
+				{
+					ops[i] = renames.rename(fName + ".tmp", fName); // Replaces a file without an entry, as commitFile() does.
+				}
+				else
+				{
+					std::remove((fName + ".tmp").c_str());
+					(*errors)[i] = Error::CouldNotWriteFile;
+					ops[i] = none;
+				}
+			}
+
+			renames.submit();
+			std::set<std::string> directories;
+			for (size_t i = 0; i < items.size(); i++)
+			{
+				if (ops[i] == none)
+					continue;
+
+				const int result = renames.result(ops[i]);
+				if (result == 0)
+				{
+					addEntry(hashes[i], Entry(items[i].size, hash::crc32(items[i].data, items[i].size)));
+					(*errors)[i] = Error::NoError;
+					if (mSync == SyncPolicy::Full)
+						directories.insert(file_path(hashes[i]).substr(0, file_path(hashes[i]).rfind('/')));
+				}
+				else
+				{
+					std::remove((file_path(hashes[i]) + ".tmp").c_str());
+					(*errors)[i] = Error::CouldNotWriteFile;
+				}
+			}
+
+			// One sync of a directory covers all renames into it.
+			for (const std::string& dir : directories)
+				util::sync_file(dir);
+		}
+
+		// Reads a batch of items into buffers with one submission. No view is involved, so nothing is pinned.
+		void readFiles(const std::vector<Key>& hashes, std::vector<std::vector<char>>* data, std::vector<Error>* errors)
+		{
+			const size_t none = static_cast<size_t>(-1);
+			std::vector<size_t> ops(hashes.size(), none);
+			util::FileBatch batch(mRing.get());
+
+			for (size_t i = 0; i < hashes.size(); i++)
+			{
+				std::vector<char>& buffer = (*data)[i];
+				buffer.clear();
+				if (mPolicy->exists(hashes[i]) != policy::Error::NoError)
+					continue;
+
+				const auto it = mEntries.find(hashes[i]);
+				assert(it != mEntries.end());
+				if (it == mEntries.end())
+					continue;
+
+				const Entry& entry = it->second;
+				buffer.resize(entry.size);
+				ops[i] = batch.read(entry.segment ? segment_path(entry.segment) : file_path(hashes[i]), entry.offset, entry.size, buffer.data());
+			}
+
+			batch.submit();
+			for (size_t i = 0; i < hashes.size(); i++)
+			{
+				if (ops[i] == none)
+					continue;
+
+				if (batch.result(ops[i]) == 0)
+				{
+					(*errors)[i] = verifyEntry(hashes[i], (*data)[i].data(), (*data)[i].size());
+					if ((*errors)[i] == Error::NoError)
+						journal(JournalRecord::Touch, hashes[i]);
+					else
+						(*data)[i].clear();
+				}
+				else
+				{
+					(*data)[i].clear();
+				}
+			}
+		}
+
 	private:
 		std::string  mCacheDir;
 		hashFunction mHashFunction;
-		std::unique_ptr<policy::EvictionPolicy> mPolicy;
+		batchHashFunction mBatchHashFunction;
+		const std::string mIndexPath; // Hashed once, as the hash function is only known at run time.
+		const std::string mJournalPath;
+		const std::string mLayoutPath;
+		std::unique_ptr<policy::BasicEvictionPolicy<Key>> mPolicy;
 
 		const size_t mMaxCacheSize;
 		size_t mCacheSize;
+		size_t mReservedSize; // Reserved by open writers.
+		size_t mHashSize;
+		std::unordered_map<Key, Entry, KeyHash<Key>> mEntries;
+		std::unordered_set<Key, KeyHash<Key>> mPending; // Items of open writers.
+
+		const SegmentOptions mSegmentOptions;
+		const DirectoryLayout mLayout;
+		const SyncPolicy mSync;
+		std::unordered_set<std::string> mDirectories; // Created by ensureDirectory().
+		std::map<uint32_t, Segment> mSegments;
+		std::set<uint32_t> mCollectableSegments;
+		std::ofstream mSegmentFile;
+		uint32_t mActiveSegment; // 0 if no segment is open for appending.
+		uint32_t mNextSegment;
+
+		std::unique_ptr<util::IoUring> mRing; // Only set for the IoUring backend.
+
+		std::ofstream mJournal;
+		std::string mJournalBuffer;
+		size_t mJournalCount;
+		uint64_t mGeneration;
 	};
 
+	typedef BasicDiskCache<std::string> DiskCache;
+
 }} // End namespace myrmo::cache
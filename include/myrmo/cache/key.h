@@ -0,0 +1,155 @@
+/* Copyright © 2019 Øystein Myrmo (oystein.myrmo@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <myrmo/util/hex.h>
+
+#include <string>
+#include <array>
+#include <functional>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+namespace myrmo { namespace cache
+{
+	// Describes how the caches and eviction policies store a key type:
+	// - size(key): Number of bytes the key takes in index data.
+	// - append(out, key): Appends the key's bytes to index data.
+	// - fromBytes(data, size): Reads a key back from index data.
+	// - hash(key): Hash for hash tables and frequency sketches.
+	// - toString(key): Printable form, used e.g. as file name.
+	// - fromString(string, key): Parses the printable form. Returns false if it is not one.
+	template<typename Key>
+	struct KeyTraits;
+
+	namespace detail
+	{
+		// Finalizer from splitmix64. Spreads the bits of keys that are not already uniformly distributed.
+		inline uint64_t mix64(uint64_t x)
+		{
+			x ^= x >> 30;
+			x *= 0xbf58476d1ce4e5b9ull;
+			x ^= x >> 27;
+			x *= 0x94d049bb133111ebull;
+			x ^= x >> 31;
+			return x;
+		}
+	}
+
+	// Hex string digests, as returned by myrmo::hash::sha1().
+	template<>
+	struct KeyTraits<std::string>
+	{
+		static size_t size(const std::string& key) { return key.size(); }
+		static void append(std::string& out, const std::string& key) { out.append(key); }
+		static std::string fromBytes(const char* data, size_t size) { return std::string(data, size); }
+		static size_t hash(const std::string& key) { return std::hash<std::string>()(key); }
+		static std::string toString(const std::string& key) { return key; }
+		static bool fromString(const std::string& str, std::string* key) { *key = str; return true; }
+	};
+
+	// Fixed width binary digests, stored inline.
+	template<size_t N>
+	struct KeyTraits<std::array<uint8_t, N>>
+	{
+		typedef std::array<uint8_t, N> Key;
+
+		static size_t size(const Key&) { return N; }
+		static void append(std::string& out, const Key& key) { out.append(reinterpret_cast<const char*>(key.data()), N); }
+
+		static Key fromBytes(const char* data, size_t size)
+		{
+			assert(size == N);
+			Key key;
+			memcpy(key.data(), data, (size < N) ? size : N);
+			return key;
+		}
+
+		static size_t hash(const Key& key)
+		{
+			uint64_t h = N;
+			size_t i = 0;
+			for (; i + 8 <= N; i += 8)
+			{
+				uint64_t word;
+				memcpy(&word, key.data() + i, 8);
+				h = detail::mix64(h ^ word);
+			}
+			for (; i < N; i++)
+				h = detail::mix64(h ^ key[i]);
+			return size_t(h);
+		}
+
+		static std::string toString(const Key& key) { return util::hex_encode(key.data(), N); }
+		static bool fromString(const std::string& str, Key* key) { return util::hex_decode(str, key->data(), N); }
+	};
+
+	// 64 bit hashes, stored inline.
+	template<>
+	struct KeyTraits<uint64_t>
+	{
+		static size_t size(const uint64_t&) { return sizeof(uint64_t); }
+
+		static void append(std::string& out, const uint64_t& key)
+		{
+			uint8_t bytes[8];
+			for (int i = 0; i < 8; i++)
+				bytes[i] = uint8_t(key >> (56 - 8 * i)); // Big endian, so the bytes read like toString().
+			out.append(reinterpret_cast<const char*>(bytes), 8);
+		}
+
+		static uint64_t fromBytes(const char* data, size_t size)
+		{
+			assert(size == sizeof(uint64_t));
+			uint64_t key = 0;
+			for (size_t i = 0; i < size; i++)
+				key = (key << 8) | uint8_t(data[i]);
+			return key;
+		}
+
+		static size_t hash(const uint64_t& key) { return size_t(detail::mix64(key)); }
+
+		static std::string toString(const uint64_t& key)
+		{
+			uint8_t bytes[8];
+			for (int i = 0; i < 8; i++)
+				bytes[i] = uint8_t(key >> (56 - 8 * i));
+			return util::hex_encode(bytes, 8);
+		}
+
+		static bool fromString(const std::string& str, uint64_t* key)
+		{
+			uint8_t bytes[8];
+			if (!util::hex_decode(str, bytes, 8))
+				return false;
+			*key = fromBytes(reinterpret_cast<const char*>(bytes), 8);
+			return true;
+		}
+	};
+
+	// Hash functor for standard containers keyed by a cache key.
+	template<typename Key>
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const { return KeyTraits<Key>::hash(key); }
+	};
+
+}} // End namespace myrmo::cache
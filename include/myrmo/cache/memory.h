@@ -20,19 +20,26 @@
  */
 #pragma once
 #include <myrmo/cache/policy.h>
+#include <myrmo/cache/arena.h>
+#include <myrmo/cache/batch.h>
 
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <algorithm>
 #include <memory>
+#include <atomic>
+#include <functional>
 
 namespace myrmo { namespace cache
 {
-	class MemoryCache
+	template<typename Key>
+	class BasicMemoryCache
 	{
 	public:
 		enum class Error : unsigned int
@@ -41,38 +48,157 @@ namespace myrmo { namespace cache
 			ItemDoesNotExist,
 			CouldNotRemoveItem,
 			SizeExceedsCacheSize,
-			ZeroSize
+			ZeroSize,
+			ItemExists
 		};
 
 		struct DataRef
 		{
+			DataRef(size_t position, size_t size) : position(position), size(size), pins(0) {}
+			DataRef(const DataRef& other) : position(other.position), size(other.size), pins(other.pins.load()) {}
+
 			size_t position;
 			size_t size;
+			std::atomic<size_t> pins;
 			size_t end() const { return position + size; }
 		};
 
-		typedef std::string (*hashFunction)(const std::string& uri);
+		// Read-only view of an item's bytes in the cache storage. The item is pinned while the handle is alive:
+		// it is never evicted or moved, and removing it only frees its storage once the last handle is released.
+		// Handles must be released before the cache is destroyed.
+		class Handle
+		{
+		public:
+			Handle() : mCache(nullptr), mData(nullptr), mSize(0), mPosition(0) {}
+			Handle(const Handle&) = delete;
+			Handle& operator=(const Handle&) = delete;
+
+			Handle(Handle&& other)
+				: mCache(other.mCache)
+				, mHash(std::move(other.mHash))
+				, mData(other.mData)
+				, mSize(other.mSize)
+				, mPosition(other.mPosition)
+			{
+				other.mCache = nullptr;
+			}
+
+			Handle& operator=(Handle&& other)
+			{
+				if (this != &other)
+				{
+					release();
+					mCache = other.mCache;
+					mHash = std::move(other.mHash);
+					mData = other.mData;
+					mSize = other.mSize;
+					mPosition = other.mPosition;
+					other.mCache = nullptr;
+				}
+				return *this;
+			}
+
+			~Handle()
+			{
+				release();
+			}
+
+			void release()
+			{
+				if (mCache)
+					mCache->unpin(mHash, mPosition);
+				mCache = nullptr;
+				mData = nullptr;
+				mSize = 0;
+			}
+
+			const char* data() const { return mData; }
+			size_t size() const { return mSize; }
+			const char* begin() const { return mData; }
+			const char* end() const { return mData + mSize; }
+			bool valid() const { return mCache != nullptr; }
+
+		private:
+			friend class BasicMemoryCache;
+			BasicMemoryCache* mCache;
+			Key mHash;
+			const char* mData;
+			size_t mSize;
+			size_t mPosition;
+		};
+
+		typedef Key (*hashFunction)(const std::string& uri);
 
-		MemoryCache() = delete;
-		MemoryCache(const MemoryCache& cache) = delete;
-		MemoryCache(MemoryCache&& cache) = delete;
-		~MemoryCache() {}
+		// Hashes count uris at once, e.g. hash::sha1_many(). Must give the same hashes as the hash function.
+		typedef void (*batchHashFunction)(const std::string* uris, size_t count, Key* hashes);
 
-		MemoryCache(hashFunction func, policy::EvictionPolicy* policy, size_t cacheSizeInMegaBytes = 10)
+		// Called with each item that is evicted to make room, while its bytes are still valid. Not called for
+		// removes and clear().
+		typedef std::function<void(const Key& hash, const char* data, size_t size)> evictionCallback;
+
+		// Size limit given in bytes, for caches that need a finer granularity than megabytes.
+		struct SizeInBytes
+		{
+			explicit SizeInBytes(size_t bytes) : bytes(bytes) {}
+			size_t bytes;
+		};
+
+		BasicMemoryCache() = delete;
+		BasicMemoryCache(const BasicMemoryCache& cache) = delete;
+		BasicMemoryCache(BasicMemoryCache&& cache) = delete;
+		~BasicMemoryCache()
+		{
+			freeUnpinnedDetached();
+			assert(mDetached.empty()); // Outstanding handles to removed items.
+			for (const auto& it : mDataRefs)
+				assert(it.second.pins == 0); // Outstanding handles.
+		}
+
+		BasicMemoryCache(hashFunction func, policy::BasicEvictionPolicy<Key>* policy, size_t cacheSizeInMegaBytes = 10)
+			: BasicMemoryCache(func, policy, SizeInBytes(cacheSizeInMegaBytes * 1048576))
+		{
+		}
+
+		BasicMemoryCache(hashFunction func, policy::BasicEvictionPolicy<Key>* policy, SizeInBytes cacheSize)
 			: mHashFunction(func)
+			, mBatchHashFunction(nullptr)
 			, mPolicy(policy)
-			, mMaxCacheSize(cacheSizeInMegaBytes * 1048576)
+			, mMaxCacheSize(cacheSize.bytes)
+			, mArena(mMaxCacheSize + mMaxCacheSize / 4) // Headroom so fragmentation rarely evicts more than the size limit requires.
+			, mSize(0)
 		{
-			const std::string hash(mHashFunction("myrmo_memory_cache"));
-			mPolicy->setHashSize(hash.size());
+			const Key hash(mHashFunction("myrmo_memory_cache"));
+			mPolicy->setHashSize(KeyTraits<Key>::size(hash));
 			assert(mMaxCacheSize > 0);
-			mData.reserve(mMaxCacheSize);
 		}
 
-		Error read(const std::string& uri, std::vector<char>* data)
+		Key hash(const std::string& uri) const
+		{
+			return mHashFunction(uri);
+		}
+
+		// Used to hash the uris of readMany() and writeMany(). By default they are hashed one by one.
+		void setBatchHashFunction(batchHashFunction func)
+		{
+			mBatchHashFunction = func;
+		}
+
+		void setEvictionCallback(evictionCallback callback)
+		{
+			mEvictionCallback = callback;
+		}
+
+		// Zero-copy read. On success the handle refers to the item's bytes and pins the item until released.
+		Error read(const std::string& uri, Handle* handle)
+		{
+			return readHash(mHashFunction(uri), handle);
+		}
+
+		// Same as read(), for callers that already have the hash of the uri.
+		Error readHash(const Key& hash, Handle* handle)
 		{
 			Error error = Error::ItemDoesNotExist;
-			const std::string hash(mHashFunction(uri));
+			handle->release();
 
 			if (mPolicy->exists(hash) == policy::Error::NoError)
 			{
@@ -80,15 +206,13 @@ namespace myrmo { namespace cache
 				assert(it != mDataRefs.end());
 				if (it != mDataRefs.end())
 				{
-					size_t start = it->second.position;
-					size_t end = it->second.end();
-					assert(end >= start);
-					assert((start < mData.size()) && (end <= mData.size()));
-
-					std::vector<char> out;
-					out.reserve(it->second.size);
-					out.insert(out.begin(), mData.begin() + start, mData.begin() + end);
-					data->swap(out);
+					assert(it->second.end() <= mArena.capacity());
+					it->second.pins++;
+					handle->mCache = this;
+					handle->mData = mArena.data() + it->second.position;
+					handle->mSize = it->second.size;
+					handle->mPosition = it->second.position;
+					handle->mHash = hash;
 					error = Error::NoError;
 				}
 			}
@@ -96,28 +220,102 @@ namespace myrmo { namespace cache
 			return error;
 		}
 
+		Error read(const std::string& uri, std::vector<char>* data)
+		{
+			Handle handle;
+			Error error = read(uri, &handle);
+			if (error == Error::NoError)
+			{
+				std::vector<char> out(handle.begin(), handle.end());
+				data->swap(out);
+			}
+			return error;
+		}
+
+		// Reads a batch of items. Each handle is set as by read(), and the returned errors are per item.
+		std::vector<Error> readMany(const std::vector<std::string>& uris, std::vector<Handle>* handles)
+		{
+			std::vector<Error> errors(uris.size(), Error::ItemDoesNotExist);
+			const std::vector<Key> hashes(detail::hash_many(mHashFunction, mBatchHashFunction, uris.data(), uris.size()));
+			handles->resize(uris.size());
+			for (size_t i = 0; i < uris.size(); i++)
+				errors[i] = readHash(hashes[i], &(*handles)[i]);
+			return errors;
+		}
+
+		std::vector<Error> readMany(const std::vector<std::string>& uris, std::vector<std::vector<char>>* data)
+		{
+			std::vector<Handle> handles;
+			std::vector<Error> errors = readMany(uris, &handles);
+			data->resize(uris.size());
+			for (size_t i = 0; i < uris.size(); i++)
+			{
+				if (errors[i] == Error::NoError)
+					(*data)[i].assign(handles[i].begin(), handles[i].end());
+				else
+					(*data)[i].clear();
+			}
+			return errors;
+		}
+
 		Error write(const std::string& uri, const char* data, size_t size)
+		{
+			return writeHash(mHashFunction(uri), data, size);
+		}
+
+		// Same as write(), for callers that already have the hash of the uri.
+		Error writeHash(const Key& hash, const char* data, size_t size)
 		{
 			assert(size > 0);
 			if (size == 0)
 				return Error::ZeroSize;
 
-			Error error = Error::NoError;
+			if (mDataRefs.find(hash) != mDataRefs.end())
+				return Error::ItemExists;
 
-			const std::string hash(mHashFunction(uri));
-			assert(mPolicy->exists(hash) == policy::Error::DoesNotExist);
+			freeUnpinnedDetached();
+			return insertItem(hash, data, size);
+		}
 
-			error = evictUntilEnoughSpace(size);
-			if (error == Error::NoError)
+		// Writes a batch of items with one eviction pass for the whole batch. The returned errors are per item,
+		// as returned by write(). Items of a batch that exceeds the cache size may evict earlier items of the batch.
+		std::vector<Error> writeMany(const std::vector<WriteItem>& items)
+		{
+			std::vector<Error> errors(items.size(), Error::NoError);
+			const std::vector<Key> hashes(detail::hash_many(mHashFunction, mBatchHashFunction, items));
+			std::unordered_set<Key, KeyHash<Key>> batch;
+
+			size_t batchSize = 0;
+			size_t largest = 0;
+			for (size_t i = 0; i < items.size(); i++)
 			{
-				assert((mData.size() + size) <= mMaxCacheSize);
-				size_t position = mData.size();
-				mData.insert(mData.end(), data, data + size);
-				mDataRefs.insert({hash, { position, size }});
-				mPolicy->add(hash);
+				if (items[i].size == 0)
+					errors[i] = Error::ZeroSize;
+				else if ((mDataRefs.find(hashes[i]) != mDataRefs.end()) || !batch.insert(hashes[i]).second)
+					errors[i] = Error::ItemExists;
+				else if (items[i].size > mMaxCacheSize)
+					errors[i] = Error::SizeExceedsCacheSize;
+				else
+				{
+					batchSize += items[i].size;
+					largest = std::max(largest, items[i].size);
+				}
 			}
 
-			return error;
+			freeUnpinnedDetached();
+
+			// Make room for the whole batch at once. If that fails, e.g. because of pinned items, each item
+			// still gets its own eviction pass below.
+			if ((batchSize > 0) && (batchSize <= mMaxCacheSize))
+				evictUntilEnoughSpace(batchSize, largest);
+
+			for (size_t i = 0; i < items.size(); i++)
+			{
+				if (errors[i] == Error::NoError)
+					errors[i] = insertItem(hashes[i], items[i].data, items[i].size);
+			}
+
+			return errors;
 		}
 
 		Error write(const std::string& uri, const std::string& data)
@@ -132,8 +330,19 @@ namespace myrmo { namespace cache
 
 		Error clear()
 		{
-			mData.clear();
-			mDataRefs.clear();
+			freeUnpinnedDetached();
+			if (mDetached.empty() && std::none_of(mDataRefs.begin(), mDataRefs.end(), [](const std::pair<const Key, DataRef>& it) { return it.second.pins > 0; }))
+			{
+				mArena.clear();
+				mDataRefs.clear();
+			}
+			else
+			{
+				while (!mDataRefs.empty())
+					removeItem(mDataRefs.begin()->first);
+			}
+
+			mSize = 0;
 			mPolicy->clear();
 			assert(mPolicy->count() == 0);
 			assert(size() == 0);
@@ -141,10 +350,15 @@ namespace myrmo { namespace cache
 		}
 
 		inline Error remove(const std::string& uri)
+		{
+			return removeHash(mHashFunction(uri));
+		}
+
+		// Same as remove(), for callers that already have the hash of the uri.
+		Error removeHash(const Key& hash)
 		{
 			Error error = Error::NoError;
-			const std::string hash(mHashFunction(uri));
-			assert(mPolicy->exists(hash) == policy::Error::NoError);
+			freeUnpinnedDetached();
 			policy::Error pError = mPolicy->remove(hash);
 
 			if (pError == policy::Error::NoError)
@@ -157,7 +371,7 @@ namespace myrmo { namespace cache
 
 		size_t size() const
 		{
-			return mData.size();
+			return mSize;
 		}
 
 		size_t count() const
@@ -165,64 +379,164 @@ namespace myrmo { namespace cache
 			return mPolicy->count();
 		}
 
+		// True if the item is in the cache. Unlike a read, this does not count as a use.
+		bool containsHash(const Key& hash) const
+		{
+			return mDataRefs.find(hash) != mDataRefs.end();
+		}
+
+		// Evicts items in the order of the eviction policy until at least bytes are freed or only pinned items are
+		// left, and returns the number of bytes freed. For caches that share a size limit with others, see
+		// ShardedMemoryCache.
+		size_t evict(size_t bytes)
+		{
+			freeUnpinnedDetached();
+			const size_t before = mSize;
+			while ((before - mSize) < bytes)
+			{
+				if (evictNext() != Error::NoError)
+					break;
+			}
+			return before - mSize;
+		}
+
+		// True if read(), readHash() and releasing handles may run concurrently on several threads, as long as
+		// no other member function runs at the same time. This depends on the eviction policy.
+		bool concurrentReads() const
+		{
+			return mPolicy->concurrentExists();
+		}
+
 	private:
-		inline Error removeItem(const std::string& hash)
+		inline Error insertItem(const Key& hash, const char* data, size_t size)
+		{
+			Error error = evictUntilEnoughSpace(size, size);
+			if (error == Error::NoError)
+			{
+				assert((mSize + size) <= mMaxCacheSize);
+				const size_t position = mArena.allocate(size);
+				assert(position != Arena::npos);
+				memcpy(mArena.data() + position, data, size);
+				mSize += size;
+				mDataRefs.insert({ hash, DataRef(position, size) });
+				mPolicy->add(hash);
+			}
+			return error;
+		}
+
+		inline Error removeItem(const Key& hash)
 		{
 			Error error = Error::ItemDoesNotExist;
 			const auto it = mDataRefs.find(hash);
 			assert(it != mDataRefs.end());
 			if (it != mDataRefs.end())
 			{
-				DataRef removed = it->second;
-				mData.erase(mData.begin() + removed.position, mData.begin() + removed.end());
+				// Freeing the range leaves all other items in place. Pinned items keep their range until unpinned.
+				if (it->second.pins > 0)
+					mDetached.insert({ it->second.position, it->second });
+				else
+					mArena.free(it->second.position, it->second.size);
+				mSize -= it->second.size;
 				mDataRefs.erase(it);
-				for (auto& it : mDataRefs) // TODO: Consider changing data structure(s) because of this iteration.
-				{
-					if (it.second.position > removed.position)
-						it.second.position -= removed.size;
-				}
 				error = Error::NoError;
 			}
 			return error;
 		}
 
-		inline Error evictUntilEnoughSpace(const size_t size)
+		// Only decrements the pin count, so that concurrent readers can release handles. The storage of removed
+		// items is freed by the next write, remove or clear.
+		void unpin(const Key& hash, size_t position)
 		{
-			Error error = Error::NoError;
+			const auto it = mDataRefs.find(hash);
+			if ((it != mDataRefs.end()) && (it->second.position == position))
+			{
+				assert(it->second.pins > 0);
+				it->second.pins--;
+				return;
+			}
 
-			if (size > mMaxCacheSize)
+			// The item was removed while pinned.
+			const auto detached = mDetached.find(position);
+			assert(detached != mDetached.end());
+			if (detached != mDetached.end())
 			{
-				error = Error::SizeExceedsCacheSize;
+				assert(detached->second.pins > 0);
+				detached->second.pins--;
 			}
-			else
+		}
+
+		void freeUnpinnedDetached()
+		{
+			for (auto it = mDetached.begin(); it != mDetached.end();)
 			{
-				while ((error == Error::NoError) && (mData.size() + size) > mMaxCacheSize)
+				if (it->second.pins == 0)
+				{
+					mArena.free(it->second.position, it->second.size);
+					it = mDetached.erase(it);
+				}
+				else
 				{
-					const std::string hash = mPolicy->back();
-					error = removeItem(hash);
-					assert(error == Error::NoError);
-					if (error == Error::NoError)
-					{
-						policy::Error pError = mPolicy->remove(hash);
-						assert(pError == policy::Error::NoError);
-						if (pError != policy::Error::NoError)
-						{
-							error = Error::CouldNotRemoveItem;
-						}
-					}
+					++it;
 				}
 			}
+		}
+
+		// Evicts until size more bytes fit within the size limit and the arena has a contiguous range of largest bytes.
+		inline Error evictUntilEnoughSpace(const size_t size, const size_t largest)
+		{
+			if (size > mMaxCacheSize)
+				return Error::SizeExceedsCacheSize;
 
+			// The arena may be fragmented, so keep evicting until there is a contiguous range for the item too.
+			Error error = Error::NoError;
+			while ((error == Error::NoError) && (((mSize + size) > mMaxCacheSize) || !mArena.canAllocate(largest)))
+				error = evictNext();
 			return error;
 		}
 
+		// Evicts the next unpinned item the policy offers.
+		inline Error evictNext()
+		{
+			for (size_t pinnedCount = 0; pinnedCount < mPolicy->count(); pinnedCount++)
+			{
+				const Key hash = mPolicy->back();
+				const auto it = mDataRefs.find(hash);
+				if ((it != mDataRefs.end()) && (it->second.pins > 0))
+				{
+					// Pinned items cannot be evicted. Touch it so the policy offers the next candidate.
+					mPolicy->exists(hash);
+					continue;
+				}
+
+				if (mEvictionCallback && (it != mDataRefs.end()))
+					mEvictionCallback(hash, mArena.data() + it->second.position, it->second.size);
+				Error error = removeItem(hash);
+				assert(error == Error::NoError);
+				if (error == Error::NoError)
+				{
+					policy::Error pError = mPolicy->remove(hash);
+					assert(pError == policy::Error::NoError);
+					if (pError != policy::Error::NoError)
+						error = Error::CouldNotRemoveItem;
+				}
+				return error;
+			}
+			return Error::CouldNotRemoveItem; // Everything left is pinned.
+		}
+
 	private:
 		hashFunction mHashFunction;
-		std::unique_ptr<policy::EvictionPolicy> mPolicy;
+		batchHashFunction mBatchHashFunction;
+		std::unique_ptr<policy::BasicEvictionPolicy<Key>> mPolicy;
 
 		const size_t mMaxCacheSize;
-		std::vector<char> mData;
-		std::unordered_map<std::string, DataRef> mDataRefs;
+		Arena mArena;
+		size_t mSize;
+		std::unordered_map<Key, DataRef, KeyHash<Key>> mDataRefs;
+		std::unordered_map<size_t, DataRef> mDetached; // Removed items that are still pinned, by position.
+		evictionCallback mEvictionCallback;
 	};
 
+	typedef BasicMemoryCache<std::string> MemoryCache;
+
 }} // End namespace myrmo::cache
@@ -1,12 +1,17 @@
 #pragma once
+#include <myrmo/cache/key.h>
+
 #include <string>
 #include <vector>
 #include <list>
 #include <set>
+#include <unordered_map>
 #include <cstdint>
 #include <algorithm>
 #include <cassert>
 #include <functional>
+#include <iterator>
+#include <atomic>
 
 namespace myrmo { namespace cache { namespace policy
 {
@@ -19,30 +24,36 @@ namespace myrmo { namespace cache { namespace policy
 		ErroneousHashSize
 	};
 
-	struct EvictionPolicy
+	template<typename Key>
+	struct BasicEvictionPolicy
 	{
-		virtual ~EvictionPolicy() {};
+		virtual ~BasicEvictionPolicy() {};
 
 		virtual Error setHashSize(const size_t hashSize) = 0;
 		virtual Error setIndexData(const std::vector<char>& indexData) = 0;
-		virtual Error exists(const std::string& hash) = 0;
-		virtual Error add(const std::string& hash) = 0;
-		virtual Error remove(const std::string& hash) = 0;
+		virtual Error exists(const Key& hash) = 0;
+		virtual Error add(const Key& hash) = 0;
+		virtual Error remove(const Key& hash) = 0;
 		virtual std::string getIndexData() const = 0;
-		virtual const std::string& back() const = 0;
-		virtual const std::string& front() const = 0;
-		virtual void forEach(std::function<void(const std::string&hash)> callback) = 0;
+		virtual const Key& back() const = 0;
+		virtual const Key& front() const = 0;
+		virtual void forEach(std::function<void(const Key& hash)> callback) = 0;
 		virtual void clear() = 0;
 		virtual size_t count() const = 0;
+
+		// True if exists() may run concurrently on several threads, as long as no other member function runs
+		// at the same time. Caches use this to serve hits under a shared lock.
+		virtual bool concurrentExists() const { return false; }
 	};
 
-	class LRU : public EvictionPolicy
+	template<typename Key>
+	class BasicLRU : public BasicEvictionPolicy<Key>
 	{
 	public:
-		LRU(){}
-		~LRU() override {}
-		LRU(const LRU&) = delete;
-		LRU(LRU&&) = delete;
+		BasicLRU(){}
+		~BasicLRU() override {}
+		BasicLRU(const BasicLRU&) = delete;
+		BasicLRU(BasicLRU&&) = delete;
 
 		Error setHashSize(const size_t hashSize) override
 		{
@@ -53,18 +64,25 @@ namespace myrmo { namespace cache { namespace policy
 		Error setIndexData(const std::vector<char>& indexData) override
 		{
 			Error error = Error::NoError;
-			mData.clear();
+			clear();
 			assert((indexData.size() % mHashSize) == 0);
 			for (size_t i = 0; i < indexData.size(); i += mHashSize)
-				mData.insert(mData.end(), std::string(&indexData[i], mHashSize));
+			{
+				mData.insert(mData.end(), KeyTraits<Key>::fromBytes(&indexData[i], mHashSize));
+				if (!mIndex.insert({ mData.back(), std::prev(mData.end()) }).second)
+				{
+					mData.pop_back(); // Duplicate hash in index data, keep the most recent one.
+					error = Error::DataCorrupted;
+				}
+			}
 			return error;
 		}
 
-		Error exists(const std::string& hash) override
+		Error exists(const Key& hash) override
 		{
 			Error error = Error::NoError;
 
-			if (hash.size() != mHashSize)
+			if (KeyTraits<Key>::size(hash) != mHashSize)
 			{
 				error = Error::ErroneousHashSize;
 				assert(false);
@@ -72,34 +90,39 @@ namespace myrmo { namespace cache { namespace policy
 
 			if (error == Error::NoError)
 			{
-				error = Error::DoesNotExist;
-				for (auto it = mData.begin(); it != mData.end(); it++)
-				{
-					if (*it == hash)
-					{
-						// Move hash to front.
-						mData.splice(mData.begin(), mData, it);
-						error = Error::NoError;
-						break;
-					}
-				}
+				const auto it = mIndex.find(hash);
+				if (it != mIndex.end())
+					mData.splice(mData.begin(), mData, it->second); // Move hash to front.
+				else
+					error = Error::DoesNotExist;
 			}
 
 			return error;
 		}
 
-		Error add(const std::string& hash) override
+		Error add(const Key& hash) override
 		{
 			Error error = Error::NoError;
-			assert(exists(hash) == Error::DoesNotExist);
-			assert(hash.size() == mHashSize);
+			assert(KeyTraits<Key>::size(hash) == mHashSize);
 			mData.insert(mData.begin(), hash);
+			if (!mIndex.insert({ mData.front(), mData.begin() }).second)
+			{
+				mData.pop_front();
+				error = Error::AlreadyExists;
+				assert(false);
+			}
 			return error;
 		}
 
-		Error remove(const std::string& hash) override
+		Error remove(const Key& hash) override
 		{
-			mData.remove(hash);
+			const auto it = mIndex.find(hash);
+			if (it == mIndex.end())
+				return Error::DoesNotExist;
+
+			const auto listIt = it->second;
+			mIndex.erase(it); // Erase the index entry first, its key refers to the list node.
+			mData.erase(listIt);
 			return Error::NoError;
 		}
 
@@ -108,21 +131,21 @@ namespace myrmo { namespace cache { namespace policy
 			std::string indexData;
 			indexData.reserve(mData.size() * mHashSize);
 			for (auto it = mData.begin(); it != mData.end(); it++)
-				indexData.insert(indexData.size(), *it);
+				KeyTraits<Key>::append(indexData, *it);
 			return indexData;
 		}
 
-		const std::string& back() const override
+		const Key& back() const override
 		{
 			return mData.back();
 		}
 
-		const std::string& front() const override
+		const Key& front() const override
 		{
 			return mData.front();
 		}
 
-		void forEach(std::function<void(const std::string&hash)> callback) override
+		void forEach(std::function<void(const Key& hash)> callback) override
 		{
 			for (const auto& hash : mData)
 				callback(hash);
@@ -130,6 +153,7 @@ namespace myrmo { namespace cache { namespace policy
 
 		void clear() override
 		{
+			mIndex.clear();
 			mData.clear();
 		}
 
@@ -139,8 +163,595 @@ namespace myrmo { namespace cache { namespace policy
 		}
 
 	private:
-		std::list<std::string> mData;
+		// The index keys refer to the strings stored in the list nodes, so each hash is only stored once.
+		typedef std::list<Key> List;
+		typedef std::reference_wrapper<const Key> HashRef;
+		typedef std::unordered_map<HashRef, typename List::iterator, KeyHash<Key>, std::equal_to<Key>> Index;
+
+		List mData;
+		Index mIndex;
+		size_t mHashSize;
+	};
+
+	// CLOCK (second chance) approximation of LRU. Hashes sit in a circular buffer of slots and a hit only sets the
+	// slot's reference bit, so exists() is a read-only index lookup plus an atomic store and is safe to call from
+	// concurrent readers. back() advances the clock hand past referenced slots, clearing their bits, and returns
+	// the first unreferenced hash, which is the eviction candidate.
+	template<typename Key>
+	class BasicCLOCK : public BasicEvictionPolicy<Key>
+	{
+	public:
+		BasicCLOCK() : mHand(0), mCount(0), mHashSize(0), mEmpty() {}
+		~BasicCLOCK() override {}
+		BasicCLOCK(const BasicCLOCK&) = delete;
+		BasicCLOCK(BasicCLOCK&&) = delete;
+
+		Error setHashSize(const size_t hashSize) override
+		{
+			mHashSize = hashSize;
+			return Error::NoError;
+		}
+
+		// The index data is ordered like LRU's, from the hash evicted last to the hash evicted first.
+		Error setIndexData(const std::vector<char>& indexData) override
+		{
+			Error error = Error::NoError;
+			clear();
+			assert((indexData.size() % mHashSize) == 0);
+
+			// Find duplicate hashes first and keep the most recent one, the first in the data, like LRU does.
+			std::vector<bool> duplicate(indexData.size() / mHashSize, false);
+			for (size_t i = 0; i < indexData.size(); i += mHashSize)
+			{
+				if (!mIndex.emplace(KeyTraits<Key>::fromBytes(&indexData[i], mHashSize), 0).second)
+				{
+					duplicate[i / mHashSize] = true;
+					error = Error::DataCorrupted;
+				}
+			}
+			mIndex.clear();
+
+			for (size_t i = indexData.size(); i >= mHashSize; i -= mHashSize)
+			{
+				if (!duplicate[(i - mHashSize) / mHashSize])
+					add(KeyTraits<Key>::fromBytes(&indexData[i - mHashSize], mHashSize));
+			}
+			return error;
+		}
+
+		Error exists(const Key& hash) override
+		{
+			Error error = Error::NoError;
+
+			if (KeyTraits<Key>::size(hash) != mHashSize)
+			{
+				error = Error::ErroneousHashSize;
+				assert(false);
+			}
+
+			if (error == Error::NoError)
+			{
+				const auto it = mIndex.find(hash);
+				if (it != mIndex.end())
+					mSlots[it->second].referenced.store(true, std::memory_order_relaxed);
+				else
+					error = Error::DoesNotExist;
+			}
+
+			return error;
+		}
+
+		Error add(const Key& hash) override
+		{
+			assert(KeyTraits<Key>::size(hash) == mHashSize);
+			if (mIndex.find(hash) != mIndex.end())
+			{
+				assert(false);
+				return Error::AlreadyExists;
+			}
+
+			// Reuse the most recently freed slot, usually the one just evicted at the hand. A new hash at the
+			// hand is moved behind it by advancing the hand, so it is the last one the hand reaches.
+			size_t slot;
+			if (mFreeSlots.empty())
+			{
+				slot = mSlots.size();
+				mSlots.emplace_back();
+			}
+			else
+			{
+				slot = mFreeSlots.back();
+				mFreeSlots.pop_back();
+				if (slot == mHand)
+					mHand = (mHand + 1) % mSlots.size();
+			}
+
+			mSlots[slot].hash = hash;
+			mSlots[slot].used = true;
+			mSlots[slot].referenced.store(false, std::memory_order_relaxed);
+			mIndex.insert({ hash, slot });
+			mCount++;
+			return Error::NoError;
+		}
+
+		Error remove(const Key& hash) override
+		{
+			const auto it = mIndex.find(hash);
+			if (it == mIndex.end())
+				return Error::DoesNotExist;
+
+			Slot& slot = mSlots[it->second];
+			slot.used = false;
+			slot.hash = Key();
+			mFreeSlots.push_back(it->second);
+			mIndex.erase(it);
+			mCount--;
+
+			if (mCount == 0)
+				clear(); // Drop the free slots.
+			return Error::NoError;
+		}
+
+		std::string getIndexData() const override
+		{
+			std::string indexData;
+			indexData.reserve(mCount * mHashSize);
+			forEachInOrder([&](const Key& hash) { KeyTraits<Key>::append(indexData, hash); });
+			return indexData;
+		}
+
+		const Key& back() const override
+		{
+			if (mCount == 0)
+				return mEmpty;
+
+			// Give referenced hashes a second chance. Terminates within two rounds, as every pass clears a bit.
+			while (true)
+			{
+				Slot& slot = mSlots[mHand];
+				if (slot.used && !slot.referenced.exchange(false, std::memory_order_relaxed))
+					return slot.hash;
+				mHand = (mHand + 1) % mSlots.size();
+			}
+		}
+
+		const Key& front() const override
+		{
+			if (mCount == 0)
+				return mEmpty;
+
+			for (size_t i = 1; i <= mSlots.size(); i++)
+			{
+				const Slot& slot = mSlots[(mHand + mSlots.size() - i) % mSlots.size()];
+				if (slot.used)
+					return slot.hash;
+			}
+			assert(false);
+			return mEmpty;
+		}
+
+		void forEach(std::function<void(const Key& hash)> callback) override
+		{
+			forEachInOrder(callback);
+		}
+
+		void clear() override
+		{
+			mSlots.clear();
+			mFreeSlots.clear();
+			mIndex.clear();
+			mHand = 0;
+			mCount = 0;
+		}
+
+		size_t count() const override
+		{
+			return mCount;
+		}
+
+		bool concurrentExists() const override
+		{
+			return true;
+		}
+
+	private:
+		struct Slot
+		{
+			Slot() : referenced(false), used(false) {}
+			Slot(const Slot& other) : hash(other.hash), referenced(other.referenced.load()), used(other.used) {}
+			Slot& operator=(const Slot& other)
+			{
+				hash = other.hash;
+				referenced.store(other.referenced.load());
+				used = other.used;
+				return *this;
+			}
+
+			Key hash;
+			std::atomic<bool> referenced;
+			bool used;
+		};
+
+		// Visits the hashes from the one the hand reaches last to the one it reaches first.
+		template<typename Callback>
+		void forEachInOrder(Callback callback) const
+		{
+			for (size_t i = 1; i <= mSlots.size(); i++)
+			{
+				const Slot& slot = mSlots[(mHand + mSlots.size() - i) % mSlots.size()];
+				if (slot.used)
+					callback(slot.hash);
+			}
+		}
+
+	private:
+		mutable std::vector<Slot> mSlots; // Mutable for the reference bits and the hand, which back() advances.
+		mutable size_t mHand;
+		std::vector<size_t> mFreeSlots;
+		std::unordered_map<Key, size_t, KeyHash<Key>> mIndex;
+		size_t mCount;
+		size_t mHashSize;
+		const Key mEmpty;
+	};
+
+	// Count-min sketch of 4 bit counters, used to estimate how often a hash has been seen. All counters are halved
+	// after a sample of 10 * width additions, so old popularity fades out.
+	class FrequencySketch
+	{
+	public:
+		explicit FrequencySketch(size_t width = 1024)
+			: mWidth(0)
+			, mAdditions(0)
+		{
+			resize(width);
+		}
+
+		// Resizes to at least the given width, rounded up to a power of two. The counters keep their history: as
+		// both widths are powers of two, a hash's column in the new table only maps to its column in the old one,
+		// so every new counter takes the largest of the old counters that map to it.
+		void resize(size_t width)
+		{
+			size_t newWidth = 16;
+			while (newWidth < width)
+				newWidth <<= 1;
+
+			std::vector<uint64_t> table((Depth * newWidth) / CountersPerWord, 0);
+			if (mWidth > 0)
+			{
+				for (size_t row = 0; row < Depth; row++)
+				{
+					for (size_t column = 0; column < std::max(mWidth, newWidth); column++)
+					{
+						const uint64_t count = counterAt(row * mWidth + (column & (mWidth - 1)));
+						const size_t index = row * newWidth + (column & (newWidth - 1));
+						const unsigned int shift = (index % CountersPerWord) * 4;
+						uint64_t& word = table[index / CountersPerWord];
+						if (count > ((word >> shift) & 0xf))
+							word = (word & ~(uint64_t(0xf) << shift)) | (count << shift);
+					}
+				}
+			}
+
+			mTable.swap(table);
+			mWidth = newWidth;
+			mSampleSize = 10 * mWidth;
+		}
+
+		template<typename Key>
+		void increment(const Key& hash)
+		{
+			const size_t h = KeyTraits<Key>::hash(hash);
+			bool added = false;
+			for (size_t row = 0; row < Depth; row++)
+				added |= incrementAt(counterIndex(h, row));
+
+			if (added && (++mAdditions >= mSampleSize))
+				age();
+		}
+
+		template<typename Key>
+		unsigned int frequency(const Key& hash) const
+		{
+			const size_t h = KeyTraits<Key>::hash(hash);
+			unsigned int frequency = MaxCount;
+			for (size_t row = 0; row < Depth; row++)
+				frequency = std::min(frequency, counterAt(counterIndex(h, row)));
+			return frequency;
+		}
+
+		void clear()
+		{
+			std::fill(mTable.begin(), mTable.end(), 0);
+			mAdditions = 0;
+		}
+
+		size_t width() const
+		{
+			return mWidth;
+		}
+
+	private:
+		static constexpr size_t Depth = 4;
+		static constexpr size_t CountersPerWord = 16;
+		static constexpr unsigned int MaxCount = 15;
+
+		inline size_t counterIndex(size_t h, size_t row) const
+		{
+			static const uint64_t seeds[Depth] = { 0x9e3779b97f4a7c15ull, 0xc2b2ae3d27d4eb4full, 0x165667b19e3779f9ull, 0xd6e8feb86659fd93ull };
+			uint64_t x = (uint64_t(h) + row) * seeds[row];
+			x ^= x >> 32;
+			return row * mWidth + (size_t(x) & (mWidth - 1));
+		}
+
+		inline unsigned int counterAt(size_t index) const
+		{
+			return unsigned(mTable[index / CountersPerWord] >> ((index % CountersPerWord) * 4)) & 0xf;
+		}
+
+		inline bool incrementAt(size_t index)
+		{
+			const unsigned int shift = (index % CountersPerWord) * 4;
+			uint64_t& word = mTable[index / CountersPerWord];
+			if (((word >> shift) & 0xf) == MaxCount)
+				return false;
+			word += uint64_t(1) << shift;
+			return true;
+		}
+
+		void age()
+		{
+			for (auto& word : mTable)
+				word = (word >> 1) & 0x7777777777777777ull;
+			mAdditions /= 2;
+		}
+
+	private:
+		std::vector<uint64_t> mTable;
+		size_t mWidth;
+		size_t mAdditions;
+		size_t mSampleSize;
+	};
+
+	// W-TinyLFU: new hashes enter a small LRU admission window, and the rest of the cache is a segmented LRU with a
+	// probation and a protected segment. The eviction candidate from the window competes with the probation
+	// victim, and the one with the lowest estimated frequency is evicted, so one-off scans are evicted from the
+	// window without flushing the frequently used hashes. Frequencies are estimated by a FrequencySketch that is
+	// updated on every lookup and insertion, including misses.
+	template<typename Key>
+	class BasicWTinyLFU : public BasicEvictionPolicy<Key>
+	{
+	public:
+		// The window holds about windowPercent % of the hashes and the protected segment up to protectedPercent %
+		// of the rest. The sketch grows with the number of hashes, expectedCount only sets its initial size.
+		BasicWTinyLFU(size_t expectedCount = 1024, unsigned int windowPercent = 1, unsigned int protectedPercent = 80)
+			: mSketch(expectedCount)
+			, mWindowPercent(windowPercent)
+			, mProtectedPercent(protectedPercent)
+			, mHashSize(0)
+			, mEmpty()
+		{
+			assert((windowPercent > 0) && (windowPercent < 100));
+			assert(protectedPercent < 100);
+		}
+
+		~BasicWTinyLFU() override {}
+		BasicWTinyLFU(const BasicWTinyLFU&) = delete;
+		BasicWTinyLFU(BasicWTinyLFU&&) = delete;
+
+		Error setHashSize(const size_t hashSize) override
+		{
+			mHashSize = hashSize;
+			return Error::NoError;
+		}
+
+		// Restored hashes have no access history, so they are all put on probation in the stored order.
+		Error setIndexData(const std::vector<char>& indexData) override
+		{
+			Error error = Error::NoError;
+			clear();
+			assert((indexData.size() % mHashSize) == 0);
+			for (size_t i = 0; i < indexData.size(); i += mHashSize)
+			{
+				List& probation = mSegments[Probation];
+				probation.insert(probation.end(), KeyTraits<Key>::fromBytes(&indexData[i], mHashSize));
+				if (!mIndex.insert({ probation.back(), { std::prev(probation.end()), Probation } }).second)
+				{
+					probation.pop_back();
+					error = Error::DataCorrupted;
+				}
+			}
+			growSketch();
+			return error;
+		}
+
+		Error exists(const Key& hash) override
+		{
+			if (KeyTraits<Key>::size(hash) != mHashSize)
+			{
+				assert(false);
+				return Error::ErroneousHashSize;
+			}
+
+			mSketch.increment(hash);
+
+			const auto it = mIndex.find(hash);
+			if (it == mIndex.end())
+				return Error::DoesNotExist;
+
+			Entry& entry = it->second;
+			if (entry.segment == Probation)
+			{
+				// A second hit on probation promotes the hash to the protected segment.
+				moveTo(entry, Protected);
+				demoteProtectedOverflow();
+			}
+			else
+			{
+				List& list = mSegments[entry.segment];
+				list.splice(list.begin(), list, entry.position);
+			}
+
+			return Error::NoError;
+		}
+
+		Error add(const Key& hash) override
+		{
+			assert(KeyTraits<Key>::size(hash) == mHashSize);
+			List& window = mSegments[Window];
+			window.insert(window.begin(), hash);
+			if (!mIndex.insert({ window.front(), { window.begin(), Window } }).second)
+			{
+				window.pop_front();
+				assert(false);
+				return Error::AlreadyExists;
+			}
+
+			mSketch.increment(hash);
+			growSketch();
+
+			// Hashes that fall out of the window go on probation, where they compete for their place.
+			while (window.size() > windowTarget())
+				moveTo(mIndex.find(window.back())->second, Probation);
+
+			return Error::NoError;
+		}
+
+		Error remove(const Key& hash) override
+		{
+			const auto it = mIndex.find(hash);
+			if (it == mIndex.end())
+				return Error::DoesNotExist;
+
+			const Entry entry = it->second;
+			mIndex.erase(it); // Erase the index entry first, its key refers to the list node.
+			mSegments[entry.segment].erase(entry.position);
+			return Error::NoError;
+		}
+
+		// Stored from the hash evicted last to the hash evicted first: protected, window, then probation.
+		std::string getIndexData() const override
+		{
+			std::string indexData;
+			indexData.reserve(count() * mHashSize);
+			for (Segment segment : { Protected, Window, Probation })
+			{
+				for (const auto& hash : mSegments[segment])
+					KeyTraits<Key>::append(indexData, hash);
+			}
+			return indexData;
+		}
+
+		const Key& back() const override
+		{
+			const List& window = mSegments[Window];
+			const List& main = mSegments[Probation].empty() ? mSegments[Protected] : mSegments[Probation];
+
+			if (main.empty())
+				return window.empty() ? mEmpty : window.back();
+			if (window.empty())
+				return main.back();
+
+			// The window candidate is only admitted if it is used more often than the main victim.
+			const Key& candidate = window.back();
+			const Key& victim = main.back();
+			return (mSketch.frequency(candidate) > mSketch.frequency(victim)) ? victim : candidate;
+		}
+
+		const Key& front() const override
+		{
+			for (Segment segment : { Protected, Window, Probation })
+			{
+				if (!mSegments[segment].empty())
+					return mSegments[segment].front();
+			}
+			return mEmpty;
+		}
+
+		void forEach(std::function<void(const Key& hash)> callback) override
+		{
+			for (Segment segment : { Protected, Window, Probation })
+			{
+				for (const auto& hash : mSegments[segment])
+					callback(hash);
+			}
+		}
+
+		void clear() override
+		{
+			mIndex.clear();
+			for (auto& segment : mSegments)
+				segment.clear();
+			mSketch.clear();
+		}
+
+		size_t count() const override
+		{
+			return mIndex.size();
+		}
+
+		unsigned int frequency(const Key& hash) const
+		{
+			return mSketch.frequency(hash);
+		}
+
+	private:
+		enum Segment { Window = 0, Probation = 1, Protected = 2, SegmentCount = 3 };
+
+		typedef std::list<Key> List;
+		typedef std::reference_wrapper<const Key> HashRef;
+
+		struct Entry
+		{
+			typename List::iterator position;
+			Segment segment;
+		};
+
+		typedef std::unordered_map<HashRef, Entry, KeyHash<Key>, std::equal_to<Key>> Index;
+
+		inline size_t windowTarget() const
+		{
+			return std::max<size_t>(1, (count() * mWindowPercent) / 100);
+		}
+
+		inline size_t protectedTarget() const
+		{
+			return ((count() - mSegments[Window].size()) * mProtectedPercent) / 100;
+		}
+
+		// Moves the hash to the front of the segment. The list node is spliced, so the index key stays valid.
+		void moveTo(Entry& entry, Segment segment)
+		{
+			List& to = mSegments[segment];
+			to.splice(to.begin(), mSegments[entry.segment], entry.position);
+			entry.segment = segment;
+		}
+
+		void demoteProtectedOverflow()
+		{
+			List& protectedList = mSegments[Protected];
+			while (protectedList.size() > protectedTarget())
+				moveTo(mIndex.find(protectedList.back())->second, Probation);
+		}
+
+		void growSketch()
+		{
+			if (count() > mSketch.width())
+				mSketch.resize(2 * count());
+		}
+
+	private:
+		List mSegments[SegmentCount];
+		Index mIndex;
+		FrequencySketch mSketch;
+		const unsigned int mWindowPercent;
+		const unsigned int mProtectedPercent;
 		size_t mHashSize;
+		const Key mEmpty;
 	};
 
+	typedef BasicEvictionPolicy<std::string> EvictionPolicy;
+	typedef BasicLRU<std::string> LRU;
+	typedef BasicCLOCK<std::string> CLOCK;
+	typedef BasicWTinyLFU<std::string> WTinyLFU;
+
 }}} // End namespace myrmo::cache::policy
@@ -0,0 +1,342 @@
+/* Copyright © 2019 Øystein Myrmo (oystein.myrmo@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <myrmo/cache/memory.h>
+#include <myrmo/util/shared_mutex.h>
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
+
+namespace myrmo { namespace cache
+{
+	// Thread-safe memory cache. Items are spread over independent shards by the hash of their uri, and every shard
+	// has its own lock, eviction policy and storage, so threads only contend when they use the same shard. With a
+	// policy that supports concurrent lookups, such as policy::CLOCK, reads only take the shard lock in shared mode.
+	// The size limit is global: shards charge a shared byte count, so a busy shard can grow past its even share
+	// while others are idle. A write that goes over the limit evicts from its own shard while that holds at least
+	// its even share, and otherwise from other shards whose lock is free. Each shard holds at most twice its even
+	// share, which bounds the storage of all shards to a small multiple of the limit and is the largest item size.
+	template<typename Key>
+	class BasicShardedMemoryCache
+	{
+	public:
+		typedef BasicMemoryCache<Key> Cache;
+		typedef typename Cache::Error Error;
+		typedef typename Cache::hashFunction hashFunction;
+		typedef std::function<policy::BasicEvictionPolicy<Key>*()> policyFactory;
+
+		// Pinned read-only view of an item, see MemoryCache::Handle. Releasing the handle locks the item's shard.
+		class Handle
+		{
+		public:
+			Handle() : mMutex(nullptr), mShared(false) {}
+			Handle(const Handle&) = delete;
+			Handle& operator=(const Handle&) = delete;
+
+			Handle(Handle&& other)
+				: mMutex(other.mMutex)
+				, mShared(other.mShared)
+				, mHandle(std::move(other.mHandle))
+			{
+				other.mMutex = nullptr;
+			}
+
+			Handle& operator=(Handle&& other)
+			{
+				if (this != &other)
+				{
+					release();
+					mMutex = other.mMutex;
+					mShared = other.mShared;
+					mHandle = std::move(other.mHandle);
+					other.mMutex = nullptr;
+				}
+				return *this;
+			}
+
+			~Handle()
+			{
+				release();
+			}
+
+			void release()
+			{
+				if (mMutex)
+				{
+					util::SharedMutexLock lock(*mMutex, mShared);
+					mHandle.release();
+				}
+				mMutex = nullptr;
+			}
+
+			const char* data() const { return mHandle.data(); }
+			size_t size() const { return mHandle.size(); }
+			const char* begin() const { return mHandle.begin(); }
+			const char* end() const { return mHandle.end(); }
+			bool valid() const { return mHandle.valid(); }
+
+		private:
+			friend class BasicShardedMemoryCache;
+			util::SharedMutex* mMutex;
+			bool mShared;
+			typename Cache::Handle mHandle;
+		};
+
+		BasicShardedMemoryCache() = delete;
+		BasicShardedMemoryCache(const BasicShardedMemoryCache&) = delete;
+		BasicShardedMemoryCache(BasicShardedMemoryCache&&) = delete;
+
+		BasicShardedMemoryCache(hashFunction func, policyFactory factory, size_t cacheSizeInMegaBytes = 10, size_t shardCount = 16)
+			: mHashFunction(func)
+			, mMaxCacheSize(cacheSizeInMegaBytes * 1048576)
+			, mMaxShardSize(std::min(mMaxCacheSize, 2 * (mMaxCacheSize / std::max<size_t>(shardCount, 1))))
+			, mSize(0)
+			, mNextVictim(0)
+		{
+			assert(shardCount > 0);
+			const typename Cache::SizeInBytes shardSize(mMaxShardSize);
+			for (size_t i = 0; i < shardCount; i++)
+			{
+				std::unique_ptr<Shard> shard(new Shard);
+				shard->cache.reset(new Cache(func, factory(), shardSize));
+				shard->concurrentReads = shard->cache->concurrentReads();
+				mShards.push_back(std::move(shard));
+			}
+		}
+
+		Error read(const std::string& uri, Handle* handle)
+		{
+			handle->release(); // Before locking, the handle may belong to the same shard.
+
+			const Key hash(mHashFunction(uri));
+			Shard& s = shard(hash);
+			util::SharedMutexLock lock(s.mutex, s.concurrentReads);
+			Error error = s.cache->readHash(hash, &handle->mHandle);
+			if (error == Error::NoError)
+			{
+				handle->mMutex = &s.mutex;
+				handle->mShared = s.concurrentReads;
+			}
+			return error;
+		}
+
+		Error read(const std::string& uri, std::vector<char>* data)
+		{
+			const Key hash(mHashFunction(uri));
+			Shard& s = shard(hash);
+			util::SharedMutexLock lock(s.mutex, s.concurrentReads);
+
+			typename Cache::Handle handle;
+			Error error = s.cache->readHash(hash, &handle);
+			if (error == Error::NoError)
+			{
+				std::vector<char> out(handle.begin(), handle.end());
+				data->swap(out);
+			}
+			return error;
+		}
+
+		Error write(const std::string& uri, const char* data, size_t size)
+		{
+			if (size > mMaxShardSize)
+				return Error::SizeExceedsCacheSize;
+
+			const Key hash(mHashFunction(uri));
+			Shard& s = shard(hash);
+			std::lock_guard<util::SharedMutex> lock(s.mutex);
+			if (s.cache->containsHash(hash))
+				return Error::ItemExists;
+
+			// Reserve the bytes first, so that concurrent writers to other shards see them when making room.
+			mSize += size;
+			Error error = makeRoom(s);
+			const size_t before = s.cache->size();
+			if (error == Error::NoError)
+				error = s.cache->writeHash(hash, data, size);
+			mSize -= size;
+			charge(before, s.cache->size());
+			return error;
+		}
+
+		Error write(const std::string& uri, const std::string& data)
+		{
+			return write(uri, data.c_str(), data.size());
+		}
+
+		Error write(const std::string& uri, const std::vector<char>& data)
+		{
+			return write(uri, data.data(), data.size());
+		}
+
+		Error remove(const std::string& uri)
+		{
+			const Key hash(mHashFunction(uri));
+			Shard& s = shard(hash);
+			std::lock_guard<util::SharedMutex> lock(s.mutex);
+			const size_t before = s.cache->size();
+			Error error = s.cache->removeHash(hash);
+			charge(before, s.cache->size());
+			return error;
+		}
+
+		Error clear()
+		{
+			Error error = Error::NoError;
+			for (auto& s : mShards)
+			{
+				std::lock_guard<util::SharedMutex> lock(s->mutex);
+				const size_t before = s->cache->size();
+				Error shardError = s->cache->clear();
+				charge(before, s->cache->size());
+				if (shardError != Error::NoError)
+					error = shardError;
+			}
+			return error;
+		}
+
+		size_t size() const
+		{
+			size_t size = 0;
+			for (const auto& s : mShards)
+			{
+				util::SharedMutexLock lock(s->mutex, true);
+				size += s->cache->size();
+			}
+			return size;
+		}
+
+		size_t count() const
+		{
+			size_t count = 0;
+			for (const auto& s : mShards)
+			{
+				util::SharedMutexLock lock(s->mutex, true);
+				count += s->cache->count();
+			}
+			return count;
+		}
+
+		size_t maxSize() const
+		{
+			return mMaxCacheSize;
+		}
+
+		// Largest item that fits, the size limit of a single shard.
+		size_t maxItemSize() const
+		{
+			return mMaxShardSize;
+		}
+
+		size_t shardCount() const
+		{
+			return mShards.size();
+		}
+
+	private:
+		struct Shard
+		{
+			mutable util::SharedMutex mutex;
+			std::unique_ptr<Cache> cache;
+			bool concurrentReads;
+		};
+
+		// Applies a change of a shard's size to the global count.
+		inline void charge(size_t before, size_t after)
+		{
+			if (after >= before)
+				mSize += after - before;
+			else
+				mSize -= before - after;
+		}
+
+		// Evicts until the shards fit the size limit, including what the caller reserved for its write. The caller
+		// holds the lock of its own shard, which gives up items first while it holds at least its even share of the
+		// limit. Other shards are only locked if no other writer holds them, so writers never wait for each other.
+		// Fails if a round over all shards frees nothing.
+		Error makeRoom(Shard& own)
+		{
+			const size_t share = mMaxCacheSize / mShards.size();
+			size_t idle = 0; // Shards tried in a row that freed nothing.
+			while (true)
+			{
+				const size_t total = mSize.load();
+				if (total <= mMaxCacheSize)
+					return Error::NoError;
+				const size_t excess = total - mMaxCacheSize;
+
+				size_t freed = 0;
+				if (own.cache->size() >= share)
+					freed = evict(own, excess);
+
+				if (freed == 0)
+				{
+					Shard& victim = *mShards[mNextVictim++ % mShards.size()];
+					if ((&victim != &own) && victim.mutex.try_lock())
+					{
+						freed = evict(victim, excess);
+						victim.mutex.unlock();
+					}
+				}
+
+				if ((freed == 0) && (++idle >= mShards.size()))
+				{
+					// The other shards are empty, pinned or busy. Take from the own shard regardless of its share.
+					freed = evict(own, excess);
+					if (freed == 0)
+						return Error::CouldNotRemoveItem;
+				}
+				if (freed > 0)
+					idle = 0;
+			}
+		}
+
+		inline size_t evict(Shard& s, size_t bytes)
+		{
+			const size_t freed = s.cache->evict(bytes);
+			mSize -= freed;
+			return freed;
+		}
+
+		// Remixes the key hash, so the shard index does not correlate with the buckets of the shard's hash table.
+		inline Shard& shard(const Key& hash)
+		{
+			const uint64_t h = detail::mix64(KeyTraits<Key>::hash(hash));
+			return *mShards[size_t(h >> 32) % mShards.size()];
+		}
+
+	private:
+		hashFunction mHashFunction;
+		const size_t mMaxCacheSize;
+		const size_t mMaxShardSize;
+		std::atomic<size_t> mSize; // Of all shards, plus the bytes reserved by writes in progress.
+		std::atomic<size_t> mNextVictim;
+		std::vector<std::unique_ptr<Shard>> mShards;
+	};
+
+	typedef BasicShardedMemoryCache<std::string> ShardedMemoryCache;
+
+}} // End namespace myrmo::cache
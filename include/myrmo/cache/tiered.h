@@ -0,0 +1,430 @@
+/* Copyright © 2019 Øystein Myrmo (oystein.myrmo@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <myrmo/cache/memory.h>
+#include <myrmo/cache/disk.h>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace myrmo { namespace cache
+{
+	// Memory cache in front of a disk cache. Both tiers use the same hash function, and every uri is hashed once.
+	//
+	// - Inclusive mode: writes go to memory and are queued for the disk, so the disk holds every item. Disk hits
+	//   are promoted into memory and stay on the disk.
+	// - Exclusive mode: writes go to memory only. Items the memory tier evicts are queued for the disk (demoted),
+	//   and disk hits are moved into memory, so every item is in one tier only.
+	//
+	// Queued disk writes are done by a background thread and bounded by maxQueuedBytes. Reads serve items that
+	// are still queued from the queued data. Items too large for the memory tier are written to the disk directly.
+	// Apart from the background writer, the cache is not thread-safe, like the tiers themselves.
+	template<typename Key>
+	class BasicTieredCache
+	{
+	public:
+		typedef BasicMemoryCache<Key> MemoryTier;
+		typedef BasicDiskCache<Key> DiskTier;
+
+		enum class Error : unsigned int
+		{
+			NoError,
+			ItemDoesNotExist,
+			ItemExists,
+			ZeroSize,
+			SizeExceedsCacheSize,
+			CouldNotWriteItem,
+			CouldNotRemoveItem
+		};
+
+		enum class Mode
+		{
+			Inclusive,
+			Exclusive
+		};
+
+		// Lookups in one tier. The disk tier is only looked up on memory misses, and its time includes reading
+		// the item. Queued items count as disk hits.
+		struct TierStats
+		{
+			TierStats() : hits(0), misses(0), nanoseconds(0) {}
+			uint64_t hits;
+			uint64_t misses;
+			uint64_t nanoseconds;
+		};
+
+		struct Stats
+		{
+			Stats() : promotions(0), demotions(0) {}
+			TierStats memory;
+			TierStats disk;
+			uint64_t promotions; // Disk hits copied or moved into memory.
+			uint64_t demotions;  // Items written to the disk by the background writer.
+		};
+
+		BasicTieredCache() = delete;
+		BasicTieredCache(const BasicTieredCache&) = delete;
+
+		// Takes ownership of both tiers.
+		BasicTieredCache(MemoryTier* memory, DiskTier* disk, Mode mode = Mode::Inclusive, size_t maxQueuedBytes = 64 * 1048576)
+			: mMemory(memory)
+			, mDisk(disk)
+			, mMode(mode)
+			, mMaxQueuedBytes(maxQueuedBytes)
+			, mQueuedBytes(0)
+			, mBusy(false)
+			, mStopping(false)
+			, mDemotions(0)
+		{
+			assert(mMemory->hash("myrmo_tiered_cache") == mDisk->hash("myrmo_tiered_cache")); // Same hash function.
+			if (mMode == Mode::Exclusive)
+			{
+				mMemory->setEvictionCallback([this](const Key& hash, const char* data, size_t size)
+				{
+					enqueue(hash, data, size);
+				});
+			}
+			mWriter = std::thread(&BasicTieredCache::work, this);
+		}
+
+		~BasicTieredCache()
+		{
+			flush();
+			{
+				std::lock_guard<std::mutex> lock(mQueueMutex);
+				mStopping = true;
+			}
+			mWorkAvailable.notify_all();
+			mWriter.join();
+			mMemory->setEvictionCallback(nullptr);
+		}
+
+		Error read(const std::string& uri, std::vector<char>* data)
+		{
+			const Key hash(mMemory->hash(uri));
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			{
+				typename MemoryTier::Handle handle;
+				const bool hit = mMemory->readHash(hash, &handle) == MemoryTier::Error::NoError;
+				if (hit)
+					data->assign(handle.begin(), handle.end());
+				count(mStats.memory, hit, start);
+				if (hit)
+					return Error::NoError;
+			}
+
+			start = std::chrono::steady_clock::now();
+			bool hit = false;
+			const std::shared_ptr<const std::vector<char>> queued = findQueued(hash);
+			if (queued)
+			{
+				data->assign(queued->begin(), queued->end());
+				hit = true;
+			}
+			else
+			{
+				std::lock_guard<std::mutex> lock(mDiskMutex);
+				hit = mDisk->readHash(hash, data) == DiskTier::Error::NoError;
+			}
+			count(mStats.disk, hit, start);
+
+			if (!hit)
+				return Error::ItemDoesNotExist;
+
+			promote(hash, *data);
+			return Error::NoError;
+		}
+
+		Error write(const std::string& uri, const char* data, size_t size)
+		{
+			if (size == 0)
+				return Error::ZeroSize;
+
+			const Key hash(mMemory->hash(uri));
+			if (findQueued(hash))
+				return Error::ItemExists;
+			{
+				std::lock_guard<std::mutex> lock(mDiskMutex);
+				if (mDisk->containsHash(hash))
+					return Error::ItemExists;
+			}
+
+			const typename MemoryTier::Error error = mMemory->writeHash(hash, data, size);
+			if (error == MemoryTier::Error::NoError)
+			{
+				if (mMode == Mode::Inclusive)
+					enqueue(hash, data, size);
+				return Error::NoError;
+			}
+			if (error == MemoryTier::Error::ItemExists)
+				return Error::ItemExists;
+
+			// Too large for memory, or everything in memory is pinned.
+			std::lock_guard<std::mutex> lock(mDiskMutex);
+			switch (mDisk->writeHash(hash, data, size))
+			{
+			case DiskTier::Error::NoError:
+				return Error::NoError;
+			case DiskTier::Error::FileSizeGreaterThanMaxCacheSize:
+				return Error::SizeExceedsCacheSize;
+			default:
+				return Error::CouldNotWriteItem;
+			}
+		}
+
+		Error write(const std::string& uri, const std::string& data)
+		{
+			return write(uri, data.c_str(), data.size());
+		}
+
+		Error write(const std::string& uri, const std::vector<char>& data)
+		{
+			return write(uri, data.data(), data.size());
+		}
+
+		Error remove(const std::string& uri)
+		{
+			const Key hash(mMemory->hash(uri));
+			bool removed = mMemory->removeHash(hash) == MemoryTier::Error::NoError;
+			removed = cancel(hash) || removed;
+
+			// Taking the disk lock waits for a write of the item that the background writer may have started.
+			std::lock_guard<std::mutex> lock(mDiskMutex);
+			if (mDisk->containsHash(hash))
+			{
+				if (mDisk->removeHash(hash) != DiskTier::Error::NoError)
+					return Error::CouldNotRemoveItem;
+				removed = true;
+			}
+
+			return removed ? Error::NoError : Error::ItemDoesNotExist;
+		}
+
+		Error clear()
+		{
+			mMemory->clear();
+			{
+				std::lock_guard<std::mutex> lock(mQueueMutex);
+				mQueue.clear();
+				mQueued.clear();
+				mQueuedBytes = 0;
+			}
+			mSpaceAvailable.notify_all();
+
+			std::lock_guard<std::mutex> lock(mDiskMutex);
+			return (mDisk->clear() == DiskTier::Error::NoError) ? Error::NoError : Error::CouldNotRemoveItem;
+		}
+
+		// Waits until all queued disk writes are done.
+		void flush()
+		{
+			std::unique_lock<std::mutex> lock(mQueueMutex);
+			mSpaceAvailable.wait(lock, [this] { return mQueued.empty() && !mBusy; });
+		}
+
+		Stats stats() const
+		{
+			Stats stats(mStats);
+			stats.demotions = mDemotions;
+			return stats;
+		}
+
+		void resetStats()
+		{
+			mStats = Stats();
+			mDemotions = 0;
+		}
+
+		Mode mode() const
+		{
+			return mMode;
+		}
+
+		size_t memorySize() const
+		{
+			return mMemory->size();
+		}
+
+		size_t memoryCount() const
+		{
+			return mMemory->count();
+		}
+
+		size_t diskSize()
+		{
+			std::lock_guard<std::mutex> lock(mDiskMutex);
+			return mDisk->size();
+		}
+
+		size_t diskCount()
+		{
+			std::lock_guard<std::mutex> lock(mDiskMutex);
+			return mDisk->count();
+		}
+
+		size_t queuedBytes() const
+		{
+			std::lock_guard<std::mutex> lock(mQueueMutex);
+			return mQueuedBytes;
+		}
+
+	private:
+		static void count(TierStats& stats, bool hit, std::chrono::steady_clock::time_point start)
+		{
+			stats.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+			if (hit)
+				stats.hits++;
+			else
+				stats.misses++;
+		}
+
+		// Items that do not fit in memory, e.g. because everything there is pinned, stay on the disk.
+		void promote(const Key& hash, const std::vector<char>& data)
+		{
+			if (mMemory->writeHash(hash, data.data(), data.size()) != MemoryTier::Error::NoError)
+				return;
+
+			mStats.promotions++;
+			if (mMode == Mode::Exclusive)
+			{
+				cancel(hash);
+				std::lock_guard<std::mutex> lock(mDiskMutex);
+				if (mDisk->containsHash(hash))
+					mDisk->removeHash(hash);
+			}
+		}
+
+		// Blocks while the queue is full. Must not be called with the disk lock held, as the writer needs it to
+		// make progress.
+		void enqueue(const Key& hash, const char* data, size_t size)
+		{
+			std::unique_lock<std::mutex> lock(mQueueMutex);
+			mSpaceAvailable.wait(lock, [&] { return (mQueuedBytes == 0) || (mQueuedBytes + size <= mMaxQueuedBytes); });
+			if (mQueued.find(hash) != mQueued.end())
+				return;
+
+			mQueued[hash] = std::make_shared<const std::vector<char>>(data, data + size);
+			mQueue.push_back(hash);
+			mQueuedBytes += size;
+			mWorkAvailable.notify_one();
+		}
+
+		std::shared_ptr<const std::vector<char>> findQueued(const Key& hash) const
+		{
+			std::lock_guard<std::mutex> lock(mQueueMutex);
+			const auto it = mQueued.find(hash);
+			return (it != mQueued.end()) ? it->second : nullptr;
+		}
+
+		// Drops a queued write. The hash stays in mQueue, and the writer skips it.
+		bool cancel(const Key& hash)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mQueueMutex);
+				const auto it = mQueued.find(hash);
+				if (it == mQueued.end())
+					return false;
+				mQueuedBytes -= it->second->size();
+				mQueued.erase(it);
+			}
+			mSpaceAvailable.notify_all();
+			return true;
+		}
+
+		void work()
+		{
+			for (;;)
+			{
+				{
+					std::unique_lock<std::mutex> lock(mQueueMutex);
+					mWorkAvailable.wait(lock, [this] { return mStopping || !mQueue.empty(); });
+					if (mQueue.empty())
+						return;
+				}
+
+				// The disk lock is held from taking an item until it is written, so that a remove or promotion
+				// that cancels the item and then takes the disk lock finds the item on the disk if it was written.
+				std::lock_guard<std::mutex> diskLock(mDiskMutex);
+				Key hash;
+				std::shared_ptr<const std::vector<char>> data;
+				{
+					std::lock_guard<std::mutex> lock(mQueueMutex);
+					if (mQueue.empty())
+						continue;
+					hash = mQueue.front();
+					mQueue.pop_front();
+					const auto it = mQueued.find(hash);
+					if (it == mQueued.end())
+						continue; // Cancelled.
+					data = it->second;
+					mBusy = true;
+				}
+
+				if (!mDisk->containsHash(hash) && (mDisk->writeHash(hash, data->data(), data->size()) == DiskTier::Error::NoError))
+					mDemotions++;
+
+				{
+					std::lock_guard<std::mutex> lock(mQueueMutex);
+					const auto it = mQueued.find(hash);
+					if ((it != mQueued.end()) && (it->second == data))
+					{
+						mQueuedBytes -= data->size();
+						mQueued.erase(it);
+					}
+					mBusy = false;
+				}
+				mSpaceAvailable.notify_all();
+			}
+		}
+
+		std::unique_ptr<MemoryTier> mMemory;
+		std::unique_ptr<DiskTier> mDisk;
+		const Mode mMode;
+		std::mutex mDiskMutex;
+
+		mutable std::mutex mQueueMutex;
+		std::condition_variable mWorkAvailable;
+		std::condition_variable mSpaceAvailable; // Also signalled when the writer finishes an item.
+		std::deque<Key> mQueue;
+		std::unordered_map<Key, std::shared_ptr<const std::vector<char>>, KeyHash<Key>> mQueued;
+		const size_t mMaxQueuedBytes;
+		size_t mQueuedBytes;
+		bool mBusy;
+		bool mStopping;
+		std::thread mWriter;
+
+		Stats mStats;
+		std::atomic<uint64_t> mDemotions;
+	};
+
+	typedef BasicTieredCache<std::string> TieredCache;
+
+}} // End namespace myrmo::cache
@@ -19,9 +19,15 @@
  * SOFTWARE.
  */
 #pragma once
+#include <myrmo/util/cpu.h>
+
 #include <string>
 #include <cstdint>
 
+#ifdef MYRMO_HAS_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
 namespace myrmo { namespace hash
 {
 	// Ref. https://github.com/Michaelangel007/crc32
@@ -82,13 +88,163 @@ namespace myrmo { namespace hash
 		0x4400, 0x84c1, 0x8581, 0x4540, 0x8701, 0x47c0, 0x4680, 0x8641, 0x8201, 0x42c0, 0x4380, 0x8341, 0x4100, 0x81c1, 0x8081, 0x4040
 	};
 
+	namespace detail
+	{
+		// Tables for slicing-by-N, generated at compile time from crc_table_32. Entry i of slice k is the CRC of
+		// byte i followed by k zero bytes, so one lookup per byte of an N-byte block advances the CRC over the
+		// whole block at once. Slice 0 is crc_table_32.
+		constexpr uint32_t crc32_zero_byte(uint32_t crc)
+		{
+			return (crc >> 8) ^ crc_table_32[crc & 0xff];
+		}
+
+		struct crc32_slice { uint32_t values[256]; };
+		struct crc32_slices { crc32_slice slices[16]; };
+
+		constexpr crc32_slices make_crc32_slices()
+		{
+			crc32_slices tables = {};
+			for (size_t i = 0; i < 256; i++)
+			{
+				uint32_t crc = crc_table_32[i];
+				tables.slices[0].values[i] = crc;
+				for (size_t slice = 1; slice < 16; slice++)
+				{
+					crc = crc32_zero_byte(crc);
+					tables.slices[slice].values[i] = crc;
+				}
+			}
+			return tables;
+		}
+
+		static constexpr crc32_slices crc_slices_32 = make_crc32_slices();
+
+		inline uint32_t load_le32(const unsigned char* p)
+		{
+			return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+		}
+
+		// The kernels take and return the inverted CRC register.
+		inline uint32_t crc32_bytewise(const unsigned char* data, size_t size, uint32_t crc)
+		{
+			for (size_t i = 0; i < size; ++i)
+				crc = crc_table_32[(data[i] ^ crc) & 0xff] ^ (crc >> 8);
+			return crc;
+		}
+
+		// Slicing-by-N for N = 4, 8 or 16: N table lookups per N bytes, independent of each other, instead of N
+		// dependent lookups. The tail is done byte by byte.
+		template<size_t N>
+		inline uint32_t crc32_sliced(const unsigned char* data, size_t size, uint32_t crc)
+		{
+			static_assert((N == 4) || (N == 8) || (N == 16), "Slicing by 4, 8 or 16 bytes");
+			const crc32_slice* t = crc_slices_32.slices;
+			for (; size >= N; size -= N, data += N)
+			{
+				uint32_t next = 0;
+				for (size_t word = 0; word < N / 4; word++)
+				{
+					const uint32_t value = load_le32(data + 4 * word) ^ (word ? 0 : crc);
+					const size_t slice = N - 1 - 4 * word;
+					next ^= t[slice].values[value & 0xff] ^ t[slice - 1].values[(value >> 8) & 0xff]
+						^ t[slice - 2].values[(value >> 16) & 0xff] ^ t[slice - 3].values[value >> 24];
+				}
+				crc = next;
+			}
+			return crc32_bytewise(data, size, crc);
+		}
+
+#ifdef MYRMO_HAS_X86_DISPATCH
+		// Folds the data into the CRC with carry-less multiplication, 64 bytes per iteration in four independent
+		// lanes, and reduces the result with a Barrett reduction. The size must be a multiple of 16 and at least
+		// 64. Ref. Gopal et al., "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction", Intel
+		// 2009, and the bit-reflected constants for the CRC32 polynomial given there.
+		__attribute__((target("pclmul,sse4.1")))
+		inline uint32_t crc32_clmul(const unsigned char* data, size_t size, uint32_t crc)
+		{
+			const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+			const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+			const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163cd6124);
+			const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+			const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+			__m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00));
+			__m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10));
+			__m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20));
+			__m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30));
+			x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+			data += 64;
+			size -= 64;
+
+			for (; size >= 64; data += 64, size -= 64)
+			{
+				const __m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+				const __m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+				const __m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+				const __m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+				x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+				x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+				x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+				x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+				x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00)));
+				x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10)));
+				x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20)));
+				x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30)));
+			}
+
+			// Fold the four lanes into one, then the remaining 16-byte blocks.
+			const __m128i lanes[] = { x2, x3, x4 };
+			for (const __m128i& lane : lanes)
+			{
+				const __m128i x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+				x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), lane), x5);
+			}
+			for (; size >= 16; data += 16, size -= 16)
+			{
+				const __m128i x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+				x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data))), x5);
+			}
+
+			// Fold 128 bits to 64.
+			x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+			x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+			x2 = _mm_srli_si128(x1, 4);
+			x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k5k0, 0x00), x2);
+
+			// Barrett reduction to 32 bits.
+			x2 = _mm_and_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x10), mask32);
+			x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+			x1 = _mm_xor_si128(x1, x2);
+			return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+		}
+#endif
+	}
+
 	// Verify at e.g. https://cse.unl.edu/~ssamal/crypto/genhash.php
+	// Continues the checksum crc of the preceding data, so that data can be checksummed in pieces. The checksum
+	// of no data is 0. Buffers of 64 bytes and more are folded with carry-less multiplication on CPUs that have
+	// it, and the rest of them with slicing-by-16.
+	inline uint32_t crc32(const char* const data, size_t size, uint32_t crc)
+	{
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+		crc = ~crc;
+#ifdef MYRMO_HAS_X86_DISPATCH
+		if ((size >= 64) && util::cpu_features().pclmul && util::cpu_features().sse41)
+		{
+			const size_t folded = size & ~size_t(15);
+			crc = detail::crc32_clmul(bytes, folded, crc);
+			bytes += folded;
+			size -= folded;
+		}
+#endif
+		if (size < 16)
+			return ~detail::crc32_bytewise(bytes, size, crc);
+		return ~detail::crc32_sliced<16>(bytes, size, crc);
+	}
+
 	inline uint32_t crc32(const char* const data, size_t size)
 	{
-		unsigned int crc = ~0;
-		for (size_t i = 0; i < size; ++i)
-			crc = crc_table_32[(unsigned char)((int)(data[i]) ^ crc)] ^ (crc >> 8);
-		return ~crc;
+		return crc32(data, size, 0);
 	}
 
 	inline uint32_t crc32(const std::string& data)
@@ -96,4 +252,22 @@ namespace myrmo { namespace hash
 		return crc32(data.c_str(), data.size());
 	}
 
+	// Same checksum as crc32(), evaluated at compile time in constant expressions, e.g. for fixed keys:
+	// constexpr uint32_t key = crc32_constexpr("myrmo_memory_cache");
+	// At run time it is the byte-wise loop, so prefer crc32() there.
+	constexpr uint32_t crc32_constexpr(const char* data, size_t size, uint32_t crc = 0)
+	{
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++)
+			crc = crc_table_32[(crc ^ static_cast<unsigned char>(data[i])) & 0xff] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	// The checksum of a string literal, without its terminator.
+	template<size_t N>
+	constexpr uint32_t crc32_constexpr(const char (&literal)[N])
+	{
+		return crc32_constexpr(literal, N - 1);
+	}
+
 }} // End namespace myrmo
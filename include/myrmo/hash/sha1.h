@@ -20,118 +20,713 @@
  */
 #pragma once
 #include <myrmo/util/bits.h>
+#include <myrmo/util/cpu.h>
+#include <myrmo/util/hex.h>
 
 #include <string>
+#include <array>
 #include <cstdint>
 #include <cassert>
-#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+
+#ifdef MYRMO_HAS_X86_DISPATCH
+#include <immintrin.h>
+#endif
 
 namespace myrmo { namespace hash
 {
-	// Notes:
-	// - Nice website for testing/debugging SHA1: https://cse.unl.edu/~ssamal/crypto/genhash.php
-	// TODO:
-	// - Support little endian?
-	// - Support streaming?
-	inline std::string sha1(const std::string& message)
+	// The 20 digest bytes, in the order of the hex string.
+	typedef std::array<uint8_t, 20> Sha1Digest;
+
+	namespace detail
 	{
-		std::string result;
-		result.resize(40);
-
-		size_t bitLength = message.size() * 8;
-		if ((bitLength % 512) >= 448)
-			bitLength += 1024 - (bitLength % 512); // Not enough space for both the 1 and the 64 byte message length. Pad through next block.
-		else
-			bitLength += 512 - (bitLength % 512);  // Pad to end of current block.
-		assert((bitLength % 512) == 0);
-
-		size_t byteLength = bitLength / 8;
-		unsigned char* data = new unsigned char[byteLength];
-		memset(data, 0, byteLength);
-		memcpy(data, message.c_str(), message.size());
-		data[message.size()] = 0x80;
-
-		const uint64_t message_size_bits = message.size() * 8;
-		for (int i = 0; i < 8; i++)
-			data[byteLength - i - 1] = (unsigned char)(message_size_bits >> (i * 8));
-
-		unsigned int h0 = 0x67452301;
-		unsigned int h1 = 0xEFCDAB89;
-		unsigned int h2 = 0x98BADCFE;
-		unsigned int h3 = 0x10325476;
-		unsigned int h4 = 0xC3D2E1F0;
-
-		const size_t nBlocks = bitLength / 512;
-		size_t block = 0;
-		while (block < nBlocks)
-		{
-			unsigned int words[80];
-			for (int i = 0; i < 16; i++)
-				words[i] =	(((unsigned int)data[block*64 + i*4 + 0]) << 24) +
-							(((unsigned int)data[block*64 + i*4 + 1]) << 16) +
-							(((unsigned int)data[block*64 + i*4 + 2]) << 8)  +
-							(((unsigned int)data[block*64 + i*4 + 3]) << 0);
-
-			for (int i = 16; i < 80; i++)
-				words[i] = util::bits::left_rotate<1>(words[i-3] ^ words[i-8] ^ words[i-14] ^ words[i-16]);
-
-			unsigned int a = h0;
-			unsigned int b = h1;
-			unsigned int c = h2;
-			unsigned int d = h3;
-			unsigned int e = h4;
-			unsigned int f;
-			unsigned int k;
-
-			// TODO: Optimize loop
-			for (int i = 0; i < 80; i++)
-			{
-				if (i < 20)
+		inline uint32_t load_be32(const unsigned char* p)
+		{
+			return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+		}
+
+		inline void sha1_init(uint32_t state[5])
+		{
+			state[0] = 0x67452301;
+			state[1] = 0xEFCDAB89;
+			state[2] = 0x98BADCFE;
+			state[3] = 0x10325476;
+			state[4] = 0xC3D2E1F0;
+		}
+
+		inline void sha1_store(const uint32_t state[5], uint8_t* digest)
+		{
+			for (int i = 0; i < 5; i++)
+			{
+				digest[i * 4] = uint8_t(state[i] >> 24);
+				digest[i * 4 + 1] = uint8_t(state[i] >> 16);
+				digest[i * 4 + 2] = uint8_t(state[i] >> 8);
+				digest[i * 4 + 3] = uint8_t(state[i]);
+			}
+		}
+
+		// Pads the last size < 64 bytes of a message of length bytes into one or two blocks of out: a 1 bit and
+		// zeros up to the last 8 bytes of a block, which hold the message length in bits. Returns the block count.
+		inline size_t sha1_pad(const unsigned char* tail, size_t size, uint64_t length, unsigned char out[128])
+		{
+			const size_t blocks = (size + 9 > 64) ? 2 : 1;
+			memcpy(out, tail, size);
+			out[size] = 0x80;
+			memset(out + size + 1, 0, blocks * 64 - 8 - size - 1);
+			const uint64_t bitLength = length * 8;
+			for (int i = 0; i < 8; i++)
+				out[blocks * 64 - i - 1] = (unsigned char)(bitLength >> (i * 8));
+			return blocks;
+		}
+
+		// The four round functions and constants, one for each 20 rounds.
+		struct Sha1Choose
+		{
+			static constexpr uint32_t f(uint32_t b, uint32_t c, uint32_t d) { return d ^ (b & (c ^ d)); }
+			static const uint32_t k = 0x5A827999;
+		};
+
+		struct Sha1Parity
+		{
+			static constexpr uint32_t f(uint32_t b, uint32_t c, uint32_t d) { return b ^ c ^ d; }
+			static const uint32_t k = 0x6ED9EBA1;
+		};
+
+		struct Sha1Majority
+		{
+			static constexpr uint32_t f(uint32_t b, uint32_t c, uint32_t d) { return (b & c) | (d & (b | c)); }
+			static const uint32_t k = 0x8F1BBCDC;
+		};
+
+		struct Sha1Parity2 : Sha1Parity
+		{
+			static const uint32_t k = 0xCA62C1D6;
+		};
+
+		// Word i of the message schedule, kept in a ring of the last 16 words.
+		inline uint32_t sha1_word(uint32_t* w, int i)
+		{
+			if (i < 16)
+				return w[i];
+			w[i & 15] = util::bits::left_rotate<1>(w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15]);
+			return w[i & 15];
+		}
+
+		// One round. The caller rotates the roles of the variables instead of moving their values.
+		template<typename Round>
+		inline void sha1_round(uint32_t a, uint32_t& b, uint32_t c, uint32_t d, uint32_t& e, uint32_t word)
+		{
+			e += util::bits::left_rotate<5>(a) + Round::f(b, c, d) + Round::k + word;
+			b = util::bits::left_rotate<30>(b);
+		}
+
+		// 20 rounds with the same round function, without branches.
+		template<typename Round, int First>
+		inline void sha1_phase(uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d, uint32_t& e, uint32_t* w)
+		{
+			for (int i = First; i < First + 20; i += 5)
+			{
+				sha1_round<Round>(a, b, c, d, e, sha1_word(w, i));
+				sha1_round<Round>(e, a, b, c, d, sha1_word(w, i + 1));
+				sha1_round<Round>(d, e, a, b, c, sha1_word(w, i + 2));
+				sha1_round<Round>(c, d, e, a, b, sha1_word(w, i + 3));
+				sha1_round<Round>(b, c, d, e, a, sha1_word(w, i + 4));
+			}
+		}
+
+		// Portable compression function over count 64-byte blocks.
+		inline void sha1_compress_scalar(uint32_t state[5], const unsigned char* data, size_t count)
+		{
+			for (size_t block = 0; block < count; block++, data += 64)
+			{
+				uint32_t w[16];
+				for (int i = 0; i < 16; i++)
+					w[i] = load_be32(data + i * 4);
+
+				uint32_t a = state[0];
+				uint32_t b = state[1];
+				uint32_t c = state[2];
+				uint32_t d = state[3];
+				uint32_t e = state[4];
+
+				sha1_phase<Sha1Choose, 0>(a, b, c, d, e, w);
+				sha1_phase<Sha1Parity, 20>(a, b, c, d, e, w);
+				sha1_phase<Sha1Majority, 40>(a, b, c, d, e, w);
+				sha1_phase<Sha1Parity2, 60>(a, b, c, d, e, w);
+
+				state[0] += a;
+				state[1] += b;
+				state[2] += c;
+				state[3] += d;
+				state[4] += e;
+			}
+		}
+
+#ifdef MYRMO_HAS_X86_DISPATCH
+		// Rounds 4 * G to 4 * G + 3 with the SHA extensions. msg holds the schedule for four groups in a ring,
+		// e the E values of this group and the next.
+		template<int G>
+		__attribute__((target("sha,ssse3,sse4.1")))
+		inline void sha1_ni_rounds(__m128i& abcd, __m128i* e, __m128i* msg)
+		{
+			const __m128i m = msg[G % 4];
+			if (G == 0)
+				e[0] = _mm_add_epi32(e[0], m);
+			else
+				e[G % 2] = _mm_sha1nexte_epu32(e[G % 2], m);
+			e[(G + 1) % 2] = abcd;
+			abcd = _mm_sha1rnds4_epu32(abcd, e[G % 2], G / 5);
+
+			// The schedule words of group G + 3, computed over the next three groups.
+			if ((G >= 1) && (G <= 16))
+				msg[(G + 3) % 4] = _mm_sha1msg1_epu32(msg[(G + 3) % 4], m);
+			if ((G >= 2) && (G <= 17))
+				msg[(G + 2) % 4] = _mm_xor_si128(msg[(G + 2) % 4], m);
+			if ((G >= 3) && (G <= 18))
+				msg[(G + 1) % 4] = _mm_sha1msg2_epu32(msg[(G + 1) % 4], m);
+		}
+
+		template<int G>
+		struct Sha1NiGroups
+		{
+			__attribute__((target("sha,ssse3,sse4.1")))
+			static void run(__m128i& abcd, __m128i* e, __m128i* msg)
+			{
+				sha1_ni_rounds<G>(abcd, e, msg);
+				Sha1NiGroups<G + 1>::run(abcd, e, msg);
+			}
+		};
+
+		template<>
+		struct Sha1NiGroups<20>
+		{
+			static void run(__m128i&, __m128i*, __m128i*) {}
+		};
+
+		// Compression function on the x86 SHA extensions, four rounds per instruction.
+		__attribute__((target("sha,ssse3,sse4.1")))
+		inline void sha1_compress_ni(uint32_t state[5], const unsigned char* data, size_t count)
+		{
+			const __m128i byteSwap = _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+			__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1B);
+			__m128i e0 = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+
+			for (size_t block = 0; block < count; block++, data += 64)
+			{
+				const __m128i abcdSaved = abcd;
+				const __m128i e0Saved = e0;
+
+				__m128i msg[4];
+				for (int i = 0; i < 4; i++)
+					msg[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * i)), byteSwap);
+
+				__m128i e[2] = { e0, e0 };
+				Sha1NiGroups<0>::run(abcd, e, msg);
+
+				e0 = _mm_sha1nexte_epu32(e[0], e0Saved);
+				abcd = _mm_add_epi32(abcd, abcdSaved);
+			}
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_shuffle_epi32(abcd, 0x1B));
+			state[4] = static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
+		}
+#endif
+
+		// Runs the SHA1 compression function over count 64-byte blocks, on the SHA extensions where the CPU has
+		// them.
+		inline void sha1_compress(uint32_t state[5], const unsigned char* data, size_t count)
+		{
+#ifdef MYRMO_HAS_X86_DISPATCH
+			const util::CpuFeatures& cpu = util::cpu_features();
+			if (cpu.sha && cpu.ssse3 && cpu.sse41)
+			{
+				sha1_compress_ni(state, data, count);
+				return;
+			}
+#endif
+			sha1_compress_scalar(state, data, count);
+		}
+
+#ifdef MYRMO_HAS_X86_DISPATCH
+		// The blocks of one message in a multi-buffer lane: whole blocks are read from the message, the padded tail
+		// from a copy. Idle lanes and lanes past their last block hash the tail again, and the result is dropped.
+		struct Sha1Lane
+		{
+			void set(const std::string& message)
+			{
+				data = reinterpret_cast<const unsigned char*>(message.data());
+				whole = message.size() / 64;
+				blocks = whole + sha1_pad(data + whole * 64, message.size() % 64, message.size(), tail);
+			}
+
+			void clear()
+			{
+				whole = 0;
+				blocks = 0;
+				memset(tail, 0, sizeof(tail));
+			}
+
+			const unsigned char* block(size_t i) const
+			{
+				if (i < whole)
+					return data + i * 64;
+				return (i < blocks) ? tail + (i - whole) * 64 : tail;
+			}
+
+			const unsigned char* data;
+			size_t whole;
+			size_t blocks;
+			unsigned char tail[128];
+		};
+
+		// Loads a block from each of 8 lanes and transposes them, so w[i] holds word i of every lane.
+		__attribute__((target("avx2")))
+		inline void sha1_transpose8(const unsigned char* const* blocks, __m256i* w)
+		{
+			const __m256i byteSwap = _mm256_set_epi64x(0x0c0d0e0f08090a0bLL, 0x0405060700010203LL, 0x0c0d0e0f08090a0bLL, 0x0405060700010203LL);
+			for (int half = 0; half < 2; half++)
+			{
+				__m256i r[8];
+				for (int l = 0; l < 8; l++)
+					r[l] = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(blocks[l] + 32 * half)), byteSwap);
+
+				__m256i t[8], u[8];
+				for (int l = 0; l < 8; l += 2)
 				{
-					f = (b & c) | ((~b) & d);
-					k = 0x5A827999;
+					t[l] = _mm256_unpacklo_epi32(r[l], r[l + 1]);
+					t[l + 1] = _mm256_unpackhi_epi32(r[l], r[l + 1]);
 				}
-				else if (i < 40)
+				for (int l = 0; l < 8; l += 4)
 				{
-					f = b ^ c ^ d;
-					k = 0x6ED9EBA1;
+					u[l] = _mm256_unpacklo_epi64(t[l], t[l + 2]);
+					u[l + 1] = _mm256_unpackhi_epi64(t[l], t[l + 2]);
+					u[l + 2] = _mm256_unpacklo_epi64(t[l + 1], t[l + 3]);
+					u[l + 3] = _mm256_unpackhi_epi64(t[l + 1], t[l + 3]);
 				}
-				else if (i < 60)
+				__m256i* out = w + 8 * half;
+				out[0] = _mm256_permute2x128_si256(u[0], u[4], 0x20);
+				out[1] = _mm256_permute2x128_si256(u[1], u[5], 0x20);
+				out[2] = _mm256_permute2x128_si256(u[2], u[6], 0x20);
+				out[3] = _mm256_permute2x128_si256(u[3], u[7], 0x20);
+				out[4] = _mm256_permute2x128_si256(u[0], u[4], 0x31);
+				out[5] = _mm256_permute2x128_si256(u[1], u[5], 0x31);
+				out[6] = _mm256_permute2x128_si256(u[2], u[6], 0x31);
+				out[7] = _mm256_permute2x128_si256(u[3], u[7], 0x31);
+			}
+		}
+
+		// 8 messages side by side in the 32-bit elements of the AVX2 registers.
+		struct Sha1Avx2
+		{
+			typedef __m256i Vector;
+			static const size_t Lanes = 8;
+
+			__attribute__((target("avx2"))) static void load(const unsigned char* const* blocks, Vector* w) { sha1_transpose8(blocks, w); }
+			__attribute__((target("avx2"))) static Vector set(uint32_t x) { return _mm256_set1_epi32(static_cast<int>(x)); }
+			__attribute__((target("avx2"))) static void store(uint32_t* p, const Vector& x) { _mm256_store_si256(reinterpret_cast<__m256i*>(p), x); }
+			__attribute__((target("avx2"))) static Vector add(const Vector& x, const Vector& y) { return _mm256_add_epi32(x, y); }
+			__attribute__((target("avx2"))) static Vector xor2(const Vector& x, const Vector& y) { return _mm256_xor_si256(x, y); }
+			__attribute__((target("avx2"))) static Vector xor3(const Vector& x, const Vector& y, const Vector& z) { return _mm256_xor_si256(_mm256_xor_si256(x, y), z); }
+			template<int N>
+			__attribute__((target("avx2"))) static Vector rotate(const Vector& x) { return _mm256_or_si256(_mm256_slli_epi32(x, N), _mm256_srli_epi32(x, 32 - N)); }
+
+			__attribute__((target("avx2"))) static Vector f(Sha1Choose, const Vector& b, const Vector& c, const Vector& d)
+			{
+				return _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+			}
+			__attribute__((target("avx2"))) static Vector f(Sha1Parity, const Vector& b, const Vector& c, const Vector& d)
+			{
+				return xor3(b, c, d);
+			}
+			__attribute__((target("avx2"))) static Vector f(Sha1Majority, const Vector& b, const Vector& c, const Vector& d)
+			{
+				return _mm256_or_si256(_mm256_and_si256(b, c), _mm256_and_si256(d, _mm256_or_si256(b, c)));
+			}
+		};
+
+		// 16 messages in the AVX-512 registers, with native rotates and three-input logic.
+		struct Sha1Avx512
+		{
+			typedef __m512i Vector;
+			static const size_t Lanes = 16;
+
+			__attribute__((target("avx512f")))
+			static void load(const unsigned char* const* blocks, Vector* w)
+			{
+				__m256i low[16], high[16];
+				sha1_transpose8(blocks, low);
+				sha1_transpose8(blocks + 8, high);
+				for (int i = 0; i < 16; i++)
+					w[i] = _mm512_inserti64x4(_mm512_castsi256_si512(low[i]), high[i], 1);
+			}
+
+			__attribute__((target("avx512f"))) static Vector set(uint32_t x) { return _mm512_set1_epi32(static_cast<int>(x)); }
+			__attribute__((target("avx512f"))) static void store(uint32_t* p, const Vector& x) { _mm512_store_si512(p, x); }
+			__attribute__((target("avx512f"))) static Vector add(const Vector& x, const Vector& y) { return _mm512_add_epi32(x, y); }
+			__attribute__((target("avx512f"))) static Vector xor2(const Vector& x, const Vector& y) { return _mm512_xor_si512(x, y); }
+			__attribute__((target("avx512f"))) static Vector xor3(const Vector& x, const Vector& y, const Vector& z) { return _mm512_ternarylogic_epi32(x, y, z, 0x96); }
+			template<int N>
+			__attribute__((target("avx512f"))) static Vector rotate(const Vector& x) { return _mm512_rol_epi32(x, N); }
+
+			__attribute__((target("avx512f"))) static Vector f(Sha1Choose, const Vector& b, const Vector& c, const Vector& d)
+			{
+				return _mm512_ternarylogic_epi32(b, c, d, 0xCA);
+			}
+			__attribute__((target("avx512f"))) static Vector f(Sha1Parity, const Vector& b, const Vector& c, const Vector& d)
+			{
+				return _mm512_ternarylogic_epi32(b, c, d, 0x96);
+			}
+			__attribute__((target("avx512f"))) static Vector f(Sha1Majority, const Vector& b, const Vector& c, const Vector& d)
+			{
+				return _mm512_ternarylogic_epi32(b, c, d, 0xE8);
+			}
+		};
+
+		// The multi-buffer counterparts of sha1_word(), sha1_round() and sha1_phase(). They are generic over the
+		// vector width and always inlined into the target-specific kernels below, so they take the target of
+		// their caller. GCC still warns about the vector ABI where they are parsed, which does not apply to inlined
+		// calls. GCC 12 also takes the deliberately undefined pass-through operand of the inlined AVX-512
+		// intrinsics, such as _mm512_rol_epi32(), for an uninitialized read.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+		template<typename V>
+		__attribute__((always_inline)) inline const typename V::Vector& sha1_lanes_word(typename V::Vector* w, int i)
+		{
+			if (i >= 16)
+				w[i & 15] = V::template rotate<1>(V::xor3(w[(i + 13) & 15], w[(i + 8) & 15], V::xor2(w[(i + 2) & 15], w[i & 15])));
+			return w[i & 15];
+		}
+
+		template<typename V, typename Round>
+		__attribute__((always_inline)) inline void sha1_lanes_round(const typename V::Vector& a, typename V::Vector& b,
+			const typename V::Vector& c, const typename V::Vector& d, typename V::Vector& e, const typename V::Vector& word)
+		{
+			e = V::add(V::add(V::add(e, V::template rotate<5>(a)), V::add(V::f(Round(), b, c, d), V::set(Round::k))), word);
+			b = V::template rotate<30>(b);
+		}
+
+		template<typename V, typename Round, int First>
+		__attribute__((always_inline)) inline void sha1_lanes_phase(typename V::Vector* s, typename V::Vector* w)
+		{
+			for (int i = First; i < First + 20; i += 5)
+			{
+				sha1_lanes_round<V, Round>(s[0], s[1], s[2], s[3], s[4], sha1_lanes_word<V>(w, i));
+				sha1_lanes_round<V, Round>(s[4], s[0], s[1], s[2], s[3], sha1_lanes_word<V>(w, i + 1));
+				sha1_lanes_round<V, Round>(s[3], s[4], s[0], s[1], s[2], sha1_lanes_word<V>(w, i + 2));
+				sha1_lanes_round<V, Round>(s[2], s[3], s[4], s[0], s[1], sha1_lanes_word<V>(w, i + 3));
+				sha1_lanes_round<V, Round>(s[1], s[2], s[3], s[4], s[0], sha1_lanes_word<V>(w, i + 4));
+			}
+		}
+
+		// Hashes the messages V::Lanes at a time, one lane per message. Each step transposes the next block of
+		// every lane into the schedule vectors, and a lane's digest is taken after its last block.
+		template<typename V>
+		__attribute__((always_inline)) inline void sha1_many_lanes(const std::string* messages, size_t count, Sha1Digest* digests)
+		{
+			typedef typename V::Vector Vector;
+			const size_t L = V::Lanes;
+			Sha1Lane lanes[L];
+			const unsigned char* data[L];
+			alignas(64) uint32_t states[5][L];
+
+			for (size_t first = 0; first < count; first += L)
+			{
+				const size_t active = std::min(L, count - first);
+				size_t blocks = 0;
+				for (size_t l = 0; l < L; l++)
 				{
-					f = (b & c) | (b & d) | (c & d);
-					k = 0x8F1BBCDC;
+					if (l < active)
+					{
+						lanes[l].set(messages[first + l]);
+						blocks = std::max(blocks, lanes[l].blocks);
+					}
+					else
+						lanes[l].clear();
 				}
-				else // i < 80
+
+				Vector state[5];
+				uint32_t initial[5];
+				sha1_init(initial);
+				for (int i = 0; i < 5; i++)
+					state[i] = V::set(initial[i]);
+
+				for (size_t block = 0; block < blocks; block++)
 				{
-					f = b ^ c ^ d;
-					k = 0xCA62C1D6;
+					for (size_t l = 0; l < L; l++)
+						data[l] = lanes[l].block(block);
+					Vector w[16];
+					V::load(data, w);
+					Vector s[5] = { state[0], state[1], state[2], state[3], state[4] };
+					sha1_lanes_phase<V, Sha1Choose, 0>(s, w);
+					sha1_lanes_phase<V, Sha1Parity, 20>(s, w);
+					sha1_lanes_phase<V, Sha1Majority, 40>(s, w);
+					sha1_lanes_phase<V, Sha1Parity2, 60>(s, w);
+					for (int i = 0; i < 5; i++)
+						state[i] = V::add(state[i], s[i]);
+
+					bool finished = false;
+					for (size_t l = 0; l < active; l++)
+						finished = finished || (lanes[l].blocks == block + 1);
+					if (!finished)
+						continue;
+
+					for (int i = 0; i < 5; i++)
+						V::store(states[i], state[i]);
+					for (size_t l = 0; l < active; l++)
+					{
+						if (lanes[l].blocks != block + 1)
+							continue;
+						const uint32_t lane[5] = { states[0][l], states[1][l], states[2][l], states[3][l], states[4][l] };
+						sha1_store(lane, digests[first + l].data());
+					}
 				}
+			}
+		}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
 
-				const unsigned int temp = util::bits::left_rotate<5>(a) + f + e + k + words[i];
-				e = d;
-				d = c;
-				c = util::bits::left_rotate<30>(b);
-				b = a;
-				a = temp;
+		__attribute__((target("avx2")))
+		inline void sha1_many_avx2(const std::string* messages, size_t count, Sha1Digest* digests)
+		{
+			sha1_many_lanes<Sha1Avx2>(messages, count, digests);
+		}
+
+		__attribute__((target("avx512f")))
+		inline void sha1_many_avx512(const std::string* messages, size_t count, Sha1Digest* digests)
+		{
+			sha1_many_lanes<Sha1Avx512>(messages, count, digests);
+		}
+#endif
+	}
+
+	// Incremental SHA1 of a message that is fed in pieces of any size. Whole blocks are hashed in place from the
+	// caller's data, only a partial block is buffered. finalize() returns the digest and resets the hasher for the
+	// next message.
+	// Notes:
+	// - Nice website for testing/debugging SHA1: https://cse.unl.edu/~ssamal/crypto/genhash.php
+	class Sha1
+	{
+	public:
+		static const size_t BlockSize = 64;
+		static const size_t DigestSize = 20;
+
+		Sha1()
+		{
+			reset();
+		}
+
+		void reset()
+		{
+			detail::sha1_init(mState);
+			mLength = 0;
+			mBuffered = 0;
+		}
+
+		void update(const void* data, size_t size)
+		{
+			if (size == 0)
+				return;
+
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			mLength += size;
+
+			if (mBuffered)
+			{
+				const size_t count = std::min(size, BlockSize - mBuffered);
+				memcpy(mBuffer + mBuffered, bytes, count);
+				mBuffered += count;
+				bytes += count;
+				size -= count;
+				if (mBuffered < BlockSize)
+					return;
+				detail::sha1_compress(mState, mBuffer, 1);
+				mBuffered = 0;
 			}
 
-			h0 = h0 + a;
-			h1 = h1 + b;
-			h2 = h2 + c;
-			h3 = h3 + d;
-			h4 = h4 + e;
+			const size_t blocks = size / BlockSize;
+			detail::sha1_compress(mState, bytes, blocks);
+			bytes += blocks * BlockSize;
+			size -= blocks * BlockSize;
+
+			memcpy(mBuffer, bytes, size);
+			mBuffered = size;
+		}
+
+		void update(const std::string& data)
+		{
+			update(data.data(), data.size());
+		}
+
+		// Writes the DigestSize digest bytes.
+		void finalize(uint8_t* digest)
+		{
+			unsigned char tail[2 * BlockSize];
+			detail::sha1_compress(mState, tail, detail::sha1_pad(mBuffer, mBuffered, mLength, tail));
+			detail::sha1_store(mState, digest);
+			reset();
+		}
 
-			block++;
+		// Returns the digest as 40 lowercase hex characters.
+		std::string finalize()
+		{
+			uint8_t digest[DigestSize];
+			finalize(digest);
+			return util::hex_encode(digest, DigestSize);
 		}
 
-		snprintf(&result[0],  32, "%08x", h0);
-		snprintf(&result[8],  32, "%08x", h1);
-		snprintf(&result[16], 32, "%08x", h2);
-		snprintf(&result[24], 32, "%08x", h3);
-		snprintf(&result[32], 32, "%08x", h4);
+	private:
+		uint32_t mState[5];
+		uint64_t mLength; // In bytes.
+		unsigned char mBuffer[BlockSize];
+		size_t mBuffered;
+	};
+
+	// Writes the 20 digest bytes of a whole message to digest. Neither allocates nor formats, unlike the hex
+	// string of sha1(message).
+	inline void sha1(const void* data, size_t size, uint8_t* digest)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		uint32_t state[5];
+		detail::sha1_init(state);
+		detail::sha1_compress(state, bytes, size / 64);
+		unsigned char tail[128];
+		detail::sha1_compress(state, tail, detail::sha1_pad(bytes + size / 64 * 64, size % 64, size, tail));
+		detail::sha1_store(state, digest);
+	}
+
+	// The digest bytes, e.g. as the hash function of caches with binary keys.
+	inline Sha1Digest sha1_digest(const std::string& message)
+	{
+		Sha1Digest digest;
+		sha1(message.data(), message.size(), digest.data());
+		return digest;
+	}
+
+	namespace detail
+	{
+		// Byte i of a message of size bytes after padding to padded bytes, as sha1_pad() lays it out.
+		constexpr uint8_t sha1_padded_byte(const char* data, size_t size, size_t padded, size_t i)
+		{
+			return (i < size) ? static_cast<uint8_t>(data[i])
+				: (i == size) ? uint8_t(0x80)
+				: (i + 8 >= padded) ? static_cast<uint8_t>((uint64_t(size) * 8) >> (8 * (padded - 1 - i)))
+				: uint8_t(0);
+		}
 
-		delete[] data;
-		return result;
+		struct Sha1ConstexprState { uint32_t h[5]; };
+
+		// The textbook form of the compression function, which constant evaluation can run.
+		constexpr Sha1ConstexprState sha1_constexpr_state(const char* data, size_t size)
+		{
+			Sha1ConstexprState state = { { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 } };
+			const size_t padded = (size + 8) / 64 * 64 + 64;
+			for (size_t block = 0; block < padded; block += 64)
+			{
+				uint32_t w[80] = {};
+				for (size_t i = 0; i < 16; i++)
+				{
+					for (size_t j = 0; j < 4; j++)
+						w[i] = (w[i] << 8) | sha1_padded_byte(data, size, padded, block + i * 4 + j);
+				}
+				for (size_t i = 16; i < 80; i++)
+					w[i] = util::bits::left_rotate<1>(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16]);
+
+				uint32_t a = state.h[0], b = state.h[1], c = state.h[2], d = state.h[3], e = state.h[4];
+				for (size_t i = 0; i < 80; i++)
+				{
+					const uint32_t f = (i < 20) ? Sha1Choose::f(b, c, d) + Sha1Choose::k
+						: (i < 40) ? Sha1Parity::f(b, c, d) + Sha1Parity::k
+						: (i < 60) ? Sha1Majority::f(b, c, d) + Sha1Majority::k
+						: Sha1Parity2::f(b, c, d) + Sha1Parity2::k;
+					const uint32_t temp = util::bits::left_rotate<5>(a) + f + e + w[i];
+					e = d;
+					d = c;
+					c = util::bits::left_rotate<30>(b);
+					b = a;
+					a = temp;
+				}
+				state.h[0] += a;
+				state.h[1] += b;
+				state.h[2] += c;
+				state.h[3] += d;
+				state.h[4] += e;
+			}
+			return state;
+		}
+
+		template<size_t... I>
+		constexpr Sha1Digest sha1_constexpr_digest(const Sha1ConstexprState& state, std::index_sequence<I...>)
+		{
+			return Sha1Digest{ { static_cast<uint8_t>(state.h[I / 4] >> (24 - 8 * (I % 4)))... } };
+		}
+	}
+
+	// Same digest as sha1(data, size, digest), evaluated at compile time in constant expressions, e.g. for fixed
+	// keys: constexpr Sha1Digest key = sha1_constexpr("myrmo_disk_cache_index");
+	// At run time it is much slower than the kernels of sha1(), so prefer those there.
+	constexpr Sha1Digest sha1_constexpr(const char* data, size_t size)
+	{
+		return detail::sha1_constexpr_digest(detail::sha1_constexpr_state(data, size), std::make_index_sequence<Sha1::DigestSize>());
+	}
+
+	// The digest of a string literal, without its terminator.
+	template<size_t N>
+	constexpr Sha1Digest sha1_constexpr(const char (&literal)[N])
+	{
+		return sha1_constexpr(literal, N - 1);
+	}
+
+	// TODO:
+	// - Support little endian?
+	inline std::string sha1(const std::string& message)
+	{
+		uint8_t digest[Sha1::DigestSize];
+		sha1(message.data(), message.size(), digest);
+		return util::hex_encode(digest, Sha1::DigestSize);
+	}
+
+	// The digests of count messages. Short messages such as cache keys only fill one or two blocks each, so on
+	// CPUs with AVX2 or AVX-512 they are hashed 8 or 16 at a time in the lanes of the vector registers.
+	inline void sha1_many(const std::string* messages, size_t count, Sha1Digest* digests)
+	{
+#ifdef MYRMO_HAS_X86_DISPATCH
+		const util::CpuFeatures& cpu = util::cpu_features();
+		if (cpu.avx512)
+		{
+			detail::sha1_many_avx512(messages, count, digests);
+			return;
+		}
+		if (cpu.avx2)
+		{
+			detail::sha1_many_avx2(messages, count, digests);
+			return;
+		}
+#endif
+		for (size_t i = 0; i < count; i++)
+			sha1(messages[i].data(), messages[i].size(), digests[i].data());
+	}
+
+	// Same as above, with the digests as 40 lowercase hex characters like sha1() returns.
+	inline void sha1_many(const std::string* messages, size_t count, std::string* hexDigests)
+	{
+		Sha1Digest digests[64];
+		for (size_t first = 0; first < count; first += 64)
+		{
+			const size_t n = std::min<size_t>(64, count - first);
+			sha1_many(messages + first, n, digests);
+			for (size_t i = 0; i < n; i++)
+			{
+				hexDigests[first + i].resize(2 * Sha1::DigestSize);
+				util::hex_encode(digests[i].data(), Sha1::DigestSize, &hexDigests[first + i][0]);
+			}
+		}
 	}
 
 }} // End namespace myrmo::hash
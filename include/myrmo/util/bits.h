@@ -25,7 +25,7 @@ namespace myrmo { namespace util { namespace bits
 {
 	// Note: Stolen from https://blog.regehr.org/archives/1063
 	template<unsigned int T>
-	inline uint32_t left_rotate(uint32_t x)
+	constexpr uint32_t left_rotate(uint32_t x)
 	{
 		static_assert(T < 32, "This function is for 32 bit left rotate only.");
 		return (x << T) | (x >> (-T & 31));
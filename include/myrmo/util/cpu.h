@@ -0,0 +1,89 @@
+/* Copyright © 2019 Øystein Myrmo (oystein.myrmo@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+// Kernels for x86 instruction set extensions are compiled with per-function target attributes and selected at
+// run time, so that the library needs no -m flags and still runs on CPUs without the extensions. Define
+// MYRMO_NO_CPU_DISPATCH to build with the portable kernels only.
+#if !defined(MYRMO_NO_CPU_DISPATCH) && (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define MYRMO_HAS_X86_DISPATCH 1
+#include <cpuid.h>
+#endif
+
+namespace myrmo { namespace util
+{
+	// Instruction set extensions of the CPU that the kernels dispatch on. All false where dispatch is not built.
+	struct CpuFeatures
+	{
+		CpuFeatures() : ssse3(false), sse41(false), pclmul(false), sha(false), avx2(false), avx512(false) {}
+		bool ssse3;
+		bool sse41;
+		bool pclmul;
+		bool sha;
+		bool avx2;
+		bool avx512; // AVX-512 F.
+	};
+
+	// Detected once, on first use.
+	inline const CpuFeatures& cpu_features()
+	{
+		struct Detect
+		{
+			static CpuFeatures run()
+			{
+				CpuFeatures features;
+#ifdef MYRMO_HAS_X86_DISPATCH
+				unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+				bool osxsave = false;
+				if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+				{
+					features.ssse3 = (ecx & (1u << 9)) != 0;
+					features.sse41 = (ecx & (1u << 19)) != 0;
+					features.pclmul = (ecx & (1u << 1)) != 0;
+					osxsave = (ecx & (1u << 27)) != 0;
+				}
+
+				// The wide registers are only usable if the OS saves their state on context switches.
+				unsigned int xcr0 = 0;
+				if (osxsave)
+				{
+					unsigned int xcr0High = 0;
+					__asm__("xgetbv" : "=a"(xcr0), "=d"(xcr0High) : "c"(0));
+				}
+				const bool ymm = (xcr0 & 0x06) == 0x06;
+				const bool zmm = (xcr0 & 0xe6) == 0xe6;
+
+				if ((__get_cpuid_max(0, nullptr) >= 7) && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+				{
+					features.sha = (ebx & (1u << 29)) != 0;
+					features.avx2 = ymm && ((ebx & (1u << 5)) != 0);
+					features.avx512 = zmm && ((ebx & (1u << 16)) != 0);
+				}
+#endif
+				return features;
+			}
+		};
+
+		static const CpuFeatures features = Detect::run();
+		return features;
+	}
+
+}} // End namespace myrmo::util
@@ -0,0 +1,48 @@
+/* Copyright © 2019 Øystein Myrmo (oystein.myrmo@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace myrmo { namespace util
+{
+	// Flushes the file's data and metadata to stable storage.
+	inline bool sync_file(const std::string& path)
+	{
+		const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			return false;
+		const bool synced = ::fsync(fd) == 0;
+		::close(fd);
+		return synced;
+	}
+
+	// Flushes the directory holding path, so that files created, renamed or removed in it stay that way.
+	inline bool sync_parent_directory(const std::string& path)
+	{
+		const size_t slash = path.rfind('/');
+		const std::string dir = (slash == std::string::npos) ? std::string(".") : (slash == 0) ? std::string("/") : path.substr(0, slash);
+		return sync_file(dir);
+	}
+
+}} // End namespace myrmo::util
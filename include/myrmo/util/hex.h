@@ -0,0 +1,87 @@
+/* Copyright © 2019 Øystein Myrmo (oystein.myrmo@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstring>
+
+namespace myrmo { namespace util
+{
+	namespace detail
+	{
+		// The two lowercase hex digits of every byte value.
+		static const char hex_pairs[] =
+			"000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+			"202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+			"404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+			"606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+			"808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+			"a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+			"c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+			"e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+		// The value of a hex digit in either case, or -1.
+		inline int hex_value(char c)
+		{
+			const unsigned int digit = static_cast<unsigned char>(c) - unsigned('0');
+			if (digit < 10)
+				return int(digit);
+			const unsigned int letter = (static_cast<unsigned char>(c) | 0x20u) - unsigned('a');
+			return (letter < 6) ? int(letter + 10) : -1;
+		}
+	}
+
+	// Writes the 2 * size lowercase hex digits of data to out, without a terminator.
+	inline void hex_encode(const uint8_t* data, size_t size, char* out)
+	{
+		for (size_t i = 0; i < size; i++)
+			memcpy(out + 2 * i, detail::hex_pairs + 2 * data[i], 2);
+	}
+
+	inline std::string hex_encode(const uint8_t* data, size_t size)
+	{
+		std::string hex(size * 2, '\0');
+		hex_encode(data, size, &hex[0]);
+		return hex;
+	}
+
+	// Reads size bytes from the 2 * size hex digits at hex, in either case. Returns false if there is a character
+	// that is not a hex digit, in which case out is partly written.
+	inline bool hex_decode(const char* hex, uint8_t* out, size_t size)
+	{
+		for (size_t i = 0; i < size; i++)
+		{
+			const int high = detail::hex_value(hex[2 * i]);
+			const int low = detail::hex_value(hex[2 * i + 1]);
+			if ((high | low) < 0)
+				return false;
+			out[i] = uint8_t((high << 4) | low);
+		}
+		return true;
+	}
+
+	// Returns false unless hex holds exactly 2 * size hex digits.
+	inline bool hex_decode(const std::string& hex, uint8_t* out, size_t size)
+	{
+		return (hex.size() == 2 * size) && hex_decode(hex.data(), out, size);
+	}
+
+}} // End namespace myrmo::util
@@ -0,0 +1,572 @@
+/* Copyright © 2019 Øystein Myrmo (oystein.myrmo@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+// io_uring is used through the raw system calls, so that it needs neither liburing nor a particular kernel at
+// build time. Define MYRMO_NO_IO_URING to build without it. Unlinks and renames need kernel 5.11 headers.
+#if !defined(MYRMO_NO_IO_URING) && defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_FEAT_NATIVE_WORKERS) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define MYRMO_HAS_IO_URING 1
+#endif
+#endif
+#endif
+
+namespace myrmo { namespace util
+{
+#ifdef MYRMO_HAS_IO_URING
+	// Minimal io_uring submission and completion ring. isOpen() is false if the kernel does not support io_uring,
+	// is older than 5.12 or does not allow it, in which case the caller falls back to plain system calls.
+	class IoUring
+	{
+	public:
+		explicit IoUring(unsigned int entries = 64)
+			: mFd(-1), mSqRing(nullptr), mSqRingSize(0), mCqRing(nullptr), mCqRingSize(0), mSqes(nullptr), mSqesSize(0), mPrepared(0)
+		{
+			struct io_uring_params params;
+			std::memset(&params, 0, sizeof(params));
+			const long fd = ::syscall(__NR_io_uring_setup, entries, &params);
+			if (fd < 0)
+				return;
+			mFd = static_cast<int>(fd);
+
+			// Unlinks and the other file operations need the native workers of kernel 5.12.
+			if (!(params.features & IORING_FEAT_NATIVE_WORKERS))
+			{
+				close();
+				return;
+			}
+
+			mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+			mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+			if (params.features & IORING_FEAT_SINGLE_MMAP)
+				mSqRingSize = mCqRingSize = std::max(mSqRingSize, mCqRingSize);
+
+			mSqRing = map(mSqRingSize, IORING_OFF_SQ_RING);
+			mCqRing = (params.features & IORING_FEAT_SINGLE_MMAP) ? mSqRing : map(mCqRingSize, IORING_OFF_CQ_RING);
+			mSqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+			mSqes = static_cast<struct io_uring_sqe*>(map(mSqesSize, IORING_OFF_SQES));
+			if (!mSqRing || !mCqRing || !mSqes)
+			{
+				close();
+				return;
+			}
+
+			char* sq = static_cast<char*>(mSqRing);
+			mSqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+			mSqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+			mSqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+			mSqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+			mSqEntries = params.sq_entries;
+
+			char* cq = static_cast<char*>(mCqRing);
+			mCqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+			mCqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+			mCqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+			mCqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+		}
+
+		IoUring(const IoUring&) = delete;
+		IoUring& operator=(const IoUring&) = delete;
+
+		~IoUring()
+		{
+			close();
+		}
+
+		bool isOpen() const { return mFd >= 0; }
+
+		// Number of operations that can be prepared before they have to be submitted.
+		unsigned int capacity() const { return isOpen() ? mSqEntries : 0; }
+
+		// Returns a cleared submission entry, or nullptr if capacity() entries are already prepared.
+		struct io_uring_sqe* prepare()
+		{
+			if (!isOpen() || (mPrepared >= mSqEntries))
+				return nullptr;
+
+			const unsigned tail = *mSqTail + mPrepared;
+			struct io_uring_sqe* sqe = &mSqes[tail & mSqMask];
+			std::memset(sqe, 0, sizeof(*sqe));
+			mSqArray[tail & mSqMask] = tail & mSqMask;
+			mPrepared++;
+			return sqe;
+		}
+
+		// Submits the prepared entries and waits until waitCount operations have completed. Returns 0 or -errno.
+		// On an error the ring closes itself, as its state is no longer known: entries that were not submitted are
+		// discarded with it and the kernel cancels the operations in flight, so none of them may be waited for.
+		int submitAndWait(unsigned int waitCount)
+		{
+			__atomic_store_n(mSqTail, *mSqTail + mPrepared, __ATOMIC_RELEASE);
+			unsigned int toSubmit = mPrepared;
+			mPrepared = 0;
+
+			for (;;)
+			{
+				const long submitted = ::syscall(__NR_io_uring_enter, mFd, toSubmit, waitCount, IORING_ENTER_GETEVENTS, nullptr, 0);
+				if (submitted >= 0)
+				{
+					toSubmit -= static_cast<unsigned int>(submitted);
+					if (toSubmit == 0)
+						return 0;
+				}
+				else if (errno != EINTR)
+				{
+					const int error = -errno;
+					close();
+					return error;
+				}
+			}
+		}
+
+		// Takes the next completion, if any.
+		bool pop(uint64_t* userData, int* result)
+		{
+			const unsigned head = *mCqHead;
+			if (head == __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE))
+				return false;
+
+			const struct io_uring_cqe& cqe = mCqes[head & mCqMask];
+			*userData = cqe.user_data;
+			*result = cqe.res;
+			__atomic_store_n(mCqHead, head + 1, __ATOMIC_RELEASE);
+			return true;
+		}
+
+	private:
+		void* map(size_t size, uint64_t offset)
+		{
+			void* mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, static_cast<off_t>(offset));
+			return (mapping == MAP_FAILED) ? nullptr : mapping;
+		}
+
+		void close()
+		{
+			if (mSqes)
+				::munmap(mSqes, mSqesSize);
+			if (mCqRing && (mCqRing != mSqRing))
+				::munmap(mCqRing, mCqRingSize);
+			if (mSqRing)
+				::munmap(mSqRing, mSqRingSize);
+			if (mFd >= 0)
+				::close(mFd);
+			mFd = -1;
+			mSqRing = mCqRing = nullptr;
+			mSqes = nullptr;
+			mPrepared = 0;
+		}
+
+		int mFd;
+		void* mSqRing;
+		size_t mSqRingSize;
+		void* mCqRing;
+		size_t mCqRingSize;
+		struct io_uring_sqe* mSqes;
+		size_t mSqesSize;
+		unsigned int mPrepared; // Prepared but not yet submitted.
+
+		unsigned* mSqHead;
+		unsigned* mSqTail;
+		unsigned mSqMask;
+		unsigned* mSqArray;
+		unsigned mSqEntries;
+		unsigned* mCqHead;
+		unsigned* mCqTail;
+		unsigned mCqMask;
+		struct io_uring_cqe* mCqes;
+	};
+#else
+	class IoUring
+	{
+	public:
+		explicit IoUring(unsigned int = 64) {}
+		bool isOpen() const { return false; }
+		unsigned int capacity() const { return 0; }
+	};
+#endif
+
+	// A batch of whole-file writes, ranged reads, renames and unlinks. With an open ring, submit() runs the opens,
+	// renames and unlinks of the whole batch together and then the reads and writes together, with each close
+	// (and fsync) linked to its read or write. Without one, the operations run one by one with plain system
+	// calls. The operations of a batch may run in any order, so a batch should not change a path it also uses
+	// otherwise.
+	class FileBatch
+	{
+	public:
+		explicit FileBatch(IoUring* ring = nullptr) : mRing(ring) {}
+
+		// Creates or truncates the file and writes size bytes to it. An exclusive write fails with -EEXIST if the
+		// file exists. With sync, the data is flushed to stable storage before the file is closed. The data must
+		// stay valid until submit() returns.
+		size_t write(const std::string& path, const char* data, size_t size, bool exclusive = false, bool sync = false)
+		{
+			mOps.push_back(Op(Type::Write, path, const_cast<char*>(data), 0, size));
+			mOps.back().exclusive = exclusive;
+			mOps.back().sync = sync;
+			return mOps.size() - 1;
+		}
+
+		// Reads size bytes at offset into out. Fails with -EIO if the file is shorter.
+		size_t read(const std::string& path, uint64_t offset, size_t size, char* out)
+		{
+			mOps.push_back(Op(Type::Read, path, out, offset, size));
+			return mOps.size() - 1;
+		}
+
+		size_t unlink(const std::string& path)
+		{
+			mOps.push_back(Op(Type::Unlink, path, nullptr, 0, 0));
+			return mOps.size() - 1;
+		}
+
+		// Renames from to to. With noReplace, it fails with -EEXIST if to exists.
+		size_t rename(const std::string& from, const std::string& to, bool noReplace = false)
+		{
+			mOps.push_back(Op(Type::Rename, from, nullptr, 0, 0));
+			mOps.back().target = to;
+			mOps.back().exclusive = noReplace;
+			return mOps.size() - 1;
+		}
+
+		void submit()
+		{
+#ifdef MYRMO_HAS_IO_URING
+			if (mRing && mRing->isOpen())
+			{
+				submitToRing();
+				return;
+			}
+#endif
+			for (Op& op : mOps)
+				runDirectly(op);
+		}
+
+		// 0 on success or -errno, valid after submit().
+		int result(size_t op) const
+		{
+			return mOps[op].result;
+		}
+
+		size_t size() const { return mOps.size(); }
+		bool empty() const { return mOps.empty(); }
+		void clear() { mOps.clear(); }
+
+	private:
+		enum class Type { Write, Read, Unlink, Rename };
+
+		struct Op
+		{
+			Op(Type type, const std::string& path, char* buffer, uint64_t offset, size_t size)
+				: type(type), path(path), buffer(buffer), offset(offset), size(size), exclusive(false), sync(false), fd(-1), result(0), pending(0) {}
+			Type type;
+			std::string path;
+			std::string target; // Of renames.
+			char* buffer;
+			uint64_t offset;
+			size_t size;
+			bool exclusive; // O_EXCL for writes, no replace for renames.
+			bool sync;
+			int fd;
+			int result;
+			unsigned int pending; // Ring entries that have not completed.
+		};
+
+		// Needs no open, so it runs in the first round of a ring submission.
+		static bool isPathOp(const Op& op)
+		{
+			return (op.type == Type::Unlink) || (op.type == Type::Rename);
+		}
+
+		static int renameDirectly(const Op& op)
+		{
+			if (!op.exclusive)
+				return (::rename(op.path.c_str(), op.target.c_str()) == 0) ? 0 : -errno;
+#if defined(__linux__) && defined(SYS_renameat2)
+			if (::syscall(SYS_renameat2, AT_FDCWD, op.path.c_str(), AT_FDCWD, op.target.c_str(), 1 /* RENAME_NOREPLACE */) == 0)
+				return 0;
+			if (errno != ENOSYS && errno != EINVAL)
+				return -errno;
+#endif
+			// A hard link fails if the target exists.
+			if (::link(op.path.c_str(), op.target.c_str()) != 0)
+				return -errno;
+			::unlink(op.path.c_str());
+			return 0;
+		}
+
+		static int openFlags(const Op& op)
+		{
+			if (op.type == Type::Read)
+				return O_RDONLY | O_CLOEXEC;
+			return O_WRONLY | O_CREAT | O_CLOEXEC | (op.exclusive ? O_EXCL : O_TRUNC);
+		}
+
+		static void runDirectly(Op& op)
+		{
+			if (op.type == Type::Unlink)
+			{
+				op.result = (::unlink(op.path.c_str()) == 0) ? 0 : -errno;
+				return;
+			}
+			if (op.type == Type::Rename)
+			{
+				op.result = renameDirectly(op);
+				return;
+			}
+
+			const int fd = ::open(op.path.c_str(), openFlags(op), 0644);
+			if (fd < 0)
+			{
+				op.result = -errno;
+				return;
+			}
+
+			op.result = 0;
+			size_t done = 0;
+			while ((done < op.size) && (op.result == 0))
+			{
+				const ssize_t n = (op.type == Type::Read)
+					? ::pread(fd, op.buffer + done, op.size - done, static_cast<off_t>(op.offset + done))
+					: ::pwrite(fd, op.buffer + done, op.size - done, static_cast<off_t>(op.offset + done));
+				if (n > 0)
+					done += static_cast<size_t>(n);
+				else if (n == 0)
+					op.result = -EIO; // Read past the end of the file.
+				else if (errno != EINTR)
+					op.result = -errno;
+			}
+
+			if (op.sync && (op.result == 0) && (::fsync(fd) != 0))
+				op.result = -errno;
+			if ((::close(fd) != 0) && (op.result == 0) && (op.type == Type::Write))
+				op.result = -errno;
+		}
+
+#ifdef MYRMO_HAS_IO_URING
+		// A single read or write transfers at most this many bytes, larger ones run directly.
+		static const size_t MaxRingTransfer = 0x7ffff000;
+
+		void submitToRing()
+		{
+			std::vector<size_t> ringOps;
+			for (size_t i = 0; i < mOps.size(); i++)
+			{
+				if (mOps[i].size > MaxRingTransfer)
+					runDirectly(mOps[i]);
+				else
+					ringOps.push_back(i);
+			}
+
+			// Opens, renames and unlinks.
+			run(ringOps, 1, [this](size_t i)
+			{
+				Op& op = mOps[i];
+				struct io_uring_sqe* sqe = mRing->prepare();
+				sqe->fd = AT_FDCWD;
+				sqe->addr = reinterpret_cast<uint64_t>(op.path.c_str());
+				sqe->user_data = i * 4;
+				if (op.type == Type::Unlink)
+				{
+					sqe->opcode = IORING_OP_UNLINKAT;
+				}
+				else if (op.type == Type::Rename)
+				{
+					sqe->opcode = IORING_OP_RENAMEAT;
+					sqe->len = static_cast<uint32_t>(AT_FDCWD);
+					sqe->addr2 = reinterpret_cast<uint64_t>(op.target.c_str());
+					sqe->rename_flags = op.exclusive ? 1 /* RENAME_NOREPLACE */ : 0;
+				}
+				else
+				{
+					sqe->opcode = IORING_OP_OPENAT;
+					sqe->len = 0644;
+					sqe->open_flags = static_cast<uint32_t>(openFlags(op));
+				}
+				return 1u;
+			},
+			[this](uint64_t userData, int result)
+			{
+				Op& op = mOps[userData / 4];
+				if (!isPathOp(op) && (result >= 0))
+				{
+					op.fd = result;
+					op.result = 0;
+				}
+				else
+				{
+					op.result = (result < 0) ? result : 0;
+				}
+			});
+
+			// Reads and writes, each hard-linked to the fsync, if any, and the close of its file, so the file is
+			// closed even if they fail or come up short. The fsync then still runs, and the op keeps the error of
+			// the write. A close that is cancelled anyway, e.g. by the ring going away, is done here.
+			std::vector<size_t> opened;
+			for (size_t i : ringOps)
+			{
+				if (mOps[i].fd >= 0)
+					opened.push_back(i);
+			}
+
+			run(opened, 3, [this](size_t i)
+			{
+				Op& op = mOps[i];
+				struct io_uring_sqe* sqe = mRing->prepare();
+				sqe->opcode = (op.type == Type::Read) ? IORING_OP_READ : IORING_OP_WRITE;
+				sqe->flags = IOSQE_IO_HARDLINK;
+				sqe->fd = op.fd;
+				sqe->addr = reinterpret_cast<uint64_t>(op.buffer);
+				sqe->len = static_cast<uint32_t>(op.size);
+				sqe->off = op.offset;
+				sqe->user_data = i * 4;
+
+				if (op.sync)
+				{
+					sqe = mRing->prepare();
+					sqe->opcode = IORING_OP_FSYNC;
+					sqe->flags = IOSQE_IO_HARDLINK;
+					sqe->fd = op.fd;
+					sqe->user_data = i * 4 + 2;
+				}
+
+				sqe = mRing->prepare();
+				sqe->opcode = IORING_OP_CLOSE;
+				sqe->fd = op.fd;
+				sqe->user_data = i * 4 + 1;
+				return op.sync ? 3u : 2u;
+			},
+			[this](uint64_t userData, int result)
+			{
+				Op& op = mOps[userData / 4];
+				if (userData % 4)
+				{
+					if (userData % 4 == 1)
+					{
+						if (result == -ECANCELED)
+							result = (::close(op.fd) == 0) ? 0 : -errno;
+						op.fd = -1;
+					}
+					if ((result < 0) && (op.result == 0) && (op.type == Type::Write))
+						op.result = result; // A failed fsync or close of a written file.
+				}
+				else if (result < 0)
+				{
+					op.result = result;
+				}
+				else if (static_cast<size_t>(result) != op.size)
+				{
+					op.result = (op.type == Type::Read) ? -EIO : -ENOSPC; // Short transfer.
+				}
+			});
+		}
+
+		// Prepares up to maxSqesPerOp entries per operation, as returned by prepare, and submits them in chunks of
+		// the ring's capacity. If the ring fails, it is closed and never used again, and the operations that did
+		// not complete run directly, as do all operations once the ring is closed.
+		template<typename Prepare, typename Complete>
+		void run(const std::vector<size_t>& ops, unsigned int maxSqesPerOp, Prepare prepare, Complete complete)
+		{
+			if (!mRing->isOpen())
+			{
+				for (size_t i : ops)
+					runWithoutRing(mOps[i]);
+				return;
+			}
+
+			const size_t chunkSize = mRing->capacity() / maxSqesPerOp;
+			for (size_t begin = 0; begin < ops.size(); begin += chunkSize)
+			{
+				const size_t end = std::min(ops.size(), begin + chunkSize);
+				unsigned int count = 0;
+				for (size_t i = begin; i < end; i++)
+				{
+					Op& op = mOps[ops[i]];
+					op.pending = prepare(ops[i]);
+					count += op.pending;
+				}
+
+				int error = mRing->submitAndWait(count);
+				uint64_t userData;
+				int result;
+				for (unsigned int done = 0; (error == 0) && (done < count); )
+				{
+					if (mRing->pop(&userData, &result))
+					{
+						mOps[userData / 4].pending--;
+						complete(userData, result);
+						done++;
+					}
+					else
+					{
+						error = mRing->submitAndWait(count - done);
+					}
+				}
+
+				if (error < 0)
+				{
+					for (size_t i = begin; i < ops.size(); i++)
+					{
+						if ((i >= end) || (mOps[ops[i]].pending > 0))
+							runWithoutRing(mOps[ops[i]]);
+					}
+					return;
+				}
+			}
+		}
+
+		// Runs an operation directly after the ring was closed, also if it was partly done through the ring. The
+		// ring's open already created the file. Its descriptor is closed here unless a close for it was queued on
+		// the ring, which is then left to the kernel.
+		static void runWithoutRing(Op& op)
+		{
+			if (op.fd >= 0)
+			{
+				if (op.pending == 0)
+					::close(op.fd);
+				op.fd = -1;
+				op.exclusive = false;
+			}
+			op.pending = 0;
+			runDirectly(op);
+		}
+#endif
+
+		IoUring* mRing;
+		std::vector<Op> mOps;
+	};
+
+}} // End namespace myrmo::util
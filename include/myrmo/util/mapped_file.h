@@ -0,0 +1,157 @@
+/* Copyright © 2019 Øystein Myrmo (oystein.myrmo@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <string>
+#include <cstddef>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace myrmo { namespace util
+{
+	// Read-only memory mapping of a file or of a range of it. The mapping stays valid after the file is unlinked,
+	// so a file can be removed while it is mapped. Empty ranges are opened without a mapping.
+	class MappedFile
+	{
+	public:
+		MappedFile() : mData(nullptr), mSize(0), mMapping(nullptr), mMappingSize(0), mOpen(false) {}
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		MappedFile(MappedFile&& other)
+			: mData(other.mData)
+			, mSize(other.mSize)
+			, mMapping(other.mMapping)
+			, mMappingSize(other.mMappingSize)
+			, mOpen(other.mOpen)
+		{
+			other.mData = nullptr;
+			other.mSize = 0;
+			other.mMapping = nullptr;
+			other.mMappingSize = 0;
+			other.mOpen = false;
+		}
+
+		MappedFile& operator=(MappedFile&& other)
+		{
+			if (this != &other)
+			{
+				close();
+				mData = other.mData;
+				mSize = other.mSize;
+				mMapping = other.mMapping;
+				mMappingSize = other.mMappingSize;
+				mOpen = other.mOpen;
+				other.mData = nullptr;
+				other.mSize = 0;
+				other.mMapping = nullptr;
+				other.mMappingSize = 0;
+				other.mOpen = false;
+			}
+			return *this;
+		}
+
+		~MappedFile()
+		{
+			close();
+		}
+
+		bool open(const std::string& path)
+		{
+			return open(path, 0, npos);
+		}
+
+		// Maps size bytes from offset, or up to the end of the file for npos. Fails if the range is outside the file.
+		bool open(const std::string& path, size_t offset, size_t size)
+		{
+			close();
+
+			const int fd = ::open(path.c_str(), O_RDONLY);
+			if (fd < 0)
+				return false;
+
+			struct stat st;
+			if (::fstat(fd, &st) != 0)
+			{
+				::close(fd);
+				return false;
+			}
+
+			const size_t fileSize = static_cast<size_t>(st.st_size);
+			if (size == npos)
+				size = (offset <= fileSize) ? fileSize - offset : 0;
+			if ((offset > fileSize) || (size > fileSize - offset))
+			{
+				::close(fd);
+				return false;
+			}
+
+			if (size > 0)
+			{
+				// Mappings start at a page boundary.
+				const size_t pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+				const size_t mappingOffset = offset - (offset % pageSize);
+				const size_t mappingSize = size + (offset - mappingOffset);
+				void* mapping = ::mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(mappingOffset));
+				if (mapping == MAP_FAILED)
+				{
+					::close(fd);
+					return false;
+				}
+				mMapping = mapping;
+				mMappingSize = mappingSize;
+				mData = static_cast<const char*>(mapping) + (offset - mappingOffset);
+				mSize = size;
+			}
+
+			::close(fd); // The mapping keeps its own reference to the file.
+			mOpen = true;
+			return true;
+		}
+
+		void close()
+		{
+			if (mMapping)
+				::munmap(mMapping, mMappingSize);
+			mData = nullptr;
+			mSize = 0;
+			mMapping = nullptr;
+			mMappingSize = 0;
+			mOpen = false;
+		}
+
+		static const size_t npos = static_cast<size_t>(-1);
+
+		const char* data() const { return mData; }
+		size_t size() const { return mSize; }
+		bool isOpen() const { return mOpen; }
+
+	private:
+		const char* mData;
+		size_t mSize;
+		void* mMapping;
+		size_t mMappingSize;
+		bool mOpen;
+	};
+
+}} // End namespace myrmo::util
@@ -0,0 +1,128 @@
+/* Copyright © 2019 Øystein Myrmo (oystein.myrmo@gmail.com)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <cstdint>
+#include <cassert>
+
+namespace myrmo { namespace util
+{
+	// Reader/writer lock for read-mostly data. Taking a shared lock is a single compare-and-swap when no writer
+	// holds or waits for the lock. Writers are serialized by a mutex, announce themselves so that new readers back
+	// off, and wait for the active readers to drain. Waiting threads yield rather than sleep, so the lock suits
+	// short critical sections.
+	class SharedMutex
+	{
+	public:
+		SharedMutex() : mState(0) {}
+		SharedMutex(const SharedMutex&) = delete;
+		SharedMutex& operator=(const SharedMutex&) = delete;
+
+		void lock()
+		{
+			mWriters.lock();
+			mState.fetch_or(WriterBit, std::memory_order_acquire);
+			while ((mState.load(std::memory_order_acquire) & ReaderMask) != 0)
+				std::this_thread::yield();
+		}
+
+		// Fails instead of waiting for another writer. Still waits for the active readers to drain.
+		bool try_lock()
+		{
+			if (!mWriters.try_lock())
+				return false;
+			mState.fetch_or(WriterBit, std::memory_order_acquire);
+			while ((mState.load(std::memory_order_acquire) & ReaderMask) != 0)
+				std::this_thread::yield();
+			return true;
+		}
+
+		void unlock()
+		{
+			mState.fetch_and(~WriterBit, std::memory_order_release);
+			mWriters.unlock();
+		}
+
+		void lock_shared()
+		{
+			uint32_t state = mState.load(std::memory_order_relaxed);
+			while (true)
+			{
+				if (state & WriterBit)
+				{
+					std::this_thread::yield();
+					state = mState.load(std::memory_order_relaxed);
+				}
+				else if (mState.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed))
+				{
+					return;
+				}
+			}
+		}
+
+		void unlock_shared()
+		{
+			const uint32_t previous = mState.fetch_sub(1, std::memory_order_release);
+			assert((previous & ReaderMask) > 0);
+			(void)previous;
+		}
+
+	private:
+		static constexpr uint32_t WriterBit = 0x80000000u;
+		static constexpr uint32_t ReaderMask = ~WriterBit;
+
+		std::atomic<uint32_t> mState;
+		std::mutex mWriters;
+	};
+
+	// Locks a SharedMutex in shared or exclusive mode, chosen at runtime.
+	class SharedMutexLock
+	{
+	public:
+		SharedMutexLock(SharedMutex& mutex, bool shared)
+			: mMutex(mutex)
+			, mShared(shared)
+		{
+			if (mShared)
+				mMutex.lock_shared();
+			else
+				mMutex.lock();
+		}
+
+		~SharedMutexLock()
+		{
+			if (mShared)
+				mMutex.unlock_shared();
+			else
+				mMutex.unlock();
+		}
+
+		SharedMutexLock(const SharedMutexLock&) = delete;
+		SharedMutexLock& operator=(const SharedMutexLock&) = delete;
+
+	private:
+		SharedMutex& mMutex;
+		const bool mShared;
+	};
+
+}} // End namespace myrmo::util
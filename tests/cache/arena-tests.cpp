@@ -0,0 +1,81 @@
+#include <myrmo/test/assert.h>
+#include <myrmo/cache/arena.h>
+
+#include <vector>
+#include <cstring>
+
+void test_allocate_free()
+{
+	using namespace myrmo::cache;
+
+	Arena arena(1000);
+	MYRMO_ASSERT(arena.capacity() == 1000);
+	MYRMO_ASSERT(arena.used() == 0);
+	MYRMO_ASSERT(arena.freeRangeCount() == 1);
+
+	const size_t a = arena.allocate(100);
+	const size_t b = arena.allocate(200);
+	const size_t c = arena.allocate(300);
+	MYRMO_ASSERT(a == 0);
+	MYRMO_ASSERT(b == 100);
+	MYRMO_ASSERT(c == 300);
+	MYRMO_ASSERT(arena.used() == 600);
+
+	// Not enough contiguous space.
+	MYRMO_ASSERT(arena.allocate(401) == Arena::npos);
+	MYRMO_ASSERT(!arena.canAllocate(401));
+	MYRMO_ASSERT(arena.canAllocate(400));
+
+	// Freeing the middle range leaves the others in place and creates a hole.
+	arena.free(b, 200);
+	MYRMO_ASSERT(arena.used() == 400);
+	MYRMO_ASSERT(arena.freeRangeCount() == 2);
+
+	// Best fit picks the hole over the larger free range at the end.
+	MYRMO_ASSERT(arena.allocate(150) == 100);
+	MYRMO_ASSERT(arena.allocate(50) == 250);
+	MYRMO_ASSERT(arena.freeRangeCount() == 1);
+
+	// Freed neighbours are coalesced.
+	arena.free(100, 150);
+	arena.free(250, 50);
+	arena.free(a, 100);
+	MYRMO_ASSERT(arena.freeRangeCount() == 2);
+	arena.free(c, 300);
+	MYRMO_ASSERT(arena.freeRangeCount() == 1);
+	MYRMO_ASSERT(arena.used() == 0);
+	MYRMO_ASSERT(arena.allocate(1000) == 0);
+
+	arena.clear();
+	MYRMO_ASSERT(arena.used() == 0);
+	MYRMO_ASSERT(arena.canAllocate(1000));
+}
+
+void test_data_is_not_moved()
+{
+	using namespace myrmo::cache;
+
+	Arena arena(64 * 10);
+	std::vector<size_t> offsets;
+	for (size_t i = 0; i < 10; i++)
+	{
+		offsets.push_back(arena.allocate(64));
+		memset(arena.data() + offsets.back(), int(i), 64);
+	}
+
+	for (size_t i = 0; i < 10; i += 2)
+		arena.free(offsets[i], 64);
+
+	for (size_t i = 1; i < 10; i += 2)
+	{
+		for (size_t j = 0; j < 64; j++)
+			MYRMO_ASSERT(arena.data()[offsets[i] + j] == char(i));
+	}
+}
+
+int main()
+{
+	test_allocate_free();
+	test_data_is_not_moved();
+	return 0;
+}
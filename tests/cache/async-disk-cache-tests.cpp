@@ -0,0 +1,158 @@
+#include <myrmo/test/assert.h>
+#include <myrmo/test/items.h>
+#include <myrmo/cache/async_disk.h>
+#include <myrmo/hash/sha1.h>
+
+#include <string>
+#include <vector>
+#include <future>
+#include <atomic>
+
+using myrmo::test::make_uri;
+using myrmo::test::make_item;
+
+static const myrmo::test::ItemSizes sizes(1000, 1000, 97);
+
+void test_write_read_remove()
+{
+	using namespace myrmo::cache;
+	const size_t itemCount = 200;
+
+	AsyncDiskCache cache(new DiskCache(MYRMO_TESTS_ASYNC_CACHE_DIR, myrmo::hash::sha1, new policy::LRU(), 50), 4);
+	MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+
+	std::vector<std::future<DiskCache::Error>> writes;
+	std::vector<char> data;
+	size_t size = 0;
+	for (size_t i = 0; i < itemCount; i++)
+	{
+		writes.push_back(cache.writeAsync(make_uri(i), make_item(i, sizes)));
+		size += make_item(i, sizes).size();
+
+		// Served from the queued data or from the disk, depending on how far the workers are.
+		MYRMO_ASSERT(cache.read(make_uri(i), &data) == DiskCache::Error::NoError);
+		MYRMO_ASSERT(data == make_item(i, sizes));
+	}
+
+	// A second write of an item fails whether the first one is queued or done.
+	MYRMO_ASSERT(cache.writeAsync(make_uri(0), make_item(0, sizes)).get() == DiskCache::Error::FileExists);
+
+	for (auto& write : writes)
+		MYRMO_ASSERT(write.get() == DiskCache::Error::NoError);
+	cache.flush();
+	MYRMO_ASSERT(cache.count() == itemCount);
+	MYRMO_ASSERT(cache.size() == size);
+	MYRMO_ASSERT(cache.queuedBytes() == 0);
+
+	for (size_t i = 0; i < itemCount; i++)
+	{
+		MYRMO_ASSERT(cache.read(make_uri(i), &data) == DiskCache::Error::NoError);
+		MYRMO_ASSERT(data == make_item(i, sizes));
+	}
+
+	std::atomic<size_t> removed(0);
+	for (size_t i = 0; i < itemCount; i += 2)
+	{
+		cache.removeAsync(make_uri(i), [&](DiskCache::Error error)
+		{
+			if (error == DiskCache::Error::NoError)
+				removed++;
+		});
+	}
+	cache.flush();
+	MYRMO_ASSERT(removed == itemCount / 2);
+	MYRMO_ASSERT(cache.count() == itemCount / 2);
+	for (size_t i = 0; i < itemCount; i++)
+		MYRMO_ASSERT(cache.read(make_uri(i), &data) == ((i % 2) ? DiskCache::Error::NoError : DiskCache::Error::FileDoesNotExist));
+
+	MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+	MYRMO_ASSERT(cache.count() == 0);
+}
+
+void test_write_then_remove()
+{
+	using namespace myrmo::cache;
+
+	AsyncDiskCache cache(new DiskCache(MYRMO_TESTS_ASYNC_CACHE_DIR, myrmo::hash::sha1, new policy::LRU(), 50), 2);
+	std::vector<char> data;
+
+	// Whether the remove cancels the queued write or deletes the written item, both succeed and the item is gone.
+	for (size_t i = 0; i < 100; i++)
+	{
+		std::future<DiskCache::Error> write = cache.writeAsync(make_uri(i), make_item(i, sizes));
+		std::future<DiskCache::Error> remove = cache.removeAsync(make_uri(i));
+		MYRMO_ASSERT(cache.read(make_uri(i), &data) == DiskCache::Error::FileDoesNotExist);
+		MYRMO_ASSERT(write.get() == DiskCache::Error::NoError);
+		MYRMO_ASSERT(remove.get() == DiskCache::Error::NoError);
+	}
+	cache.flush();
+	MYRMO_ASSERT(cache.count() == 0);
+	MYRMO_ASSERT(cache.size() == 0);
+
+	// Operations on an item complete in order.
+	for (size_t round = 0; round < 3; round++)
+	{
+		MYRMO_ASSERT(cache.writeAsync(make_uri(0), make_item(round, sizes)).get() == DiskCache::Error::NoError);
+		MYRMO_ASSERT(cache.read(make_uri(0), &data) == DiskCache::Error::NoError);
+		MYRMO_ASSERT(data == make_item(round, sizes));
+		MYRMO_ASSERT(cache.removeAsync(make_uri(0)).get() == DiskCache::Error::NoError);
+	}
+	MYRMO_ASSERT(cache.count() == 0);
+}
+
+void test_backpressure()
+{
+	using namespace myrmo::cache;
+	const size_t maxQueuedBytes = 200000;
+
+	AsyncDiskCache cache(new DiskCache(MYRMO_TESTS_ASYNC_CACHE_DIR, myrmo::hash::sha1, new policy::LRU(), 1), 2, maxQueuedBytes);
+	MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+
+	std::vector<std::future<DiskCache::Error>> writes;
+	for (size_t i = 0; i < 300; i++)
+	{
+		writes.push_back(cache.writeAsync(make_uri(i), make_item(i, sizes)));
+		MYRMO_ASSERT(cache.queuedBytes() <= maxQueuedBytes);
+	}
+
+	// Larger than the bound, accepted once the queue has drained.
+	writes.push_back(cache.writeAsync("large", std::vector<char>(2 * maxQueuedBytes, 'x')));
+
+	for (auto& write : writes)
+		MYRMO_ASSERT(write.get() == DiskCache::Error::NoError);
+	MYRMO_ASSERT(cache.size() <= 1048576);
+
+	MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+}
+
+void test_segments()
+{
+	using namespace myrmo::cache;
+
+	AsyncDiskCache cache(new DiskCache(MYRMO_TESTS_ASYNC_CACHE_DIR, myrmo::hash::sha1, new policy::LRU(), 50, DiskCache::SegmentOptions(4096)), 4);
+	MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+
+	std::vector<std::future<DiskCache::Error>> writes;
+	for (size_t i = 0; i < 500; i++)
+		writes.push_back(cache.writeAsync(make_uri(i), make_item(i, sizes)));
+	for (auto& write : writes)
+		MYRMO_ASSERT(write.get() == DiskCache::Error::NoError);
+
+	std::vector<char> data;
+	for (size_t i = 0; i < 500; i++)
+	{
+		MYRMO_ASSERT(cache.read(make_uri(i), &data) == DiskCache::Error::NoError);
+		MYRMO_ASSERT(data == make_item(i, sizes));
+	}
+
+	MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+}
+
+int main()
+{
+	test_write_read_remove();
+	test_write_then_remove();
+	test_backpressure();
+	test_segments();
+	return 0;
+}
@@ -5,6 +5,11 @@
 #include <string>
 #include <cstdio>
 #include <array>
+#include <fstream>
+#include <iterator>
+
+#include <dirent.h>
+#include <sys/stat.h>
 
 #include <cmrc/cmrc.hpp>
 
@@ -246,6 +251,786 @@ void test_disk_cache_eviction_policy()
 	MYRMO_ASSERT(cache.count() == 0);
 }
 
+void test_clock_policy()
+{
+	using namespace myrmo::cache;
+	const size_t cacheSizeInMiB = 1;
+	size_t count = 0;
+	size_t size = 0;
+
+	{
+		DiskCache cache(MYRMO_TESTS_CACHE_DIR, myrmo::hash::sha1, new policy::CLOCK(), cacheSizeInMiB);
+		std::vector<char> data;
+
+		for (size_t i = 0; i < IMAGE_COUNT; i++)
+		{
+			MYRMO_ASSERT(insertImage(cache, i) == DiskCache::Error::NoError);
+			MYRMO_ASSERT(imageExists(cache, 0, &data) == DiskCache::Error::NoError); // Keep image 0 referenced.
+		}
+		MYRMO_ASSERT(cache.size() <= cacheSizeInMiB * 1048576);
+		MYRMO_ASSERT(imageExists(cache, 0, &data) == DiskCache::Error::NoError);
+		MYRMO_ASSERT(imageExists(cache, IMAGE_COUNT - 1, &data) == DiskCache::Error::NoError);
+		count = cache.count();
+		size = cache.size();
+	}
+
+	DiskCache cache(MYRMO_TESTS_CACHE_DIR, myrmo::hash::sha1, new policy::CLOCK(), cacheSizeInMiB);
+	std::vector<char> data;
+	MYRMO_ASSERT(cache.count() == count);
+	MYRMO_ASSERT(cache.size() == size);
+	MYRMO_ASSERT(imageExists(cache, 0, &data) == DiskCache::Error::NoError);
+
+	MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+	MYRMO_ASSERT(cache.size() == 0);
+	MYRMO_ASSERT(cache.count() == 0);
+}
+
+static std::string read_file(const std::string& path)
+{
+	std::ifstream f(path, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+}
+
+static void write_file(const std::string& path, const std::string& data)
+{
+	std::ofstream f(path, std::ios::binary | std::ios::trunc);
+	f.write(data.data(), data.size());
+}
+
+void test_mapped_views()
+{
+	using namespace myrmo::cache;
+	const size_t cacheSizeInMiB = 1;
+	DiskCache cache(MYRMO_TESTS_CACHE_DIR, myrmo::hash::sha1, new policy::LRU(), cacheSizeInMiB);
+	const std::string image0(get_file(images[0].name));
+
+	DiskCache::View view;
+	MYRMO_ASSERT(!view.valid());
+	MYRMO_ASSERT(cache.read(images[0].name, &view) == DiskCache::Error::FileDoesNotExist);
+	MYRMO_ASSERT(insertImage(cache, 0) == DiskCache::Error::NoError);
+	MYRMO_ASSERT(cache.read(images[0].name, &view) == DiskCache::Error::NoError);
+	MYRMO_ASSERT(view.valid());
+	MYRMO_ASSERT(view.size() == image0.size());
+	MYRMO_ASSERT(memcmp(view.data(), image0.data(), image0.size()) == 0);
+
+	// The pinned item survives writes that evict everything else.
+	for (size_t i = 1; i < IMAGE_COUNT; i++)
+		MYRMO_ASSERT(insertImage(cache, i) == DiskCache::Error::NoError);
+	MYRMO_ASSERT(cache.size() <= cacheSizeInMiB * 1048576);
+	std::vector<char> data;
+	MYRMO_ASSERT(imageExists(cache, 0, &data) == DiskCache::Error::NoError);
+	MYRMO_ASSERT(imageExists(cache, 1, &data) == DiskCache::Error::FileDoesNotExist);
+
+	// Removing a pinned item unlinks its file, but the view stays readable.
+	MYRMO_ASSERT(deleteImage(cache, 0) == DiskCache::Error::NoError);
+	MYRMO_ASSERT(imageExists(cache, 0, &data) == DiskCache::Error::FileDoesNotExist);
+	MYRMO_ASSERT(view.size() == image0.size());
+	MYRMO_ASSERT(memcmp(view.data(), image0.data(), image0.size()) == 0);
+
+	// A view of the removed item does not unpin the item written again under the same uri.
+	DiskCache::View view2;
+	MYRMO_ASSERT(insertImage(cache, 0) == DiskCache::Error::NoError);
+	MYRMO_ASSERT(cache.read(images[0].name, &view2) == DiskCache::Error::NoError);
+	view.release();
+	MYRMO_ASSERT(!view.valid());
+	for (size_t i = 1; i < IMAGE_COUNT; i++)
+		MYRMO_ASSERT(insertImage(cache, i) == DiskCache::Error::NoError || imageExists(cache, i, &data) == DiskCache::Error::NoError);
+	MYRMO_ASSERT(imageExists(cache, 0, &data) == DiskCache::Error::NoError);
+
+	// Nothing can be evicted while everything is pinned.
+	MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+	std::vector<std::string> uris;
+	for (size_t i = 0; i < 3; i++)
+	{
+		MYRMO_ASSERT(insertImage(cache, i) == DiskCache::Error::NoError);
+		uris.push_back(images[i].name);
+	}
+	std::vector<DiskCache::View> views;
+	std::vector<DiskCache::Error> errors = cache.readMany(uris, &views);
+	for (size_t i = 0; i < 3; i++)
+	{
+		MYRMO_ASSERT(errors[i] == DiskCache::Error::NoError);
+		MYRMO_ASSERT(views[i].size() == size_t(images[i].size));
+	}
+	MYRMO_ASSERT(insertImage(cache, 3) == DiskCache::Error::CouldNotClearSpaceForFile);
+	views.clear();
+	MYRMO_ASSERT(insertImage(cache, 3) == DiskCache::Error::NoError);
+
+	view2.release();
+	MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+}
+
+void test_streaming()
+{
+	using namespace myrmo::cache;
+	const size_t cacheSizeInMiB = 4;
+	const size_t blockSize = 65536;
+	DiskCache cache(MYRMO_TESTS_CACHE_DIR, myrmo::hash::sha1, new policy::LRU(), cacheSizeInMiB);
+	MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+
+	std::string blob(3 * 1048576 + 1234, '\0');
+	for (size_t i = 0; i < blob.size(); i++)
+		blob[i] = char((i * 2654435761u) >> 13);
+
+	// Space is reserved up front: with 1.5 MiB cached, opening a 3 MiB writer evicts the older images.
+	for (size_t i = 0; i < 6; i++)
+		MYRMO_ASSERT(insertImage(cache, i) == DiskCache::Error::NoError);
+	DiskCache::Writer writer;
+	MYRMO_ASSERT(cache.openWriter("blob", 5 * 1048576, &writer) == DiskCache::Error::FileSizeGreaterThanMaxCacheSize);
+	MYRMO_ASSERT(cache.openWriter("blob", blob.size(), &writer) == DiskCache::Error::NoError);
+	MYRMO_ASSERT(writer.valid());
+	MYRMO_ASSERT(cache.size() + blob.size() <= cacheSizeInMiB * 1048576);
+	const size_t sizeBeforeCommit = cache.size();
+	const size_t countBeforeCommit = cache.count();
+
+	DiskCache::Writer other;
+	MYRMO_ASSERT(cache.openWriter("blob", 10, &other) == DiskCache::Error::FileExists);
+
+	// Nothing is visible before the commit.
+	for (size_t offset = 0; offset < blob.size(); offset += blockSize)
+		MYRMO_ASSERT(writer.write(&blob[offset], std::min(blockSize, blob.size() - offset)) == DiskCache::Error::NoError);
+	MYRMO_ASSERT(writer.write("x", 1) == DiskCache::Error::SizeExceedsExpectedSize);
+	std::vector<char> data;
+	MYRMO_ASSERT(cache.read("blob", &data) == DiskCache::Error::FileDoesNotExist);
+	MYRMO_ASSERT(cache.size() == sizeBeforeCommit);
+
+	MYRMO_ASSERT(writer.commit() == DiskCache::Error::NoError);
+	MYRMO_ASSERT(!writer.valid());
+	MYRMO_ASSERT(cache.size() == sizeBeforeCommit + blob.size());
+	MYRMO_ASSERT(cache.count() == countBeforeCommit + 1);
+
+	DiskCache::Reader reader;
+	MYRMO_ASSERT(cache.openReader("does_not_exist", &reader) == DiskCache::Error::FileDoesNotExist);
+	MYRMO_ASSERT(cache.openReader("blob", &reader) == DiskCache::Error::NoError);
+	MYRMO_ASSERT(reader.size() == blob.size());
+	std::string readBack;
+	std::vector<char> block(blockSize);
+	while (!reader.eof())
+	{
+		const size_t count = reader.read(block.data(), block.size());
+		MYRMO_ASSERT(count > 0);
+		readBack.append(block.data(), count);
+	}
+	MYRMO_ASSERT(reader.read(block.data(), block.size()) == 0);
+	MYRMO_ASSERT(readBack == blob);
+
+	// The reader pins the item.
+	for (size_t i = 0; i < 6; i++)
+		MYRMO_ASSERT(insertImage(cache, i) == DiskCache::Error::NoError || imageExists(cache, i, &data) == DiskCache::Error::NoError);
+	MYRMO_ASSERT(cache.openReader("blob", &reader) == DiskCache::Error::NoError);
+	reader.release();
+
+	// An aborted writer leaves nothing behind and releases its reservation.
+	const size_t sizeBeforeAbort = cache.size();
+	{
+		DiskCache::Writer aborted;
+		MYRMO_ASSERT(cache.openWriter("aborted", 1000, &aborted) == DiskCache::Error::NoError);
+		MYRMO_ASSERT(aborted.write(blob.data(), 1000) == DiskCache::Error::NoError);
+	}
+	MYRMO_ASSERT(cache.read("aborted", &data) == DiskCache::Error::FileDoesNotExist);
+	MYRMO_ASSERT(!std::ifstream(std::string(MYRMO_TESTS_CACHE_DIR) + "/" + myrmo::hash::sha1("aborted") + ".tmp").good());
+	MYRMO_ASSERT(cache.size() == sizeBeforeAbort);
+	MYRMO_ASSERT(cache.openWriter("aborted", 1000, &writer) == DiskCache::Error::NoError);
+	MYRMO_ASSERT(writer.write(blob.data(), 10) == DiskCache::Error::NoError);
+	MYRMO_ASSERT(writer.commit() == DiskCache::Error::NoError);
+	MYRMO_ASSERT(cache.size() == sizeBeforeAbort + 10); // Only what was written is accounted after the commit.
+
+	MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+}
+
+void test_journal_replay()
+{
+	using namespace myrmo::cache;
+	const std::string indexPath = std::string(MYRMO_TESTS_CACHE_DIR) + "/" + myrmo::hash::sha1("myrmo_disk_cache_index");
+	const std::string journalPath = std::string(MYRMO_TESTS_CACHE_DIR) + "/" + myrmo::hash::sha1("myrmo_disk_cache_journal");
+	const size_t cacheSizeInMiB = 1;
+	std::vector<char> data;
+	std::string index;
+	std::string journal;
+	std::vector<bool> cached(IMAGE_COUNT, false);
+	size_t count = 0;
+	size_t size = 0;
+
+	{
+		DiskCache cache(MYRMO_TESTS_CACHE_DIR, myrmo::hash::sha1, new policy::LRU(), cacheSizeInMiB);
+		MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+		MYRMO_ASSERT(read_file(journalPath).size() == 16);
+
+		for (size_t i = 0; i < 10; i++)
+			MYRMO_ASSERT(insertImage(cache, i) == DiskCache::Error::NoError);
+		MYRMO_ASSERT(imageExists(cache, 6, &data) == DiskCache::Error::NoError);
+		MYRMO_ASSERT(insertImage(cache, 10) == DiskCache::Error::NoError);
+		MYRMO_ASSERT(cache.remove(images[9].name) == DiskCache::Error::NoError);
+
+		// Writes only append to the journal, the snapshot is still the empty one written by clear().
+		index = read_file(indexPath);
+		journal = read_file(journalPath);
+		MYRMO_ASSERT(index.size() == 16); // Header only.
+		MYRMO_ASSERT(journal.size() > 16);
+		MYRMO_ASSERT((journal.size() - 16) % 66 == 0); // Record type, sha1 hex digest and entry.
+
+		count = cache.count();
+		size = cache.size();
+		for (size_t i = 0; i < IMAGE_COUNT; i++)
+			cached[i] = imageExists(cache, i, &data) == DiskCache::Error::NoError;
+	}
+
+	// Simulate a crash before the destructor wrote a new snapshot.
+	write_file(indexPath, index);
+	write_file(journalPath, journal);
+
+	DiskCache cache(MYRMO_TESTS_CACHE_DIR, myrmo::hash::sha1, new policy::LRU(), cacheSizeInMiB);
+	MYRMO_ASSERT(cache.count() == count);
+	MYRMO_ASSERT(cache.size() == size);
+	for (size_t i = 0; i < IMAGE_COUNT; i++)
+		MYRMO_ASSERT((imageExists(cache, i, &data) == DiskCache::Error::NoError) == cached[i]);
+	MYRMO_ASSERT(!cached[9]);
+	MYRMO_ASSERT(cached[6]);
+
+	MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+}
+
+void test_index_migration()
+{
+	using namespace myrmo::cache;
+	const std::string dir(MYRMO_TESTS_CACHE_DIR);
+	const std::string indexPath = dir + "/" + myrmo::hash::sha1("myrmo_disk_cache_index");
+	const std::string journalPath = dir + "/" + myrmo::hash::sha1("myrmo_disk_cache_journal");
+
+	// Version 0 index: hashes only, without header or sizes.
+	std::string index;
+	size_t size = 0;
+	for (size_t i = 0; i < 3; i++)
+	{
+		write_file(dir + "/" + myrmo::hash::sha1(images[i].name), get_file(images[i].name));
+		index += myrmo::hash::sha1(images[i].name);
+		size += images[i].size;
+	}
+	index += myrmo::hash::sha1("missing");
+	write_file(indexPath, index);
+	std::remove(journalPath.c_str());
+
+	{
+		DiskCache cache(MYRMO_TESTS_CACHE_DIR, myrmo::hash::sha1, new policy::LRU());
+		MYRMO_ASSERT(cache.count() == 3); // The entry without a file is dropped.
+		MYRMO_ASSERT(cache.size() == size);
+	}
+
+	MYRMO_ASSERT(read_file(indexPath).compare(0, 8, "MYRMOIDX") == 0);
+	MYRMO_ASSERT(read_file(indexPath).size() == 16 + 3 * 65);
+
+	// Version 1 index: entries hold the size only.
+	index = std::string("MYRMOIDX") + std::string("\x01\0\0\0\x28\0\0\0", 8);
+	for (size_t i = 0; i < 3; i++)
+	{
+		index += myrmo::hash::sha1(images[i].name);
+		for (size_t byte = 0; byte < 8; byte++)
+			index.push_back(char((uint64_t(images[i].size) >> (8 * byte)) & 0xff));
+	}
+	write_file(indexPath, index);
+	std::remove(journalPath.c_str());
+
+	DiskCache cache(MYRMO_TESTS_CACHE_DIR, myrmo::hash::sha1, new policy::LRU());
+	MYRMO_ASSERT(cache.count() == 3);
+	MYRMO_ASSERT(cache.size() == size);
+	std::vector<char> data;
+	for (size_t i = 0; i < 3; i++)
+		MYRMO_ASSERT(imageExists(cache, i, &data) == DiskCache::Error::NoError);
+	MYRMO_ASSERT(read_file(indexPath).size() == 16 + 3 * 65);
+	MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+}
+
+static std::string small_item(size_t i)
+{
+	std::string item(500 + (i * 7919) % 1000, char('a' + i % 26));
+	const std::string id = std::to_string(i);
+	item.replace(0, id.size(), id);
+	return item;
+}
+
+// Returns the number of segment files and adds up their sizes.
+static size_t segment_files(size_t* totalSize)
+{
+	size_t count = 0;
+	*totalSize = 0;
+	DIR* dir = opendir(MYRMO_TESTS_CACHE_DIR);
+	while (dirent* entry = readdir(dir))
+	{
+		const std::string name(entry->d_name);
+		if (name.compare(0, 8, "segment-") == 0)
+		{
+			count++;
+			*totalSize += read_file(std::string(MYRMO_TESTS_CACHE_DIR) + "/" + name).size();
+		}
+	}
+	closedir(dir);
+	return count;
+}
+
+void test_segments()
+{
+	using namespace myrmo::cache;
+	const size_t cacheSizeInMiB = 1;
+	const size_t itemCount = 5000;
+	const DiskCache::SegmentOptions segments(4096, 65536);
+	std::vector<char> data;
+	size_t count = 0;
+	size_t size = 0;
+
+	{
+		DiskCache cache(MYRMO_TESTS_CACHE_DIR, myrmo::hash::sha1, new policy::LRU(), cacheSizeInMiB, segments);
+		MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+
+		for (size_t i = 0; i < itemCount; i++)
+			MYRMO_ASSERT(cache.write("item" + std::to_string(i), small_item(i)) == DiskCache::Error::NoError);
+		MYRMO_ASSERT(cache.size() <= cacheSizeInMiB * 1048576);
+		MYRMO_ASSERT(cache.count() < itemCount);
+		MYRMO_ASSERT(!std::ifstream(std::string(MYRMO_TESTS_CACHE_DIR) + "/" + myrmo::hash::sha1("item" + std::to_string(itemCount - 1))).good());
+
+		// Evicted entries are collected, so the segments hold at most about twice the live bytes.
+		size_t segmentsSize = 0;
+		const size_t segmentCount = segment_files(&segmentsSize);
+		MYRMO_ASSERT(segmentCount > 1);
+		MYRMO_ASSERT(segmentsSize <= 2 * cache.size() + 2 * segments.segmentSize);
+
+		// Large entries still get a file of their own.
+		MYRMO_ASSERT(insertImage(cache, IMAGE_COUNT - 1) == DiskCache::Error::NoError);
+		MYRMO_ASSERT(std::ifstream(std::string(MYRMO_TESTS_CACHE_DIR) + "/" + myrmo::hash::sha1(images[IMAGE_COUNT - 1].name)).good());
+
+		for (size_t i = itemCount - 100; i < itemCount; i++)
+		{
+			const std::string item(small_item(i));
+			MYRMO_ASSERT(cache.read("item" + std::to_string(i), &data) == DiskCache::Error::NoError);
+			MYRMO_ASSERT(std::string(data.begin(), data.end()) == item);
+		}
+		count = cache.count();
+		size = cache.size();
+	}
+
+	DiskCache cache(MYRMO_TESTS_CACHE_DIR, myrmo::hash::sha1, new policy::LRU(), cacheSizeInMiB, segments);
+	MYRMO_ASSERT(cache.count() == count);
+	MYRMO_ASSERT(cache.size() == size);
+	for (size_t i = itemCount - 100; i < itemCount; i++)
+	{
+		const std::string item(small_item(i));
+		MYRMO_ASSERT(cache.read("item" + std::to_string(i), &data) == DiskCache::Error::NoError);
+		MYRMO_ASSERT(std::string(data.begin(), data.end()) == item);
+	}
+
+	// Views and readers of entries in a segment, which stay valid when the segment is collected.
+	const std::string uri("item" + std::to_string(itemCount - 1));
+	const std::string item(small_item(itemCount - 1));
+	DiskCache::View view;
+	MYRMO_ASSERT(cache.read(uri, &view) == DiskCache::Error::NoError);
+	MYRMO_ASSERT(std::string(view.begin(), view.end()) == item);
+	DiskCache::Reader reader;
+	MYRMO_ASSERT(cache.openReader(uri, &reader) == DiskCache::Error::NoError);
+	char block[100];
+	std::string readBack;
+	while (size_t n = reader.read(block, sizeof(block)))
+		readBack.append(block, n);
+	MYRMO_ASSERT(readBack == item);
+	reader.release();
+
+	for (size_t i = itemCount; i < 2 * itemCount; i++)
+		MYRMO_ASSERT(cache.write("item" + std::to_string(i), small_item(i)) == DiskCache::Error::NoError);
+	MYRMO_ASSERT(cache.read(uri, &data) == DiskCache::Error::NoError); // Pinned by the view.
+	MYRMO_ASSERT(std::string(data.begin(), data.end()) == item);
+	MYRMO_ASSERT(cache.remove(uri) == DiskCache::Error::NoError);
+	for (size_t i = 2 * itemCount; i < 3 * itemCount; i++)
+		MYRMO_ASSERT(cache.write("item" + std::to_string(i), small_item(i)) == DiskCache::Error::NoError);
+	MYRMO_ASSERT(std::string(view.begin(), view.end()) == item);
+	view.release();
+
+	MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+	size_t segmentsSize = 0;
+	MYRMO_ASSERT(segment_files(&segmentsSize) == 0);
+}
+
+void test_binary_keys()
+{
+	using namespace myrmo::cache;
+	typedef std::array<uint8_t, 20> Digest;
+	typedef BasicDiskCache<Digest> Cache;
+
+	{
+		Cache cache(MYRMO_TESTS_CACHE_DIR, myrmo::hash::sha1_digest, new policy::BasicLRU<Digest>(), 1);
+		for (size_t i = 0; i < IMAGE_COUNT; i++)
+			MYRMO_ASSERT(cache.write(images[i].name, get_file(images[i].name)) == Cache::Error::NoError);
+		MYRMO_ASSERT(cache.count() == 6);
+	}
+
+	// The binary index is restored, and files are named by the hex form of the digest, like string keys.
+	Cache cache(MYRMO_TESTS_CACHE_DIR, myrmo::hash::sha1_digest, new policy::BasicLRU<Digest>(), 1);
+	MYRMO_ASSERT(cache.count() == 6);
+	std::vector<char> data;
+	for (size_t i = IMAGE_COUNT - 6; i < IMAGE_COUNT; i++)
+	{
+		const std::string image(get_file(images[i].name));
+		MYRMO_ASSERT(cache.read(images[i].name, &data) == Cache::Error::NoError);
+		MYRMO_ASSERT(image.size() == data.size());
+		MYRMO_ASSERT(memcmp(image.data(), data.data(), data.size()) == 0);
+
+		std::ifstream f(std::string(MYRMO_TESTS_CACHE_DIR) + "/" + myrmo::hash::sha1(images[i].name), std::ios::binary);
+		MYRMO_ASSERT(f.good());
+	}
+
+	MYRMO_ASSERT(cache.clear() == Cache::Error::NoError);
+	MYRMO_ASSERT(cache.count() == 0);
+}
+
+void test_batches(myrmo::cache::DiskCache::IoBackend backend, myrmo::cache::DiskCache::batchHashFunction batchHash)
+{
+	using namespace myrmo::cache;
+
+	std::vector<std::string> uris;
+	std::vector<std::string> files;
+	for (size_t i = 0; i < IMAGE_COUNT; i++)
+	{
+		uris.push_back(images[i].name);
+		files.push_back(get_file(images[i].name));
+	}
+
+	std::vector<WriteItem> items;
+	for (size_t i = 0; i < IMAGE_COUNT; i++)
+		items.push_back(WriteItem(uris[i], files[i]));
+	items.push_back(WriteItem(uris[0], files[0])); // Duplicate within the batch.
+
+	{
+		DiskCache cache(MYRMO_TESTS_CACHE_DIR, myrmo::hash::sha1, new policy::LRU(), 10, DiskCache::SegmentOptions(), backend);
+		cache.setBatchHashFunction(batchHash);
+		MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+		std::vector<DiskCache::Error> errors = cache.writeMany(items);
+		MYRMO_ASSERT(errors.size() == IMAGE_COUNT + 1);
+		for (size_t i = 0; i < IMAGE_COUNT; i++)
+			MYRMO_ASSERT(errors[i] == DiskCache::Error::NoError);
+		MYRMO_ASSERT(errors[IMAGE_COUNT] == DiskCache::Error::FileExists);
+		MYRMO_ASSERT(cache.count() == IMAGE_COUNT);
+		MYRMO_ASSERT(cache.size() == allImagesSize());
+	}
+
+	{
+		// The index file written once for the batch is complete.
+		DiskCache cache(MYRMO_TESTS_CACHE_DIR, myrmo::hash::sha1, new policy::LRU(), 10, DiskCache::SegmentOptions(), backend);
+		cache.setBatchHashFunction(batchHash);
+		MYRMO_ASSERT(cache.count() == IMAGE_COUNT);
+		MYRMO_ASSERT(cache.size() == allImagesSize());
+
+		std::vector<std::string> readUris(uris);
+		readUris.push_back("does_not_exist");
+		std::vector<std::vector<char>> data;
+		std::vector<DiskCache::Error> errors = cache.readMany(readUris, &data);
+		MYRMO_ASSERT(errors.size() == IMAGE_COUNT + 1);
+		for (size_t i = 0; i < IMAGE_COUNT; i++)
+		{
+			MYRMO_ASSERT(errors[i] == DiskCache::Error::NoError);
+			MYRMO_ASSERT(data[i].size() == files[i].size());
+			MYRMO_ASSERT(memcmp(data[i].data(), files[i].data(), files[i].size()) == 0);
+		}
+		MYRMO_ASSERT(errors[IMAGE_COUNT] == DiskCache::Error::FileDoesNotExist);
+		MYRMO_ASSERT(data[IMAGE_COUNT].empty());
+		MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+	}
+
+	{
+		// A batch larger than the cache behaves like the same writes one by one.
+		DiskCache cache(MYRMO_TESTS_CACHE_DIR, myrmo::hash::sha1, new policy::LRU(), 1, DiskCache::SegmentOptions(), backend);
+		cache.setBatchHashFunction(batchHash);
+		std::vector<DiskCache::Error> errors = cache.writeMany(std::vector<WriteItem>(items.begin(), items.begin() + IMAGE_COUNT));
+		for (size_t i = 0; i < IMAGE_COUNT; i++)
+			MYRMO_ASSERT(errors[i] == DiskCache::Error::NoError);
+		MYRMO_ASSERT(cache.count() == 6);
+		MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+	}
+
+	{
+		// Small items go to segments, the rest are written in the batch. Later batches evict earlier ones.
+		DiskCache cache(MYRMO_TESTS_CACHE_DIR, myrmo::hash::sha1, new policy::LRU(), 1, DiskCache::SegmentOptions(4096), backend);
+		cache.setBatchHashFunction(batchHash);
+		std::vector<std::string> smallUris;
+		std::vector<std::string> smallItems;
+		for (size_t i = 0; i < 400; i++)
+		{
+			smallUris.push_back("batch_item_" + std::to_string(i));
+			smallItems.push_back(std::string(1000 + (i % 8) * 1000, char('a' + i % 26)));
+		}
+
+		for (size_t begin = 0; begin < smallUris.size(); begin += 100)
+		{
+			std::vector<WriteItem> batch;
+			for (size_t i = begin; i < begin + 100; i++)
+				batch.push_back(WriteItem(smallUris[i], smallItems[i]));
+			std::vector<DiskCache::Error> errors = cache.writeMany(batch);
+			for (const DiskCache::Error error : errors)
+				MYRMO_ASSERT(error == DiskCache::Error::NoError);
+			MYRMO_ASSERT(cache.size() <= 1048576);
+		}
+
+		// Writing the last batch again evicts nothing, as its items exist.
+		const size_t count = cache.count();
+		std::vector<WriteItem> again;
+		for (size_t i = smallUris.size() - 100; i < smallUris.size(); i++)
+			again.push_back(WriteItem(smallUris[i], smallItems[i]));
+		for (const DiskCache::Error error : cache.writeMany(again))
+			MYRMO_ASSERT(error == DiskCache::Error::FileExists);
+		MYRMO_ASSERT(cache.count() == count);
+
+		std::vector<std::vector<char>> data;
+		std::vector<DiskCache::Error> errors = cache.readMany(smallUris, &data);
+		size_t hits = 0;
+		for (size_t i = 0; i < smallUris.size(); i++)
+		{
+			if (errors[i] != DiskCache::Error::NoError)
+				continue;
+			hits++;
+			MYRMO_ASSERT(std::string(data[i].begin(), data[i].end()) == smallItems[i]);
+		}
+		MYRMO_ASSERT(hits == cache.count());
+		MYRMO_ASSERT(errors.back() == DiskCache::Error::NoError); // The last batch is not evicted.
+		MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+	}
+}
+
+static bool file_exists(const std::string& path)
+{
+	struct stat st;
+	return stat(path.c_str(), &st) == 0;
+}
+
+void test_directory_layout()
+{
+	using namespace myrmo::cache;
+	const std::string dir(MYRMO_TESTS_LAYOUT_CACHE_DIR);
+	const std::string indexPath = dir + "/" + myrmo::hash::sha1("myrmo_disk_cache_index");
+	const std::string journalPath = dir + "/" + myrmo::hash::sha1("myrmo_disk_cache_journal");
+	const size_t itemCount = 50;
+	const DiskCache::DirectoryLayout twoLevels(2, 2, 3);
+	size_t size = 0;
+
+	{
+		DiskCache cache(dir, myrmo::hash::sha1, new policy::LRU(), 10, DiskCache::SegmentOptions(), DiskCache::IoBackend::Streams, twoLevels);
+		MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+		for (size_t i = 0; i < itemCount; i++)
+		{
+			MYRMO_ASSERT(cache.write(std::to_string(i), small_item(i)) == DiskCache::Error::NoError);
+			size += small_item(i).size();
+		}
+
+		const std::string hash = myrmo::hash::sha1("0");
+		MYRMO_ASSERT(file_exists(dir + "/" + hash.substr(0, 2) + "/" + hash.substr(2, 2) + "/" + hash));
+		MYRMO_ASSERT(!file_exists(dir + "/" + hash));
+	}
+
+	// Without an index, the scan finds every item again.
+	MYRMO_ASSERT(std::remove(indexPath.c_str()) == 0);
+	MYRMO_ASSERT(std::remove(journalPath.c_str()) == 0);
+	write_file(dir + "/" + myrmo::hash::sha1("stale") + ".tmp", "unfinished write");
+	write_file(dir + "/segment-7", "segment without entries");
+	write_file(dir + "/notes.txt", "not an item");
+	{
+		DiskCache cache(dir, myrmo::hash::sha1, new policy::LRU(), 10, DiskCache::SegmentOptions(), DiskCache::IoBackend::Streams, twoLevels);
+		MYRMO_ASSERT(cache.count() == itemCount);
+		MYRMO_ASSERT(cache.size() == size);
+		std::vector<char> data;
+		for (size_t i = 0; i < itemCount; i++)
+		{
+			MYRMO_ASSERT(cache.read(std::to_string(i), &data) == DiskCache::Error::NoError);
+			MYRMO_ASSERT(std::string(data.begin(), data.end()) == small_item(i));
+		}
+	}
+	MYRMO_ASSERT(!file_exists(dir + "/" + myrmo::hash::sha1("stale") + ".tmp"));
+	MYRMO_ASSERT(!file_exists(dir + "/segment-7"));
+	MYRMO_ASSERT(file_exists(dir + "/notes.txt"));
+	std::remove((dir + "/notes.txt").c_str());
+
+	// A truncated index is recovered the same way.
+	{
+		const std::string index = read_file(indexPath);
+		write_file(indexPath, index.substr(0, index.size() - 7));
+		DiskCache cache(dir, myrmo::hash::sha1, new policy::LRU(), 10, DiskCache::SegmentOptions(), DiskCache::IoBackend::Streams, twoLevels);
+		MYRMO_ASSERT(cache.count() == itemCount);
+		MYRMO_ASSERT(cache.size() == size);
+	}
+
+	// A change of layout moves the files and removes the directories of the old layout.
+	const std::string hash = myrmo::hash::sha1("1");
+	{
+		DiskCache cache(dir, myrmo::hash::sha1, new policy::LRU(), 10, DiskCache::SegmentOptions(), DiskCache::IoBackend::Streams, DiskCache::DirectoryLayout(10, 1));
+		MYRMO_ASSERT(cache.count() == itemCount);
+		std::string path(dir);
+		for (size_t level = 0; level < 10; level++)
+			path += "/" + hash.substr(level, 1);
+		MYRMO_ASSERT(file_exists(path + "/" + hash));
+	}
+	for (const size_t levels : { 1, 0 })
+	{
+		DiskCache cache(dir, myrmo::hash::sha1, new policy::LRU(), 10, DiskCache::SegmentOptions(), DiskCache::IoBackend::Streams, DiskCache::DirectoryLayout(levels, 3));
+		MYRMO_ASSERT(cache.count() == itemCount);
+		MYRMO_ASSERT(cache.size() == size);
+		MYRMO_ASSERT(file_exists(dir + "/" + (levels ? hash.substr(0, 3) + "/" : std::string()) + hash));
+		MYRMO_ASSERT(!file_exists(dir + "/" + hash.substr(0, 2)));
+		std::vector<char> data;
+		MYRMO_ASSERT(cache.read("1", &data) == DiskCache::Error::NoError);
+		MYRMO_ASSERT(std::string(data.begin(), data.end()) == small_item(1));
+	}
+
+	DiskCache cache(dir, myrmo::hash::sha1, new policy::LRU(), 10);
+	MYRMO_ASSERT(cache.count() == itemCount);
+	MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+}
+
+// Flips a bit of every segment file at the given offset.
+static void corrupt_segments(size_t offset)
+{
+	DIR* dir = opendir(MYRMO_TESTS_CACHE_DIR);
+	while (dirent* entry = readdir(dir))
+	{
+		const std::string name(entry->d_name);
+		if (name.compare(0, 8, "segment-") != 0)
+			continue;
+		const std::string path(std::string(MYRMO_TESTS_CACHE_DIR) + "/" + name);
+		std::string data = read_file(path);
+		data[offset] ^= 1;
+		write_file(path, data);
+	}
+	closedir(dir);
+}
+
+static size_t temporary_files()
+{
+	size_t count = 0;
+	DIR* dir = opendir(MYRMO_TESTS_CACHE_DIR);
+	while (dirent* entry = readdir(dir))
+	{
+		const std::string name(entry->d_name);
+		if ((name.size() > 4) && (name.compare(name.size() - 4, 4, ".tmp") == 0))
+			count++;
+	}
+	closedir(dir);
+	return count;
+}
+
+void test_checksums(myrmo::cache::DiskCache::IoBackend backend)
+{
+	using namespace myrmo::cache;
+	const DiskCache::SegmentOptions segments(1000);
+	const size_t itemCount = 20;
+	const std::string imagePaths[] = {
+		std::string(MYRMO_TESTS_CACHE_DIR) + "/" + myrmo::hash::sha1(images[0].name),
+		std::string(MYRMO_TESTS_CACHE_DIR) + "/" + myrmo::hash::sha1(images[1].name)
+	};
+
+	{
+		DiskCache cache(MYRMO_TESTS_CACHE_DIR, myrmo::hash::sha1, new policy::LRU(), 10, segments, backend, DiskCache::DirectoryLayout(), DiskCache::SyncPolicy::Full);
+		MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+		std::vector<WriteItem> items;
+		std::vector<std::string> uris;
+		std::vector<std::string> data;
+		for (size_t i = 0; i < itemCount; i++)
+		{
+			uris.push_back(std::to_string(i));
+			data.push_back(small_item(i)); // Item 0 is the first entry of its segment.
+		}
+		for (size_t i = 0; i < itemCount; i++)
+			items.push_back(WriteItem(uris[i], data[i]));
+		for (const DiskCache::Error error : cache.writeMany(items))
+			MYRMO_ASSERT(error == DiskCache::Error::NoError);
+		MYRMO_ASSERT(insertImage(cache, 0) == DiskCache::Error::NoError);
+		MYRMO_ASSERT(insertImage(cache, 1) == DiskCache::Error::NoError);
+		MYRMO_ASSERT(temporary_files() == 0);
+	}
+	MYRMO_ASSERT(temporary_files() == 0);
+
+	// Damage the item files and the first entry of the segment while the cache is closed.
+	for (const std::string& path : imagePaths)
+	{
+		std::string image = read_file(path);
+		image[image.size() / 2] ^= 1;
+		write_file(path, image);
+	}
+	corrupt_segments(0);
+
+	DiskCache cache(MYRMO_TESTS_CACHE_DIR, myrmo::hash::sha1, new policy::LRU(), 10, segments, backend);
+	MYRMO_ASSERT(cache.count() == itemCount + 2);
+
+	std::vector<char> data;
+	MYRMO_ASSERT(imageExists(cache, 0, &data) == DiskCache::Error::ChecksumMismatch);
+	MYRMO_ASSERT(imageExists(cache, 0, &data) == DiskCache::Error::FileDoesNotExist);
+	MYRMO_ASSERT(!file_exists(imagePaths[0]));
+	MYRMO_ASSERT(insertImage(cache, 0) == DiskCache::Error::NoError);
+	MYRMO_ASSERT(imageExists(cache, 0, &data) == DiskCache::Error::NoError);
+	MYRMO_ASSERT(std::string(data.begin(), data.end()) == get_file(images[0].name));
+
+	// Only the damaged entry is dropped.
+	std::vector<std::string> uris;
+	for (size_t i = 0; i < itemCount; i++)
+		uris.push_back(std::to_string(i));
+	std::vector<std::vector<char>> items;
+	const std::vector<DiskCache::Error> errors = cache.readMany(uris, &items);
+	for (size_t i = 0; i < itemCount; i++)
+	{
+		MYRMO_ASSERT(errors[i] == (i ? DiskCache::Error::NoError : DiskCache::Error::ChecksumMismatch));
+		MYRMO_ASSERT(std::string(items[i].begin(), items[i].end()) == (i ? small_item(i) : std::string()));
+	}
+	MYRMO_ASSERT(cache.count() == itemCount + 1);
+	MYRMO_ASSERT(cache.readMany(uris, &items)[1] == DiskCache::Error::NoError);
+
+	// Streamed reads are checked as they go, and report a mismatch at the end of the item.
+	DiskCache::Reader reader;
+	char block[4096];
+	MYRMO_ASSERT(cache.openReader(images[1].name, &reader) == DiskCache::Error::NoError);
+	size_t streamedSize = 0;
+	for (size_t count = reader.read(block, sizeof(block)); count > 0; count = reader.read(block, sizeof(block)))
+		streamedSize += count;
+	MYRMO_ASSERT(streamedSize == reader.size());
+	MYRMO_ASSERT(reader.error() == DiskCache::Error::ChecksumMismatch);
+	reader.release();
+	MYRMO_ASSERT(imageExists(cache, 1, &data) == DiskCache::Error::FileDoesNotExist);
+
+	MYRMO_ASSERT(cache.openReader(images[0].name, &reader) == DiskCache::Error::NoError);
+	std::string streamed;
+	for (size_t count = reader.read(block, sizeof(block)); count > 0; count = reader.read(block, sizeof(block)))
+		streamed.append(block, count);
+	MYRMO_ASSERT(reader.error() == DiskCache::Error::NoError);
+	MYRMO_ASSERT(streamed == get_file(images[0].name));
+	reader.release();
+	MYRMO_ASSERT(cache.count() == itemCount);
+
+	MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+}
+
+void test_unindexed_files(myrmo::cache::DiskCache::IoBackend backend)
+{
+	using namespace myrmo::cache;
+	const std::string dir(MYRMO_TESTS_CACHE_DIR);
+	const std::string item(10000, 'i');
+
+	DiskCache cache(dir, myrmo::hash::sha1, new policy::LRU(), 10, DiskCache::SegmentOptions(), backend);
+	MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+
+	// Files without an entry, as left by a crash between a commit and the journal flush, are replaced.
+	for (const char* uri : { "unindexed_write", "unindexed_batch", "unindexed_writer" })
+		write_file(dir + "/" + myrmo::hash::sha1(uri), "stale");
+
+	MYRMO_ASSERT(cache.write("unindexed_write", item) == DiskCache::Error::NoError);
+	const std::vector<DiskCache::Error> errors = cache.writeMany({ WriteItem("unindexed_batch", item) });
+	MYRMO_ASSERT(errors[0] == DiskCache::Error::NoError);
+	DiskCache::Writer writer;
+	MYRMO_ASSERT(cache.openWriter("unindexed_writer", item.size(), &writer) == DiskCache::Error::NoError);
+	MYRMO_ASSERT(writer.write(item.data(), item.size()) == DiskCache::Error::NoError);
+	MYRMO_ASSERT(writer.commit() == DiskCache::Error::NoError);
+
+	MYRMO_ASSERT(cache.count() == 3);
+	MYRMO_ASSERT(cache.size() == 3 * item.size());
+	std::vector<char> data;
+	for (const char* uri : { "unindexed_write", "unindexed_batch", "unindexed_writer" })
+	{
+		MYRMO_ASSERT(cache.read(uri, &data) == DiskCache::Error::NoError);
+		MYRMO_ASSERT(std::string(data.begin(), data.end()) == item);
+	}
+	MYRMO_ASSERT(cache.clear() == DiskCache::Error::NoError);
+}
+
 int main()
 {
 	{
@@ -256,6 +1041,22 @@ int main()
 
 	test_insert_read_delete_all_images();
 	test_disk_cache_eviction_policy();
+	test_clock_policy();
+	test_mapped_views();
+	test_streaming();
+	test_journal_replay();
+	test_index_migration();
+	test_segments();
+	test_binary_keys();
+	test_batches(myrmo::cache::DiskCache::IoBackend::Streams, nullptr);
+	test_batches(myrmo::cache::DiskCache::IoBackend::IoUring, nullptr);
+	test_batches(myrmo::cache::DiskCache::IoBackend::Streams, myrmo::hash::sha1_many);
+	test_batches(myrmo::cache::DiskCache::IoBackend::IoUring, myrmo::hash::sha1_many);
+	test_directory_layout();
+	test_checksums(myrmo::cache::DiskCache::IoBackend::Streams);
+	test_checksums(myrmo::cache::DiskCache::IoBackend::IoUring);
+	test_unindexed_files(myrmo::cache::DiskCache::IoBackend::Streams);
+	test_unindexed_files(myrmo::cache::DiskCache::IoBackend::IoUring);
 
 	return 0;
 }
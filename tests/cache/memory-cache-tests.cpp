@@ -212,6 +212,243 @@ void test_disk_cache_eviction_policy()
 	}
 }
 
+void test_pinned_handles()
+{
+	using namespace myrmo::cache;
+	const size_t cacheSizeInMiB = 1;
+
+	MemoryCache cache(myrmo::hash::sha1, new policy::LRU(), cacheSizeInMiB);
+	MemoryCache::Handle handle;
+
+	MYRMO_ASSERT(cache.read(images[0].name, &handle) == MemoryCache::Error::ItemDoesNotExist);
+	MYRMO_ASSERT(!handle.valid());
+
+	// Zero-copy reads see the same bytes as the copying read.
+	MYRMO_ASSERT(insertImage(cache, 0) == MemoryCache::Error::NoError);
+	MYRMO_ASSERT(cache.read(images[0].name, &handle) == MemoryCache::Error::NoError);
+	MYRMO_ASSERT(handle.valid());
+	const std::string image0(get_file(images[0].name));
+	MYRMO_ASSERT(handle.size() == image0.size());
+	MYRMO_ASSERT(memcmp(handle.data(), image0.data(), image0.size()) == 0);
+
+	// A pinned item is skipped by eviction, the least recently used unpinned items are evicted instead.
+	for (size_t i = 1; i < IMAGE_COUNT; i++)
+		MYRMO_ASSERT(insertImage(cache, i) == MemoryCache::Error::NoError);
+	MYRMO_ASSERT(cache.size() <= cacheSizeInMiB * 1048576);
+	MYRMO_ASSERT(memcmp(handle.data(), image0.data(), image0.size()) == 0);
+	std::vector<char> data;
+	MYRMO_ASSERT(imageExists(cache, 0, &data) == MemoryCache::Error::NoError);
+
+	// Removing a pinned item hides it from the cache, but the bytes stay valid until the handle is released.
+	MemoryCache::Handle second;
+	MYRMO_ASSERT(cache.read(images[0].name, &second) == MemoryCache::Error::NoError);
+	MYRMO_ASSERT(second.data() == handle.data());
+	MYRMO_ASSERT(deleteImage(cache, 0) == MemoryCache::Error::NoError);
+	MYRMO_ASSERT(imageExists(cache, 0, &data) == MemoryCache::Error::ItemDoesNotExist);
+	MYRMO_ASSERT(memcmp(handle.data(), image0.data(), image0.size()) == 0);
+	handle.release();
+	MYRMO_ASSERT(!handle.valid());
+	MYRMO_ASSERT(memcmp(second.data(), image0.data(), image0.size()) == 0);
+
+	// The item can be written again while the old bytes are still pinned.
+	MYRMO_ASSERT(insertImage(cache, 0) == MemoryCache::Error::NoError);
+	MYRMO_ASSERT(cache.read(images[0].name, &handle) == MemoryCache::Error::NoError);
+	MYRMO_ASSERT(handle.data() != second.data());
+	second = std::move(handle);
+	MYRMO_ASSERT(!handle.valid());
+	MYRMO_ASSERT(memcmp(second.data(), image0.data(), image0.size()) == 0);
+
+	// Clearing the cache with a pinned item.
+	MYRMO_ASSERT(cache.clear() == MemoryCache::Error::NoError);
+	MYRMO_ASSERT(cache.size() == 0);
+	MYRMO_ASSERT(cache.count() == 0);
+	MYRMO_ASSERT(memcmp(second.data(), image0.data(), image0.size()) == 0);
+	second.release();
+
+	for (size_t i = 0; i < IMAGE_COUNT; i++)
+		MYRMO_ASSERT(insertImage(cache, i) == MemoryCache::Error::NoError);
+	MYRMO_ASSERT(cache.count() == 6);
+}
+
+void test_clock_policy()
+{
+	using namespace myrmo::cache;
+	const size_t cacheSizeInMiB = 1;
+
+	MemoryCache cache(myrmo::hash::sha1, new policy::CLOCK(), cacheSizeInMiB);
+	MYRMO_ASSERT(cache.concurrentReads());
+	std::vector<char> data;
+
+	for (size_t i = 0; i < IMAGE_COUNT; i++)
+	{
+		MYRMO_ASSERT(insertImage(cache, i) == MemoryCache::Error::NoError);
+		MYRMO_ASSERT(imageExists(cache, 0, &data) == MemoryCache::Error::NoError); // Keep image 0 referenced.
+	}
+	MYRMO_ASSERT(cache.size() <= cacheSizeInMiB * 1048576);
+	MYRMO_ASSERT(cache.count() > 0);
+
+	size_t cached = 0;
+	for (size_t i = 0; i < IMAGE_COUNT; i++)
+	{
+		if (imageExists(cache, i, &data) == MemoryCache::Error::NoError)
+		{
+			std::string image(get_file(images[i].name));
+			MYRMO_ASSERT(image.size() == data.size());
+			MYRMO_ASSERT(memcmp(image.data(), data.data(), data.size()) == 0);
+			cached++;
+		}
+	}
+	MYRMO_ASSERT(cached == cache.count());
+	MYRMO_ASSERT(imageExists(cache, 0, &data) == MemoryCache::Error::NoError);
+	MYRMO_ASSERT(imageExists(cache, IMAGE_COUNT - 1, &data) == MemoryCache::Error::NoError);
+
+	MYRMO_ASSERT(cache.clear() == MemoryCache::Error::NoError);
+	MYRMO_ASSERT(cache.count() == 0);
+}
+
+static uint64_t fnv1a_64(const std::string& uri)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (char c : uri)
+		hash = (hash ^ uint8_t(c)) * 0x100000001b3ull;
+	return hash;
+}
+
+template<typename Key>
+void test_binary_keys(Key (*hashFunction)(const std::string&))
+{
+	using namespace myrmo::cache;
+	typedef BasicMemoryCache<Key> Cache;
+
+	Cache cache(hashFunction, new policy::BasicLRU<Key>(), 1);
+	std::vector<char> data;
+
+	for (size_t i = 0; i < IMAGE_COUNT; i++)
+		MYRMO_ASSERT(cache.write(images[i].name, get_file(images[i].name)) == Cache::Error::NoError);
+	MYRMO_ASSERT(cache.count() == 6);
+
+	for (size_t i = IMAGE_COUNT - 6; i < IMAGE_COUNT; i++)
+	{
+		const std::string image(get_file(images[i].name));
+		MYRMO_ASSERT(cache.read(images[i].name, &data) == Cache::Error::NoError);
+		MYRMO_ASSERT(image.size() == data.size());
+		MYRMO_ASSERT(memcmp(image.data(), data.data(), data.size()) == 0);
+	}
+	MYRMO_ASSERT(cache.read(images[0].name, &data) == Cache::Error::ItemDoesNotExist);
+
+	MYRMO_ASSERT(cache.remove(images[IMAGE_COUNT - 1].name) == Cache::Error::NoError);
+	MYRMO_ASSERT(cache.count() == 5);
+	MYRMO_ASSERT(cache.clear() == Cache::Error::NoError);
+	MYRMO_ASSERT(cache.count() == 0);
+}
+
+void test_batches(myrmo::cache::MemoryCache::batchHashFunction batchHash)
+{
+	using namespace myrmo::cache;
+
+	std::vector<std::string> uris;
+	std::vector<std::string> files;
+	for (size_t i = 0; i < IMAGE_COUNT; i++)
+	{
+		uris.push_back(images[i].name);
+		files.push_back(get_file(images[i].name));
+	}
+
+	std::vector<WriteItem> items;
+	for (size_t i = 0; i < IMAGE_COUNT; i++)
+		items.push_back(WriteItem(uris[i], files[i]));
+	const std::string empty;
+	const std::string emptyUri("empty");
+	items.push_back(WriteItem(emptyUri, empty));
+	items.push_back(WriteItem(uris[0], files[0])); // Duplicate within the batch.
+
+	{
+		MemoryCache cache(myrmo::hash::sha1, new policy::LRU(), 10);
+		cache.setBatchHashFunction(batchHash);
+		std::vector<MemoryCache::Error> errors = cache.writeMany(items);
+		MYRMO_ASSERT(errors.size() == IMAGE_COUNT + 2);
+		for (size_t i = 0; i < IMAGE_COUNT; i++)
+			MYRMO_ASSERT(errors[i] == MemoryCache::Error::NoError);
+		MYRMO_ASSERT(errors[IMAGE_COUNT] == MemoryCache::Error::ZeroSize);
+		MYRMO_ASSERT(errors[IMAGE_COUNT + 1] == MemoryCache::Error::ItemExists);
+		MYRMO_ASSERT(cache.count() == IMAGE_COUNT);
+		MYRMO_ASSERT(cache.size() == allImagesSize());
+
+		errors = cache.writeMany(std::vector<WriteItem>(items.begin(), items.begin() + IMAGE_COUNT));
+		for (size_t i = 0; i < IMAGE_COUNT; i++)
+			MYRMO_ASSERT(errors[i] == MemoryCache::Error::ItemExists);
+
+		std::vector<std::string> readUris(uris);
+		readUris.push_back("does_not_exist");
+		std::vector<MemoryCache::Handle> handles;
+		errors = cache.readMany(readUris, &handles);
+		MYRMO_ASSERT(errors.size() == IMAGE_COUNT + 1);
+		MYRMO_ASSERT(handles.size() == IMAGE_COUNT + 1);
+		for (size_t i = 0; i < IMAGE_COUNT; i++)
+		{
+			MYRMO_ASSERT(errors[i] == MemoryCache::Error::NoError);
+			MYRMO_ASSERT(handles[i].size() == files[i].size());
+			MYRMO_ASSERT(memcmp(handles[i].data(), files[i].data(), files[i].size()) == 0);
+		}
+		MYRMO_ASSERT(errors[IMAGE_COUNT] == MemoryCache::Error::ItemDoesNotExist);
+		MYRMO_ASSERT(!handles[IMAGE_COUNT].valid());
+		handles.clear();
+
+		std::vector<std::vector<char>> data;
+		errors = cache.readMany(readUris, &data);
+		for (size_t i = 0; i < IMAGE_COUNT; i++)
+		{
+			MYRMO_ASSERT(errors[i] == MemoryCache::Error::NoError);
+			MYRMO_ASSERT(data[i].size() == files[i].size());
+			MYRMO_ASSERT(memcmp(data[i].data(), files[i].data(), files[i].size()) == 0);
+		}
+		MYRMO_ASSERT(data[IMAGE_COUNT].empty());
+	}
+
+	{
+		// A batch larger than the cache behaves like the same writes one by one.
+		MemoryCache cache(myrmo::hash::sha1, new policy::LRU(), 1);
+		cache.setBatchHashFunction(batchHash);
+		std::vector<MemoryCache::Error> errors = cache.writeMany(std::vector<WriteItem>(items.begin(), items.begin() + IMAGE_COUNT));
+		for (size_t i = 0; i < IMAGE_COUNT; i++)
+			MYRMO_ASSERT(errors[i] == MemoryCache::Error::NoError);
+		MYRMO_ASSERT(cache.count() == 6);
+
+		std::vector<std::vector<char>> data;
+		errors = cache.readMany(uris, &data);
+		for (size_t i = 0; i < IMAGE_COUNT; i++)
+			MYRMO_ASSERT(errors[i] == (i < IMAGE_COUNT - 6 ? MemoryCache::Error::ItemDoesNotExist : MemoryCache::Error::NoError));
+	}
+}
+
+void test_eviction_callback()
+{
+	using namespace myrmo::cache;
+
+	MemoryCache cache(myrmo::hash::sha1, new policy::LRU(), MemoryCache::SizeInBytes(3000));
+	std::vector<std::pair<std::string, std::string>> evicted;
+	cache.setEvictionCallback([&](const std::string& hash, const char* data, size_t size)
+	{
+		evicted.push_back(std::make_pair(hash, std::string(data, size)));
+	});
+
+	MYRMO_ASSERT(cache.write("a", std::string(1000, 'a')) == MemoryCache::Error::NoError);
+	MYRMO_ASSERT(cache.write("b", std::string(1000, 'b')) == MemoryCache::Error::NoError);
+	MYRMO_ASSERT(cache.write("c", std::string(1000, 'c')) == MemoryCache::Error::NoError);
+	MYRMO_ASSERT(evicted.empty());
+
+	// The least recently used item is handed over with its bytes before it goes.
+	MYRMO_ASSERT(cache.write("d", std::string(1000, 'd')) == MemoryCache::Error::NoError);
+	MYRMO_ASSERT(evicted.size() == 1);
+	MYRMO_ASSERT(evicted[0].first == cache.hash("a"));
+	MYRMO_ASSERT(evicted[0].second == std::string(1000, 'a'));
+
+	// Removes and clear() are not evictions.
+	MYRMO_ASSERT(cache.remove("b") == MemoryCache::Error::NoError);
+	MYRMO_ASSERT(cache.clear() == MemoryCache::Error::NoError);
+	MYRMO_ASSERT(evicted.size() == 1);
+}
+
 int main()
 {
 	{
@@ -222,6 +459,13 @@ int main()
 
 	test_insert_read_delete_all_images();
 	test_disk_cache_eviction_policy();
+	test_pinned_handles();
+	test_clock_policy();
+	test_binary_keys(fnv1a_64);
+	test_binary_keys(myrmo::hash::sha1_digest);
+	test_batches(nullptr);
+	test_batches(myrmo::hash::sha1_many);
+	test_eviction_callback();
 
 	return 0;
 }
@@ -0,0 +1,343 @@
+#include <myrmo/test/assert.h>
+#include <myrmo/cache/policy.h>
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <array>
+
+std::string make_hash(size_t i)
+{
+	char buf[9];
+	snprintf(buf, sizeof(buf), "%08zx", i);
+	return std::string(buf, 8);
+}
+
+void test_lru_order()
+{
+	using namespace myrmo::cache;
+
+	policy::LRU lru;
+	MYRMO_ASSERT(lru.setHashSize(8) == policy::Error::NoError);
+
+	for (size_t i = 0; i < 5; i++)
+		MYRMO_ASSERT(lru.add(make_hash(i)) == policy::Error::NoError);
+
+	MYRMO_ASSERT(lru.count() == 5);
+	MYRMO_ASSERT(lru.front() == make_hash(4));
+	MYRMO_ASSERT(lru.back() == make_hash(0));
+
+	// Lookup moves the hash to the front.
+	MYRMO_ASSERT(lru.exists(make_hash(0)) == policy::Error::NoError);
+	MYRMO_ASSERT(lru.front() == make_hash(0));
+	MYRMO_ASSERT(lru.back() == make_hash(1));
+	MYRMO_ASSERT(lru.exists(make_hash(42)) == policy::Error::DoesNotExist);
+
+	// Remove from the middle and the back.
+	MYRMO_ASSERT(lru.remove(make_hash(2)) == policy::Error::NoError);
+	MYRMO_ASSERT(lru.remove(make_hash(1)) == policy::Error::NoError);
+	MYRMO_ASSERT(lru.remove(make_hash(1)) == policy::Error::DoesNotExist);
+	MYRMO_ASSERT(lru.exists(make_hash(2)) == policy::Error::DoesNotExist);
+	MYRMO_ASSERT(lru.count() == 3);
+	MYRMO_ASSERT(lru.back() == make_hash(3));
+
+	// Removed hashes can be added again.
+	MYRMO_ASSERT(lru.add(make_hash(1)) == policy::Error::NoError);
+	MYRMO_ASSERT(lru.front() == make_hash(1));
+
+	lru.clear();
+	MYRMO_ASSERT(lru.count() == 0);
+	MYRMO_ASSERT(lru.exists(make_hash(0)) == policy::Error::DoesNotExist);
+}
+
+void test_lru_index_data()
+{
+	using namespace myrmo::cache;
+
+	policy::LRU lru;
+	lru.setHashSize(8);
+	for (size_t i = 0; i < 100; i++)
+		lru.add(make_hash(i));
+	lru.exists(make_hash(10));
+
+	const std::string indexData = lru.getIndexData();
+	MYRMO_ASSERT(indexData.size() == 100 * 8);
+	MYRMO_ASSERT(indexData.substr(0, 8) == make_hash(10));
+	MYRMO_ASSERT(indexData.substr(8, 8) == make_hash(99));
+
+	policy::LRU restored;
+	restored.setHashSize(8);
+	MYRMO_ASSERT(restored.setIndexData(std::vector<char>(indexData.begin(), indexData.end())) == policy::Error::NoError);
+	MYRMO_ASSERT(restored.count() == 100);
+	MYRMO_ASSERT(restored.getIndexData() == indexData);
+	MYRMO_ASSERT(restored.back() == make_hash(0));
+
+	std::vector<std::string> order;
+	restored.forEach([&](const std::string& hash) { order.push_back(hash); });
+	MYRMO_ASSERT(order.size() == 100);
+	MYRMO_ASSERT(order.front() == make_hash(10));
+	MYRMO_ASSERT(order.back() == make_hash(0));
+
+	// Every hash is still reachable through the index after a restore.
+	for (size_t i = 0; i < 100; i++)
+		MYRMO_ASSERT(restored.exists(make_hash(i)) == policy::Error::NoError);
+	MYRMO_ASSERT(restored.front() == make_hash(99));
+}
+
+void test_clock_second_chance()
+{
+	using namespace myrmo::cache;
+
+	policy::CLOCK clock;
+	MYRMO_ASSERT(clock.setHashSize(8) == policy::Error::NoError);
+	MYRMO_ASSERT(clock.concurrentExists());
+
+	for (size_t i = 0; i < 5; i++)
+		MYRMO_ASSERT(clock.add(make_hash(i)) == policy::Error::NoError);
+	MYRMO_ASSERT(clock.count() == 5);
+
+	// Without hits, hashes are evicted in insertion order.
+	MYRMO_ASSERT(clock.back() == make_hash(0));
+	MYRMO_ASSERT(clock.front() == make_hash(4));
+
+	// A hit gives the hash a second chance.
+	MYRMO_ASSERT(clock.exists(make_hash(0)) == policy::Error::NoError);
+	MYRMO_ASSERT(clock.exists(make_hash(1)) == policy::Error::NoError);
+	MYRMO_ASSERT(clock.exists(make_hash(42)) == policy::Error::DoesNotExist);
+	MYRMO_ASSERT(clock.back() == make_hash(2));
+	MYRMO_ASSERT(clock.remove(make_hash(2)) == policy::Error::NoError);
+	MYRMO_ASSERT(clock.remove(make_hash(2)) == policy::Error::DoesNotExist);
+
+	// The new hash takes the freed slot and is the last one the hand reaches.
+	MYRMO_ASSERT(clock.add(make_hash(5)) == policy::Error::NoError);
+	MYRMO_ASSERT(clock.front() == make_hash(5));
+	MYRMO_ASSERT(clock.back() == make_hash(3));
+	MYRMO_ASSERT(clock.remove(make_hash(3)) == policy::Error::NoError);
+	MYRMO_ASSERT(clock.back() == make_hash(4));
+	MYRMO_ASSERT(clock.remove(make_hash(4)) == policy::Error::NoError);
+
+	// Hashes 0 and 1 lost their reference bits when the hand passed them.
+	MYRMO_ASSERT(clock.back() == make_hash(0));
+	MYRMO_ASSERT(clock.count() == 3);
+
+	// Draining the policy.
+	while (clock.count() > 0)
+		MYRMO_ASSERT(clock.remove(clock.back()) == policy::Error::NoError);
+	MYRMO_ASSERT(clock.back().empty());
+	MYRMO_ASSERT(clock.add(make_hash(7)) == policy::Error::NoError);
+	MYRMO_ASSERT(clock.back() == make_hash(7));
+}
+
+void test_clock_index_data()
+{
+	using namespace myrmo::cache;
+
+	policy::CLOCK clock;
+	clock.setHashSize(8);
+	for (size_t i = 0; i < 100; i++)
+		clock.add(make_hash(i));
+
+	// Like LRU, the index data ends with the hash that is evicted first.
+	const std::string indexData = clock.getIndexData();
+	MYRMO_ASSERT(indexData.size() == 100 * 8);
+	MYRMO_ASSERT(indexData.substr(0, 8) == make_hash(99));
+	MYRMO_ASSERT(indexData.substr(99 * 8, 8) == make_hash(0));
+
+	policy::CLOCK restored;
+	restored.setHashSize(8);
+	MYRMO_ASSERT(restored.setIndexData(std::vector<char>(indexData.begin(), indexData.end())) == policy::Error::NoError);
+	MYRMO_ASSERT(restored.count() == 100);
+	MYRMO_ASSERT(restored.getIndexData() == indexData);
+	MYRMO_ASSERT(restored.back() == make_hash(0));
+	MYRMO_ASSERT(restored.front() == make_hash(99));
+
+	// LRU index data can be loaded by CLOCK and the other way around.
+	policy::LRU lru;
+	lru.setHashSize(8);
+	MYRMO_ASSERT(lru.setIndexData(std::vector<char>(indexData.begin(), indexData.end())) == policy::Error::NoError);
+	MYRMO_ASSERT(lru.back() == restored.back());
+	MYRMO_ASSERT(lru.getIndexData() == indexData);
+
+	// A duplicate hash is reported as corrupted data and only its most recent occurrence is kept.
+	const std::string duplicated = indexData.substr(0, 50 * 8) + make_hash(0) + indexData.substr(50 * 8);
+	MYRMO_ASSERT(restored.setIndexData(std::vector<char>(duplicated.begin(), duplicated.end())) == policy::Error::DataCorrupted);
+	MYRMO_ASSERT(restored.count() == 100);
+	MYRMO_ASSERT(lru.setIndexData(std::vector<char>(duplicated.begin(), duplicated.end())) == policy::Error::DataCorrupted);
+	MYRMO_ASSERT(lru.count() == 100);
+	MYRMO_ASSERT(restored.getIndexData() == lru.getIndexData());
+	MYRMO_ASSERT(restored.back() == make_hash(1));
+}
+
+// Looks up the hash and adds it on a miss, evicting from the back when the policy holds capacity hashes.
+static bool access(myrmo::cache::policy::EvictionPolicy& policy, const std::string& hash, size_t capacity)
+{
+	using namespace myrmo::cache;
+	if (policy.exists(hash) == policy::Error::NoError)
+		return true;
+	if (policy.count() >= capacity)
+	{
+		MYRMO_ASSERT(policy.remove(std::string(policy.back())) == policy::Error::NoError);
+	}
+	MYRMO_ASSERT(policy.add(hash) == policy::Error::NoError);
+	return false;
+}
+
+void test_frequency_sketch()
+{
+	using namespace myrmo::cache;
+
+	policy::FrequencySketch sketch(64);
+	MYRMO_ASSERT(sketch.width() == 64);
+	MYRMO_ASSERT(sketch.frequency(make_hash(1)) == 0);
+
+	for (size_t i = 0; i < 5; i++)
+		sketch.increment(make_hash(1));
+	for (size_t i = 0; i < 100; i++)
+		sketch.increment(make_hash(2));
+	MYRMO_ASSERT(sketch.frequency(make_hash(1)) >= 5);
+	MYRMO_ASSERT(sketch.frequency(make_hash(2)) == 15); // Saturated.
+
+	// Counters are halved after a sample of 10 * width additions.
+	for (size_t i = 0; i < 10 * 64; i++)
+		sketch.increment(make_hash(1000 + i));
+	MYRMO_ASSERT(sketch.frequency(make_hash(2)) < 15);
+
+	// Growing keeps the counts.
+	const unsigned int before = sketch.frequency(make_hash(2));
+	sketch.resize(1024);
+	MYRMO_ASSERT(sketch.width() == 1024);
+	MYRMO_ASSERT(sketch.frequency(make_hash(2)) == before);
+	MYRMO_ASSERT(sketch.frequency(make_hash(1)) >= 2);
+
+	sketch.clear();
+	MYRMO_ASSERT(sketch.frequency(make_hash(2)) == 0);
+}
+
+void test_wtinylfu_scan_resistance()
+{
+	using namespace myrmo::cache;
+	const size_t capacity = 100;
+
+	policy::WTinyLFU tinyLfu;
+	policy::LRU lru;
+	tinyLfu.setHashSize(8);
+	lru.setHashSize(8);
+
+	// A hot working set that is accessed repeatedly.
+	for (size_t round = 0; round < 5; round++)
+	{
+		for (size_t i = 0; i < 50; i++)
+		{
+			access(tinyLfu, make_hash(i), capacity);
+			access(lru, make_hash(i), capacity);
+		}
+	}
+
+	// A one-off scan, twice the size of the cache.
+	for (size_t i = 0; i < 2 * capacity; i++)
+	{
+		access(tinyLfu, make_hash(100000 + i), capacity);
+		access(lru, make_hash(100000 + i), capacity);
+	}
+	MYRMO_ASSERT(tinyLfu.count() == capacity);
+	MYRMO_ASSERT(lru.count() == capacity);
+
+	size_t tinyLfuHits = 0;
+	size_t lruHits = 0;
+	for (size_t i = 0; i < 50; i++)
+	{
+		tinyLfuHits += access(tinyLfu, make_hash(i), capacity) ? 1 : 0;
+		lruHits += access(lru, make_hash(i), capacity) ? 1 : 0;
+	}
+	MYRMO_ASSERT(lruHits == 0);
+	MYRMO_ASSERT(tinyLfuHits == 50);
+}
+
+void test_wtinylfu_interface()
+{
+	using namespace myrmo::cache;
+
+	policy::WTinyLFU tinyLfu;
+	tinyLfu.setHashSize(8);
+	MYRMO_ASSERT(tinyLfu.back().empty());
+
+	for (size_t i = 0; i < 10; i++)
+		MYRMO_ASSERT(tinyLfu.add(make_hash(i)) == policy::Error::NoError);
+	MYRMO_ASSERT(tinyLfu.count() == 10);
+	MYRMO_ASSERT(tinyLfu.front() == make_hash(9));
+	MYRMO_ASSERT(tinyLfu.exists(make_hash(3)) == policy::Error::NoError);
+	MYRMO_ASSERT(tinyLfu.exists(make_hash(42)) == policy::Error::DoesNotExist);
+
+	MYRMO_ASSERT(tinyLfu.remove(make_hash(3)) == policy::Error::NoError);
+	MYRMO_ASSERT(tinyLfu.remove(make_hash(3)) == policy::Error::DoesNotExist);
+	MYRMO_ASSERT(tinyLfu.exists(make_hash(3)) == policy::Error::DoesNotExist);
+	MYRMO_ASSERT(tinyLfu.count() == 9);
+
+	size_t visited = 0;
+	tinyLfu.forEach([&](const std::string&) { visited++; });
+	MYRMO_ASSERT(visited == 9);
+
+	// The index data round trips, and ends with the next victim.
+	const std::string indexData = tinyLfu.getIndexData();
+	MYRMO_ASSERT(indexData.size() == 9 * 8);
+	policy::WTinyLFU restored;
+	restored.setHashSize(8);
+	MYRMO_ASSERT(restored.setIndexData(std::vector<char>(indexData.begin(), indexData.end())) == policy::Error::NoError);
+	MYRMO_ASSERT(restored.count() == 9);
+	MYRMO_ASSERT(restored.getIndexData() == indexData);
+	MYRMO_ASSERT(restored.back() == indexData.substr(8 * 8, 8));
+
+	while (restored.count() > 0)
+		MYRMO_ASSERT(restored.remove(std::string(restored.back())) == policy::Error::NoError);
+	MYRMO_ASSERT(restored.back().empty());
+
+	tinyLfu.clear();
+	MYRMO_ASSERT(tinyLfu.count() == 0);
+}
+
+void test_binary_keys()
+{
+	using namespace myrmo::cache;
+
+	policy::BasicLRU<uint64_t> lru;
+	lru.setHashSize(8);
+	for (uint64_t i = 0; i < 100; i++)
+		MYRMO_ASSERT(lru.add(i * 0x0101010101010101ull) == policy::Error::NoError);
+	MYRMO_ASSERT(lru.exists(0) == policy::Error::NoError);
+	MYRMO_ASSERT(lru.back() == 0x0101010101010101ull);
+
+	const std::string indexData = lru.getIndexData();
+	MYRMO_ASSERT(indexData.size() == 100 * 8);
+
+	policy::BasicWTinyLFU<uint64_t> tinyLfu;
+	tinyLfu.setHashSize(8);
+	MYRMO_ASSERT(tinyLfu.setIndexData(std::vector<char>(indexData.begin(), indexData.end())) == policy::Error::NoError);
+	MYRMO_ASSERT(tinyLfu.getIndexData() == indexData);
+	MYRMO_ASSERT(tinyLfu.back() == lru.back());
+
+	typedef std::array<uint8_t, 20> Digest;
+	policy::BasicCLOCK<Digest> clock;
+	clock.setHashSize(20);
+	Digest a = {{ 1, 2, 3 }};
+	Digest b = {{ 4, 5, 6 }};
+	MYRMO_ASSERT(clock.add(a) == policy::Error::NoError);
+	MYRMO_ASSERT(clock.add(b) == policy::Error::NoError);
+	MYRMO_ASSERT(clock.exists(a) == policy::Error::NoError);
+	MYRMO_ASSERT(clock.back() == b);
+	MYRMO_ASSERT(KeyTraits<Digest>::toString(a) == "0102030000000000000000000000000000000000");
+	MYRMO_ASSERT(KeyTraits<uint64_t>::toString(0x0123456789abcdefull) == "0123456789abcdef");
+	MYRMO_ASSERT(KeyTraits<uint64_t>::fromBytes("\x01\x23\x45\x67\x89\xab\xcd\xef", 8) == 0x0123456789abcdefull);
+}
+
+int main()
+{
+	test_lru_order();
+	test_lru_index_data();
+	test_clock_second_chance();
+	test_clock_index_data();
+	test_frequency_sketch();
+	test_wtinylfu_scan_resistance();
+	test_wtinylfu_interface();
+	test_binary_keys();
+	return 0;
+}
@@ -0,0 +1,172 @@
+#include <myrmo/test/assert.h>
+#include <myrmo/test/items.h>
+#include <myrmo/cache/sharded.h>
+#include <myrmo/hash/sha1.h>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <random>
+
+using myrmo::test::make_uri;
+using myrmo::test::make_item;
+using myrmo::test::item_is_valid;
+
+static const myrmo::test::ItemSizes sizes(1000, 100, 97);
+
+void test_insert_read_delete()
+{
+	using namespace myrmo::cache;
+
+	ShardedMemoryCache cache(myrmo::hash::sha1, []() { return new policy::LRU(); }, 16, 8);
+	MYRMO_ASSERT(cache.shardCount() == 8);
+	MYRMO_ASSERT(cache.maxSize() == 16 * 1048576);
+
+	std::vector<char> data;
+	size_t totalSize = 0;
+	for (size_t i = 0; i < 200; i++)
+	{
+		MYRMO_ASSERT(cache.read(make_uri(i), &data) == ShardedMemoryCache::Error::ItemDoesNotExist);
+		MYRMO_ASSERT(cache.write(make_uri(i), make_item(i, sizes)) == ShardedMemoryCache::Error::NoError);
+		totalSize += make_item(i, sizes).size();
+	}
+	MYRMO_ASSERT(cache.write(make_uri(0), make_item(0, sizes)) == ShardedMemoryCache::Error::ItemExists);
+	MYRMO_ASSERT(cache.count() == 200);
+	MYRMO_ASSERT(cache.size() == totalSize);
+
+	for (size_t i = 0; i < 200; i++)
+	{
+		MYRMO_ASSERT(cache.read(make_uri(i), &data) == ShardedMemoryCache::Error::NoError);
+		MYRMO_ASSERT(item_is_valid(i, data.data(), data.size(), sizes));
+
+		ShardedMemoryCache::Handle handle;
+		MYRMO_ASSERT(cache.read(make_uri(i), &handle) == ShardedMemoryCache::Error::NoError);
+		MYRMO_ASSERT(item_is_valid(i, handle.data(), handle.size(), sizes));
+	}
+
+	for (size_t i = 0; i < 200; i += 2)
+		MYRMO_ASSERT(cache.remove(make_uri(i)) == ShardedMemoryCache::Error::NoError);
+	MYRMO_ASSERT(cache.count() == 100);
+	MYRMO_ASSERT(cache.read(make_uri(0), &data) == ShardedMemoryCache::Error::ItemDoesNotExist);
+	MYRMO_ASSERT(cache.read(make_uri(1), &data) == ShardedMemoryCache::Error::NoError);
+
+	MYRMO_ASSERT(cache.clear() == ShardedMemoryCache::Error::NoError);
+	MYRMO_ASSERT(cache.count() == 0);
+	MYRMO_ASSERT(cache.size() == 0);
+}
+
+void test_size_limit()
+{
+	using namespace myrmo::cache;
+
+	ShardedMemoryCache cache(myrmo::hash::sha1, []() { return new policy::LRU(); }, 1, 4);
+	for (size_t i = 0; i < 2000; i++)
+		MYRMO_ASSERT(cache.write(make_uri(i), make_item(i, sizes)) == ShardedMemoryCache::Error::NoError);
+
+	MYRMO_ASSERT(cache.size() <= cache.maxSize());
+	MYRMO_ASSERT(cache.count() < 2000);
+}
+
+void test_global_size_limit()
+{
+	using namespace myrmo::cache;
+
+	// Items larger than an even share of the limit fit, and evict from the other shards.
+	ShardedMemoryCache cache(myrmo::hash::sha1, []() { return new policy::LRU(); }, 1, 4);
+	const std::vector<char> large(400 * 1024, 'x');
+	for (size_t i = 0; i < 8; i++)
+	{
+		MYRMO_ASSERT(cache.write(make_uri(i), large) == ShardedMemoryCache::Error::NoError);
+		MYRMO_ASSERT(cache.size() <= cache.maxSize());
+	}
+	MYRMO_ASSERT(cache.count() <= 2);
+
+	for (size_t i = 100; i < 2000; i++)
+		MYRMO_ASSERT(cache.write(make_uri(i), make_item(i, sizes)) == ShardedMemoryCache::Error::NoError);
+	MYRMO_ASSERT(cache.size() <= cache.maxSize());
+	MYRMO_ASSERT(cache.size() > cache.maxSize() / 2);
+
+	// A shard holds at most twice its even share, which is also the largest item.
+	MYRMO_ASSERT(cache.maxItemSize() == cache.maxSize() / 2);
+	const std::vector<char> largest(cache.maxItemSize(), 'y');
+	MYRMO_ASSERT(cache.write(make_uri(10), largest) == ShardedMemoryCache::Error::NoError);
+	MYRMO_ASSERT(cache.size() <= cache.maxSize());
+	MYRMO_ASSERT(cache.write(make_uri(11), std::vector<char>(cache.maxItemSize() + 1)) == ShardedMemoryCache::Error::SizeExceedsCacheSize);
+
+	// Without other shards to share with, a single shard holds the whole limit.
+	ShardedMemoryCache single(myrmo::hash::sha1, []() { return new policy::LRU(); }, 1, 1);
+	MYRMO_ASSERT(single.maxItemSize() == single.maxSize());
+	const std::vector<char> whole(single.maxSize(), 'z');
+	MYRMO_ASSERT(single.write(make_uri(10), whole) == ShardedMemoryCache::Error::NoError);
+	MYRMO_ASSERT(single.size() == single.maxSize());
+}
+
+void test_concurrent_access(myrmo::cache::ShardedMemoryCache::policyFactory factory)
+{
+	using namespace myrmo::cache;
+
+	ShardedMemoryCache cache(myrmo::hash::sha1, factory, 2, 8);
+	std::atomic<size_t> corrupt(0);
+	std::atomic<size_t> hits(0);
+
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < 8; t++)
+	{
+		threads.emplace_back([&, t]()
+		{
+			std::mt19937 rng(static_cast<unsigned>(t));
+			std::uniform_int_distribution<size_t> itemDist(0, 499);
+			std::vector<char> data;
+			ShardedMemoryCache::Handle handle;
+
+			for (size_t n = 0; n < 5000; n++)
+			{
+				const size_t i = itemDist(rng);
+				switch (n % 4)
+				{
+				case 0:
+					cache.write(make_uri(i), make_item(i, sizes)); // May already exist, written by another thread.
+					break;
+				case 1:
+					if (cache.read(make_uri(i), &data) == ShardedMemoryCache::Error::NoError)
+					{
+						hits++;
+						if (!item_is_valid(i, data.data(), data.size(), sizes))
+							corrupt++;
+					}
+					break;
+				case 2:
+					if (cache.read(make_uri(i), &handle) == ShardedMemoryCache::Error::NoError)
+					{
+						hits++;
+						if (!item_is_valid(i, handle.data(), handle.size(), sizes))
+							corrupt++;
+					}
+					break;
+				default:
+					if ((n % 40) == 3)
+						cache.remove(make_uri(i));
+					break;
+				}
+			}
+		});
+	}
+
+	for (auto& thread : threads)
+		thread.join();
+
+	MYRMO_ASSERT(corrupt == 0);
+	MYRMO_ASSERT(hits > 0);
+	MYRMO_ASSERT(cache.size() <= cache.maxSize());
+}
+
+int main()
+{
+	test_insert_read_delete();
+	test_size_limit();
+	test_global_size_limit();
+	test_concurrent_access([]() { return new myrmo::cache::policy::LRU(); });
+	test_concurrent_access([]() { return new myrmo::cache::policy::CLOCK(); });
+	return 0;
+}
@@ -0,0 +1,174 @@
+#include <myrmo/test/assert.h>
+#include <myrmo/test/items.h>
+#include <myrmo/cache/tiered.h>
+#include <myrmo/hash/sha1.h>
+
+#include <string>
+#include <vector>
+
+using myrmo::test::make_uri;
+using myrmo::test::make_item;
+
+static const myrmo::test::ItemSizes sizes(10000, 5000, 7);
+
+static myrmo::cache::TieredCache* make_cache(myrmo::cache::TieredCache::Mode mode)
+{
+	using namespace myrmo::cache;
+	MemoryCache* memory = new MemoryCache(myrmo::hash::sha1, new policy::LRU(), MemoryCache::SizeInBytes(200000));
+	DiskCache* disk = new DiskCache(MYRMO_TESTS_TIERED_CACHE_DIR, myrmo::hash::sha1, new policy::LRU(), 10);
+	return new TieredCache(memory, disk, mode);
+}
+
+void test_inclusive()
+{
+	using namespace myrmo::cache;
+	const size_t itemCount = 100;
+
+	std::unique_ptr<TieredCache> cache(make_cache(TieredCache::Mode::Inclusive));
+	MYRMO_ASSERT(cache->clear() == TieredCache::Error::NoError);
+
+	for (size_t i = 0; i < itemCount; i++)
+		MYRMO_ASSERT(cache->write(make_uri(i), make_item(i, sizes)) == TieredCache::Error::NoError);
+	MYRMO_ASSERT(cache->write(make_uri(0), make_item(0, sizes)) == TieredCache::Error::ItemExists);
+	MYRMO_ASSERT(cache->write(make_uri(itemCount - 1), make_item(0, sizes)) == TieredCache::Error::ItemExists);
+
+	// Every item reaches the disk, the memory tier holds the most recent ones.
+	cache->flush();
+	MYRMO_ASSERT(cache->queuedBytes() == 0);
+	MYRMO_ASSERT(cache->diskCount() == itemCount);
+	MYRMO_ASSERT(cache->memorySize() <= 200000);
+	MYRMO_ASSERT(cache->stats().demotions == itemCount);
+
+	std::vector<char> data;
+	MYRMO_ASSERT(cache->read(make_uri(itemCount - 1), &data) == TieredCache::Error::NoError);
+	MYRMO_ASSERT(data == make_item(itemCount - 1, sizes));
+	MYRMO_ASSERT(cache->stats().memory.hits == 1);
+	MYRMO_ASSERT(cache->stats().disk.hits == 0);
+
+	// A disk hit is promoted, so the second read is a memory hit. The item stays on the disk.
+	MYRMO_ASSERT(cache->read(make_uri(0), &data) == TieredCache::Error::NoError);
+	MYRMO_ASSERT(data == make_item(0, sizes));
+	MYRMO_ASSERT(cache->read(make_uri(0), &data) == TieredCache::Error::NoError);
+	MYRMO_ASSERT(data == make_item(0, sizes));
+	TieredCache::Stats stats = cache->stats();
+	MYRMO_ASSERT(stats.memory.hits == 2);
+	MYRMO_ASSERT(stats.memory.misses == 1);
+	MYRMO_ASSERT(stats.disk.hits == 1);
+	MYRMO_ASSERT(stats.promotions == 1);
+	MYRMO_ASSERT(stats.memory.nanoseconds > 0);
+	MYRMO_ASSERT(stats.disk.nanoseconds > 0);
+	MYRMO_ASSERT(cache->diskCount() == itemCount);
+
+	MYRMO_ASSERT(cache->read("does_not_exist", &data) == TieredCache::Error::ItemDoesNotExist);
+	MYRMO_ASSERT(cache->stats().disk.misses == 1);
+
+	// Removes take the item out of both tiers.
+	MYRMO_ASSERT(cache->remove(make_uri(0)) == TieredCache::Error::NoError);
+	MYRMO_ASSERT(cache->read(make_uri(0), &data) == TieredCache::Error::ItemDoesNotExist);
+	MYRMO_ASSERT(cache->remove(make_uri(0)) == TieredCache::Error::ItemDoesNotExist);
+	MYRMO_ASSERT(cache->diskCount() == itemCount - 1);
+
+	cache->resetStats();
+	MYRMO_ASSERT(cache->stats().memory.hits == 0);
+	MYRMO_ASSERT(cache->clear() == TieredCache::Error::NoError);
+	MYRMO_ASSERT(cache->memoryCount() == 0);
+	MYRMO_ASSERT(cache->diskCount() == 0);
+}
+
+void test_exclusive()
+{
+	using namespace myrmo::cache;
+	const size_t itemCount = 100;
+
+	std::unique_ptr<TieredCache> cache(make_cache(TieredCache::Mode::Exclusive));
+	MYRMO_ASSERT(cache->clear() == TieredCache::Error::NoError);
+
+	for (size_t i = 0; i < itemCount; i++)
+		MYRMO_ASSERT(cache->write(make_uri(i), make_item(i, sizes)) == TieredCache::Error::NoError);
+
+	// Only the items evicted from memory are demoted.
+	cache->flush();
+	MYRMO_ASSERT(cache->memoryCount() + cache->diskCount() == itemCount);
+	MYRMO_ASSERT(cache->stats().demotions == cache->diskCount());
+
+	// Reading every item moves each disk hit into memory, demoting others. Items stay in one tier.
+	std::vector<char> data;
+	for (size_t i = 0; i < itemCount; i++)
+	{
+		MYRMO_ASSERT(cache->read(make_uri(i), &data) == TieredCache::Error::NoError);
+		MYRMO_ASSERT(data == make_item(i, sizes));
+	}
+	cache->flush();
+	MYRMO_ASSERT(cache->memoryCount() + cache->diskCount() == itemCount);
+	MYRMO_ASSERT(cache->stats().promotions > 0);
+
+	for (size_t i = 0; i < itemCount; i += 2)
+		MYRMO_ASSERT(cache->remove(make_uri(i)) == TieredCache::Error::NoError);
+	cache->flush();
+	MYRMO_ASSERT(cache->memoryCount() + cache->diskCount() == itemCount / 2);
+	for (size_t i = 0; i < itemCount; i++)
+		MYRMO_ASSERT(cache->read(make_uri(i), &data) == ((i % 2) ? TieredCache::Error::NoError : TieredCache::Error::ItemDoesNotExist));
+
+	MYRMO_ASSERT(cache->clear() == TieredCache::Error::NoError);
+}
+
+void test_large_items()
+{
+	using namespace myrmo::cache;
+
+	for (const TieredCache::Mode mode : { TieredCache::Mode::Inclusive, TieredCache::Mode::Exclusive })
+	{
+		std::unique_ptr<TieredCache> cache(make_cache(mode));
+		MYRMO_ASSERT(cache->clear() == TieredCache::Error::NoError);
+
+		// Larger than the memory tier, so it is written to the disk directly and never promoted.
+		const std::vector<char> large(300000, 'l');
+		MYRMO_ASSERT(cache->write("large", large) == TieredCache::Error::NoError);
+		MYRMO_ASSERT(cache->memoryCount() == 0);
+		MYRMO_ASSERT(cache->diskCount() == 1);
+
+		std::vector<char> data;
+		MYRMO_ASSERT(cache->read("large", &data) == TieredCache::Error::NoError);
+		MYRMO_ASSERT(data == large);
+		MYRMO_ASSERT(cache->memoryCount() == 0);
+		MYRMO_ASSERT(cache->stats().promotions == 0);
+
+		MYRMO_ASSERT(cache->write("too_large", std::vector<char>(11 * 1048576, 't')) == TieredCache::Error::SizeExceedsCacheSize);
+		MYRMO_ASSERT(cache->write("empty", std::vector<char>()) == TieredCache::Error::ZeroSize);
+		MYRMO_ASSERT(cache->clear() == TieredCache::Error::NoError);
+	}
+}
+
+void test_persistence()
+{
+	using namespace myrmo::cache;
+
+	{
+		std::unique_ptr<TieredCache> cache(make_cache(TieredCache::Mode::Inclusive));
+		MYRMO_ASSERT(cache->clear() == TieredCache::Error::NoError);
+		for (size_t i = 0; i < 10; i++)
+			MYRMO_ASSERT(cache->write(make_uri(i), make_item(i, sizes)) == TieredCache::Error::NoError);
+	}
+
+	// Destroying the cache finishes the queued disk writes, so a new cache finds every item on the disk.
+	std::unique_ptr<TieredCache> cache(make_cache(TieredCache::Mode::Inclusive));
+	MYRMO_ASSERT(cache->memoryCount() == 0);
+	MYRMO_ASSERT(cache->diskCount() == 10);
+	std::vector<char> data;
+	for (size_t i = 0; i < 10; i++)
+	{
+		MYRMO_ASSERT(cache->read(make_uri(i), &data) == TieredCache::Error::NoError);
+		MYRMO_ASSERT(data == make_item(i, sizes));
+	}
+	MYRMO_ASSERT(cache->stats().disk.hits == 10);
+	MYRMO_ASSERT(cache->clear() == TieredCache::Error::NoError);
+}
+
+int main()
+{
+	test_inclusive();
+	test_exclusive();
+	test_large_items();
+	test_persistence();
+	return 0;
+}
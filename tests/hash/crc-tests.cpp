@@ -1,6 +1,8 @@
 #include <myrmo/test/assert.h>
 #include <myrmo/hash/crc.h>
 
+#include <vector>
+
 #include <cmrc/cmrc.hpp>
 
 CMRC_DECLARE(test_data);
@@ -109,6 +111,58 @@ void test_urls()
 	MYRMO_ASSERT(hash == 0xA254CAC3);
 }
 
+void test_incremental()
+{
+	const std::string text("The quick brown fox jumps over the lazy dog");
+	for (size_t split = 0; split <= text.size(); split++)
+	{
+		const uint32_t first = myrmo::hash::crc32(text.data(), split);
+		MYRMO_ASSERT(myrmo::hash::crc32(text.data() + split, text.size() - split, first) == 0x414FA339);
+	}
+	MYRMO_ASSERT(myrmo::hash::crc32(text.data(), 0, 0x414FA339) == 0x414FA339);
+}
+
+void test_kernels()
+{
+	using namespace myrmo::hash::detail;
+	MYRMO_ASSERT(crc_slices_32.slices[0].values[0x80] == myrmo::hash::crc_table_32[0x80]);
+
+	// Every length and alignment around the block sizes gives the same checksum as the byte-wise kernel.
+	std::vector<unsigned char> data(1000);
+	for (size_t i = 0; i < data.size(); i++)
+		data[i] = static_cast<unsigned char>((i * 2654435761u) >> 13);
+	for (size_t offset = 0; offset < 16; offset++)
+	{
+		for (size_t size = 0; size + offset <= data.size(); size += (size < 64) ? 1 : 37)
+		{
+			const uint32_t expected = crc32_bytewise(data.data() + offset, size, 0x12345678);
+			MYRMO_ASSERT(crc32_sliced<4>(data.data() + offset, size, 0x12345678) == expected);
+			MYRMO_ASSERT(crc32_sliced<8>(data.data() + offset, size, 0x12345678) == expected);
+			MYRMO_ASSERT(crc32_sliced<16>(data.data() + offset, size, 0x12345678) == expected);
+			MYRMO_ASSERT(myrmo::hash::crc32(reinterpret_cast<const char*>(data.data()) + offset, size, ~0x12345678u) == ~expected);
+#ifdef MYRMO_HAS_X86_DISPATCH
+			if (myrmo::util::cpu_features().pclmul && myrmo::util::cpu_features().sse41 && (size >= 64) && (size % 16 == 0))
+			{
+				MYRMO_ASSERT(crc32_clmul(data.data() + offset, size, 0x12345678) == expected);
+			}
+#endif
+		}
+	}
+}
+
+void test_constexpr()
+{
+	static_assert(myrmo::hash::crc32_constexpr("") == 0, "crc32 of nothing");
+	static_assert(myrmo::hash::crc32_constexpr("CRYPTO") == 0x98D0EF03, "crc32 of a literal");
+	constexpr uint32_t fox = myrmo::hash::crc32_constexpr("The quick brown fox jumps over the lazy dog");
+	static_assert(fox == 0x414FA339, "crc32 of a literal");
+	static_assert(myrmo::hash::crc32_constexpr(" dog", 4, myrmo::hash::crc32_constexpr("The quick brown fox jumps over the lazy")) == fox, "continued crc32");
+
+	const std::string text(get_file("test_data/lorem_ipsum_10_paragraphs.txt"));
+	for (size_t size = 0; size <= text.size(); size += (size < 128) ? 1 : 97)
+		MYRMO_ASSERT(myrmo::hash::crc32_constexpr(text.data(), size) == myrmo::hash::crc32(text.data(), size));
+}
+
 int main()
 {
 	// Note: Results are validated at https://crccalc.com/, http://www.zorc.breitbandkatze.de/crc.html and crc32 on the command line.
@@ -116,5 +170,8 @@ int main()
 	test_medium_strings();
 	test_long_strings();
 	test_urls();
+	test_incremental();
+	test_kernels();
+	test_constexpr();
 	return 0;
 }
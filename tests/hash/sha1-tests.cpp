@@ -1,6 +1,10 @@
 #include <myrmo/test/assert.h>
 #include <myrmo/hash/sha1.h>
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
 #include <cmrc/cmrc.hpp>
 
 CMRC_DECLARE(test_data);
@@ -109,11 +113,180 @@ void test_urls()
 	MYRMO_ASSERT(hash == "2935675a409f251c6a48a96fa4eb198b789a8f0f");
 }
 
+void test_streaming()
+{
+	// Every split of messages around the block and padding boundaries gives the one-shot digest.
+	const std::string text(get_file("test_data/lorem_ipsum_10_paragraphs.txt"));
+	for (size_t size = 0; size <= 200; size++)
+	{
+		const std::string message(text.substr(0, size));
+		const std::string expected(myrmo::hash::sha1(message));
+		for (size_t split = 0; split <= size; split += 7)
+		{
+			myrmo::hash::Sha1 sha1;
+			sha1.update(message.data(), split);
+			sha1.update(message.data() + split, size - split);
+			MYRMO_ASSERT(sha1.finalize() == expected);
+		}
+	}
+
+	// Uneven pieces of a long message, and reuse of the hasher after finalize().
+	myrmo::hash::Sha1 sha1;
+	for (size_t offset = 0, piece = 1; offset < text.size(); offset += piece, piece = piece * 3 % 1000 + 1)
+		sha1.update(text.data() + offset, std::min(piece, text.size() - offset));
+	MYRMO_ASSERT(sha1.finalize() == "39f126116f2c5fef838d8bd69c49e3caacdc5cdd");
+
+	const std::string block(1000, 'a');
+	for (size_t i = 0; i < 1000; i++)
+		sha1.update(block);
+	MYRMO_ASSERT(sha1.finalize() == "34aa973cd4c4daa4f61eeb2bdbad27316534016f"); // FIPS 180 test vector, one million 'a'.
+
+	MYRMO_ASSERT(sha1.finalize() == "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+}
+
+void test_kernels()
+{
+	using namespace myrmo::hash::detail;
+	const std::string text(get_file("test_data/lorem_ipsum_10_paragraphs.txt"));
+	const unsigned char* data = reinterpret_cast<const unsigned char*>(text.data());
+
+	for (size_t count = 0; count * 64 <= text.size(); count += (count < 8) ? 1 : 13)
+	{
+		uint32_t expected[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+		sha1_compress_scalar(expected, data, count);
+
+		uint32_t state[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+		sha1_compress(state, data, count);
+		MYRMO_ASSERT(std::equal(state, state + 5, expected));
+
+#ifdef MYRMO_HAS_X86_DISPATCH
+		const myrmo::util::CpuFeatures& cpu = myrmo::util::cpu_features();
+		if (cpu.sha && cpu.ssse3 && cpu.sse41)
+		{
+			uint32_t ni[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+			sha1_compress_ni(ni, data, count);
+			MYRMO_ASSERT(std::equal(ni, ni + 5, expected));
+		}
+#endif
+	}
+
+	// The scalar kernel on its own, against a known digest.
+	uint32_t state[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+	unsigned char block[64] = { 'a', 'b', 'c', 0x80 };
+	block[63] = 24;
+	sha1_compress_scalar(state, block, 1);
+	const uint32_t abc[5] = { 0xa9993e36, 0x4706816a, 0xba3e2571, 0x7850c26c, 0x9cd0d89d };
+	MYRMO_ASSERT(std::equal(state, state + 5, abc));
+}
+
+void test_digests()
+{
+	using namespace myrmo::hash;
+
+	const uint8_t abc[20] = { 0xa9, 0x99, 0x3e, 0x36, 0x47, 0x06, 0x81, 0x6a, 0xba, 0x3e,
+		0x25, 0x71, 0x78, 0x50, 0xc2, 0x6c, 0x9c, 0xd0, 0xd8, 0x9d };
+	uint8_t digest[20];
+	sha1("abc", 3, digest);
+	MYRMO_ASSERT(memcmp(digest, abc, 20) == 0);
+	MYRMO_ASSERT(memcmp(sha1_digest("abc").data(), abc, 20) == 0);
+
+	Sha1 hasher;
+	hasher.update("ab", 2);
+	hasher.update("c", 1);
+	hasher.finalize(digest);
+	MYRMO_ASSERT(memcmp(digest, abc, 20) == 0);
+
+	// The hex helpers round trip, and decode either case.
+	const std::string hex(myrmo::util::hex_encode(abc, 20));
+	MYRMO_ASSERT(hex == "a9993e364706816aba3e25717850c26c9cd0d89d");
+	MYRMO_ASSERT(hex == sha1("abc"));
+	memset(digest, 0, 20);
+	MYRMO_ASSERT(myrmo::util::hex_decode(hex, digest, 20));
+	MYRMO_ASSERT(memcmp(digest, abc, 20) == 0);
+	MYRMO_ASSERT(myrmo::util::hex_decode("A9993E364706816ABA3E25717850C26C9CD0D89D", digest, 20));
+	MYRMO_ASSERT(memcmp(digest, abc, 20) == 0);
+
+	MYRMO_ASSERT(!myrmo::util::hex_decode(hex.substr(1), digest, 20));
+	MYRMO_ASSERT(!myrmo::util::hex_decode("0g", digest, 1));
+	MYRMO_ASSERT(!myrmo::util::hex_decode("/0", digest, 1));
+	MYRMO_ASSERT(!myrmo::util::hex_decode(":0", digest, 1));
+	MYRMO_ASSERT(!myrmo::util::hex_decode("@0", digest, 1));
+	MYRMO_ASSERT(!myrmo::util::hex_decode("`0", digest, 1));
+	for (int i = 0; i < 256; i++)
+	{
+		const uint8_t byte = uint8_t(i);
+		uint8_t decoded = 0;
+		MYRMO_ASSERT(myrmo::util::hex_decode(myrmo::util::hex_encode(&byte, 1), &decoded, 1));
+		MYRMO_ASSERT(decoded == byte);
+	}
+}
+
+void test_many()
+{
+	using namespace myrmo::hash;
+
+	// Lengths around the padding and block boundaries, in batches that leave lanes idle.
+	const std::string text(get_file("test_data/lorem_ipsum_10_paragraphs.txt"));
+	std::vector<std::string> messages;
+	for (size_t size = 0; size < 200; size++)
+		messages.push_back(text.substr(size, size));
+	messages.push_back(text);
+
+	for (size_t count : { size_t(0), size_t(1), size_t(7), size_t(17), messages.size() })
+	{
+		std::vector<std::string> hex(count);
+		sha1_many(messages.data(), count, hex.data());
+		for (size_t i = 0; i < count; i++)
+			MYRMO_ASSERT(hex[i] == sha1(messages[i]));
+
+		std::vector<Sha1Digest> expected(count);
+		for (size_t i = 0; i < count; i++)
+			expected[i] = sha1_digest(messages[i]);
+
+#ifdef MYRMO_HAS_X86_DISPATCH
+		const myrmo::util::CpuFeatures& cpu = myrmo::util::cpu_features();
+		std::vector<Sha1Digest> digests(count);
+		if (cpu.avx2)
+		{
+			detail::sha1_many_avx2(messages.data(), count, digests.data());
+			MYRMO_ASSERT(digests == expected);
+		}
+		if (cpu.avx512)
+		{
+			detail::sha1_many_avx512(messages.data(), count, digests.data());
+			MYRMO_ASSERT(digests == expected);
+		}
+#endif
+	}
+}
+
+void test_constexpr()
+{
+	using namespace myrmo::hash;
+
+	constexpr Sha1Digest abc = sha1_constexpr("abc");
+	static_assert((abc[0] == 0xa9) && (abc[1] == 0x99) && (abc[18] == 0xd8) && (abc[19] == 0x9d), "sha1 of a literal");
+	constexpr Sha1Digest empty = sha1_constexpr("");
+	static_assert((empty[0] == 0xda) && (empty[19] == 0x09), "sha1 of nothing");
+	MYRMO_ASSERT(myrmo::util::hex_encode(empty.data(), empty.size()) == "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+
+	// Every length around the padding and block boundaries.
+	const std::string text(get_file("test_data/lorem_ipsum_10_paragraphs.txt"));
+	for (size_t size = 0; size <= 300; size++)
+		MYRMO_ASSERT(sha1_constexpr(text.data(), size) == sha1_digest(text.substr(0, size)));
+	MYRMO_ASSERT(sha1_constexpr(text.data(), text.size()) == sha1_digest(text));
+}
+
 int main()
 {
 	test_short_strings();
 	test_medium_strings();
 	test_long_strings();
 	test_urls();
+	test_streaming();
+	test_kernels();
+	test_digests();
+	test_many();
+	test_constexpr();
 	return 0;
 }
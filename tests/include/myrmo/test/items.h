@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstring>
+
+namespace myrmo { namespace test
+{
+	// Item sizes run from base bytes up in count steps of step bytes, by item number.
+	struct ItemSizes
+	{
+		ItemSizes(size_t base, size_t step, size_t count) : base(base), step(step), count(count) {}
+		size_t base;
+		size_t step;
+		size_t count;
+	};
+
+	inline std::string make_uri(size_t i)
+	{
+		return "https://example.com/item/" + std::to_string(i);
+	}
+
+	// Item contents are derived from the item number, so any thread can verify what it reads.
+	inline std::vector<char> make_item(size_t i, const ItemSizes& sizes)
+	{
+		return std::vector<char>(sizes.base + (i % sizes.count) * sizes.step, char(i % 251));
+	}
+
+	inline bool item_is_valid(size_t i, const char* data, size_t size, const ItemSizes& sizes)
+	{
+		const std::vector<char> expected = make_item(i, sizes);
+		return (size == expected.size()) && (memcmp(data, expected.data(), size) == 0);
+	}
+
+}} // End namespace myrmo::test
@@ -0,0 +1,105 @@
+#include <myrmo/test/assert.h>
+#include <myrmo/util/io_uring.h>
+
+#include <string>
+#include <vector>
+#include <dirent.h>
+
+// Counts the open descriptors of the process, to find descriptors that a batch leaks.
+static size_t open_descriptors()
+{
+	size_t count = 0;
+	DIR* dir = opendir("/proc/self/fd");
+	while (dirent* entry = readdir(dir))
+	{
+		if (entry->d_name[0] != '.')
+			count++;
+	}
+	closedir(dir);
+	return count;
+}
+
+void test_write_read_rename_unlink(myrmo::util::IoUring* ring)
+{
+	using namespace myrmo::util;
+	const std::string dir(MYRMO_TESTS_FILE_BATCH_DIR);
+	const size_t descriptors = open_descriptors();
+
+	std::vector<std::string> data;
+	for (size_t i = 0; i < 100; i++)
+		data.push_back(std::string(100 + i * 10, char('a' + i % 26)));
+
+	FileBatch writes(ring);
+	for (size_t i = 0; i < data.size(); i++)
+		MYRMO_ASSERT(writes.write(dir + "/" + std::to_string(i), data[i].data(), data[i].size(), false, i % 2) == i);
+	writes.submit();
+	for (size_t i = 0; i < data.size(); i++)
+		MYRMO_ASSERT(writes.result(i) == 0);
+
+	FileBatch reads(ring);
+	std::vector<std::vector<char>> out(data.size());
+	for (size_t i = 0; i < data.size(); i++)
+	{
+		out[i].resize(data[i].size() - 10);
+		reads.read(dir + "/" + std::to_string(i), 10, out[i].size(), out[i].data());
+	}
+	std::vector<char> past(data[0].size() + 1);
+	reads.read(dir + "/0", 0, past.size(), past.data()); // Past the end of the file.
+	reads.submit();
+	for (size_t i = 0; i < data.size(); i++)
+	{
+		MYRMO_ASSERT(reads.result(i) == 0);
+		MYRMO_ASSERT(std::string(out[i].begin(), out[i].end()) == data[i].substr(10));
+	}
+	MYRMO_ASSERT(reads.result(data.size()) == -EIO);
+
+	FileBatch renames(ring);
+	renames.rename(dir + "/0", dir + "/renamed");
+	renames.rename(dir + "/1", dir + "/2", true);
+	renames.submit();
+	MYRMO_ASSERT(renames.result(0) == 0);
+	MYRMO_ASSERT(renames.result(1) == -EEXIST);
+
+	FileBatch unlinks(ring);
+	unlinks.unlink(dir + "/renamed");
+	unlinks.unlink(dir + "/0");
+	for (size_t i = 1; i < data.size(); i++)
+		unlinks.unlink(dir + "/" + std::to_string(i));
+	unlinks.submit();
+	MYRMO_ASSERT(unlinks.result(0) == 0);
+	MYRMO_ASSERT(unlinks.result(1) == -ENOENT);
+	for (size_t i = 2; i < unlinks.size(); i++)
+		MYRMO_ASSERT(unlinks.result(i) == 0);
+
+	MYRMO_ASSERT(open_descriptors() == descriptors);
+}
+
+void test_failed_writes(myrmo::util::IoUring* ring)
+{
+	using namespace myrmo::util;
+	const size_t descriptors = open_descriptors();
+
+	// Every write to /dev/full fails. The files are still closed, also when the write is followed by an fsync.
+	const std::vector<char> data(4096, 'x');
+	FileBatch batch(ring);
+	for (size_t i = 0; i < 20; i++)
+		batch.write("/dev/full", data.data(), data.size(), false, i % 2);
+	batch.write(std::string(MYRMO_TESTS_FILE_BATCH_DIR) + "/missing/file", data.data(), data.size());
+	batch.submit();
+	for (size_t i = 0; i < 20; i++)
+		MYRMO_ASSERT(batch.result(i) == -ENOSPC);
+	MYRMO_ASSERT(batch.result(20) == -ENOENT);
+
+	MYRMO_ASSERT(open_descriptors() == descriptors);
+}
+
+int main()
+{
+	test_write_read_rename_unlink(nullptr);
+	test_failed_writes(nullptr);
+
+	myrmo::util::IoUring ring(16);
+	test_write_read_rename_unlink(&ring);
+	test_failed_writes(&ring);
+	return 0;
+}